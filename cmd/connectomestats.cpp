@@ -103,6 +103,7 @@ void load_tfce_parameters (Stats::TFCE::Wrapper& enhancer)
   const default_type E  = get_option_value ("tfce_e", TFCE_E_DEFAULT);
   const default_type H  = get_option_value ("tfce_h", TFCE_H_DEFAULT);
   enhancer.set_tfce_parameters (dH, E, H);
+  enhancer.set_stepwise (get_options ("tfce_stepwise").size());
 }
 
 
@@ -18,8 +18,8 @@
 #include "phase_encoding.h"
 #include "progressbar.h"
 #include "algo/threaded_copy.h"
-#include "math/least_squares.h"
 #include "dwi/gradient.h"
+#include "dwi/tensor.h"
 
 
 using namespace MR;
@@ -46,33 +46,46 @@ using value_type = float;
 
 
 
+// fits the mono-exponential model to a row of voxels at a time:
 class DWI2ADC { MEMALIGN(DWI2ADC)
   public:
-    DWI2ADC (const Eigen::MatrixXd& binv, size_t dwi_axis) :
-      dwi (binv.cols()),
-      adc (2), 
-      binv (binv), 
-      dwi_axis (dwi_axis) { }
-
-    template <class DWIType, class ADCType>
-      void operator() (DWIType& dwi_image, ADCType& adc_image) {
-        for (auto l = Loop (dwi_axis) (dwi_image); l; ++l) {
+    DWI2ADC (const Eigen::MatrixXd& b, size_t dwi_axis, const vector<size_t>& outer_axes, size_t row_axis,
+        const Image<value_type>& dwi_image, const Image<value_type>& adc_image) :
+      fit (b, 0),
+      dwi_axis (dwi_axis),
+      outer_axes (outer_axes),
+      row_axis (row_axis),
+      dwi_image (dwi_image),
+      adc_image (adc_image) { }
+
+    void operator() (const Iterator& pos) {
+      assign_pos_of (pos, outer_axes).to (dwi_image, adc_image);
+
+      dwi.resize (dwi_image.size (dwi_axis), dwi_image.size (row_axis));
+      for (auto l = Loop (row_axis) (dwi_image); l; ++l) {
+        for (auto l2 = Loop (dwi_axis) (dwi_image); l2; ++l2) {
           value_type val = dwi_image.value();
-          dwi[dwi_image.index (dwi_axis)] = val ? std::log (val) : 1.0e-12;
+          dwi (dwi_image.index (dwi_axis), dwi_image.index (row_axis)) = val ? std::log (val) : 1.0e-12;
         }
+      }
 
-        adc = binv * dwi;
+      fit (dwi, adc);
 
+      for (auto l = Loop (row_axis) (adc_image); l; ++l) {
         adc_image.index(3) = 0;
-        adc_image.value() = std::exp (adc[0]);
+        adc_image.value() = std::exp (adc (0, adc_image.index (row_axis)));
         adc_image.index(3) = 1;
-        adc_image.value() = adc[1];
+        adc_image.value() = adc (1, adc_image.index (row_axis));
       }
+    }
 
   protected:
-    Eigen::VectorXd dwi, adc;
-    const Eigen::MatrixXd& binv;
+    DWI::TensorFit<double> fit;
+    Eigen::MatrixXd dwi, adc;
     const size_t dwi_axis;
+    const vector<size_t>& outer_axes;
+    const size_t row_axis;
+    Image<value_type> dwi_image, adc_image;
 };
 
 
@@ -93,8 +106,6 @@ void run () {
     b(i,1) = -grad (i,3);
   }
 
-  auto binv = Math::pinv (b);
-
   Header header (dwi);
   header.datatype() = DataType::Float32;
   header.ndim() = 4;
@@ -104,8 +115,8 @@ void run () {
 
   auto adc = Image<value_type>::create (argument[1], header);
 
-  ThreadedLoop ("computing ADC values", dwi, 0, 3)
-    .run (DWI2ADC (binv, dwi_axis), dwi, adc);
+  auto loop = ThreadedLoop ("computing ADC values", dwi, 0, 3);
+  loop.run_outer (DWI2ADC (b, dwi_axis, loop.outer_loop.axes, loop.inner_axes[0], dwi, adc));
 }
 
 
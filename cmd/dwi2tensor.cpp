@@ -72,96 +72,103 @@ void usage ()
 
 }
 
-template <class MASKType, class B0Type, class DKTType, class PredictType>
+// fits the tensor model to a row of voxels at a time, such that the bulk
+// of the computation can be performed as matrix-matrix products:
 class Processor { MEMALIGN(Processor)
   public:
-    Processor (const Eigen::MatrixXd& b, const int iter, MASKType* mask_image, B0Type* b0_image, DKTType* dkt_image, PredictType* predict_image) :
+    Processor (const Eigen::MatrixXd& b, const int iter, const vector<size_t>& outer_axes, size_t row_axis,
+        const Image<value_type>& dwi_image, const Image<value_type>& dt_image,
+        Image<bool>* mask_image, Image<value_type>* b0_image, Image<value_type>* dkt_image, Image<value_type>* predict_image) :
+      outer_axes (outer_axes),
+      row_axis (row_axis),
+      dwi_image (dwi_image),
+      dt_image (dt_image),
       mask_image (mask_image),
       b0_image (b0_image),
       dkt_image (dkt_image),
       predict_image (predict_image),
-      dwi(b.rows()),
-      p(b.cols()),
-      w(b.rows()),
-      work(b.cols(),b.cols()),
-      llt(work.rows()),
-      b(b),
-      maxit(iter) { }
-
-    template <class DWIType, class DTType>
-      void operator() (DWIType& dwi_image, DTType& dt_image)
-      {
+      fit (b, iter),
+      b (b) { }
+
+    void operator() (const Iterator& pos)
+    {
+      assign_pos_of (pos, outer_axes).to (dwi_image, dt_image);
+      if (mask_image)
+        assign_pos_of (pos, outer_axes).to (*mask_image);
+
+      voxels.clear();
+      for (auto l = Loop (row_axis) (dwi_image); l; ++l) {
         if (mask_image) {
-          assign_pos_of (dwi_image, 0, 3).to (*mask_image);
+          mask_image->index (row_axis) = dwi_image.index (row_axis);
           if (!mask_image->value())
-            return;
+            continue;
         }
-        
+        voxels.push_back (dwi_image.index (row_axis));
+      }
+      if (voxels.empty())
+        return;
+
+      dwi.resize (b.rows(), voxels.size());
+      for (size_t n = 0; n < voxels.size(); ++n) {
+        dwi_image.index (row_axis) = voxels[n];
         for (auto l = Loop (3) (dwi_image); l; ++l)
-          dwi[dwi_image.index(3)] = dwi_image.value();
-        
-        double small_intensity = 1.0e-6 * dwi.maxCoeff(); 
-        for (int i = 0; i < dwi.rows(); i++) {
-          if (dwi[i] < small_intensity)
-            dwi[i] = small_intensity;
-          dwi[i] = std::log (dwi[i]);
-        }
-        
-        work.setZero();
-        work.selfadjointView<Eigen::Lower>().rankUpdate (b.transpose());
-        p = llt.compute (work.selfadjointView<Eigen::Lower>()).solve(b.transpose()*dwi);
-        for (int it = 0; it < maxit; it++) {
-          w = (b*p).array().exp();
-          work.setZero();
-          work.selfadjointView<Eigen::Lower>().rankUpdate (b.transpose()*w.asDiagonal());
-          p = llt.compute (work.selfadjointView<Eigen::Lower>()).solve(b.transpose()*w.asDiagonal()*w.asDiagonal()*dwi);
-        }
-        
-        if (b0_image) {
-          assign_pos_of (dwi_image, 0, 3).to (*b0_image);
-          b0_image->value() = exp(p[6]);
-        }
-        
-        for (auto l = Loop(3)(dt_image); l; ++l) {
-          dt_image.value() = p[dt_image.index(3)];
+          dwi (dwi_image.index (3), n) = dwi_image.value();
+        const double small_intensity = 1.0e-6 * dwi.col (n).maxCoeff();
+        for (ssize_t i = 0; i < dwi.rows(); ++i)
+          dwi (i, n) = std::log (std::max (dwi (i, n), small_intensity));
+      }
+
+      fit (dwi, p);
+
+      for (size_t n = 0; n < voxels.size(); ++n) {
+        dt_image.index (row_axis) = voxels[n];
+        for (auto l = Loop (3) (dt_image); l; ++l)
+          dt_image.value() = p (dt_image.index (3), n);
+      }
+
+      if (b0_image) {
+        assign_pos_of (pos, outer_axes).to (*b0_image);
+        for (size_t n = 0; n < voxels.size(); ++n) {
+          b0_image->index (row_axis) = voxels[n];
+          b0_image->value() = std::exp (p (6, n));
         }
-        
-        if (dkt_image) {
-          assign_pos_of (dwi_image, 0, 3).to (*dkt_image);
-          double adc_sq = (p[0]+p[1]+p[2])*(p[0]+p[1]+p[2])/9.0;
-          for (auto l = Loop(3)(*dkt_image); l; ++l) {
-            dkt_image->value() = p[dkt_image->index(3)+7]/adc_sq;
-          }
+      }
+
+      if (dkt_image) {
+        assign_pos_of (pos, outer_axes).to (*dkt_image);
+        for (size_t n = 0; n < voxels.size(); ++n) {
+          dkt_image->index (row_axis) = voxels[n];
+          const double adc_sq = Math::pow2 (p (0, n) + p (1, n) + p (2, n)) / 9.0;
+          for (auto l = Loop (3) (*dkt_image); l; ++l)
+            dkt_image->value() = p (dkt_image->index (3) + 7, n) / adc_sq;
         }
-        
-        if (predict_image) {
-          assign_pos_of (dwi_image, 0, 3).to (*predict_image);
-          dwi = (b*p).array().exp();
-          for (auto l = Loop(3)(*predict_image); l; ++l) {
-            predict_image->value() = dwi[predict_image->index(3)];
-          }
+      }
+
+      if (predict_image) {
+        assign_pos_of (pos, outer_axes).to (*predict_image);
+        dwi.noalias() = b * p;
+        for (size_t n = 0; n < voxels.size(); ++n) {
+          predict_image->index (row_axis) = voxels[n];
+          for (auto l = Loop (3) (*predict_image); l; ++l)
+            predict_image->value() = std::exp (dwi (predict_image->index (3), n));
         }
-        
       }
+    }
 
   private:
-    copy_ptr<MASKType> mask_image;
-    copy_ptr<B0Type> b0_image;
-    copy_ptr<DKTType> dkt_image;
-    copy_ptr<PredictType> predict_image;
-    Eigen::VectorXd dwi;
-    Eigen::VectorXd p;
-    Eigen::VectorXd w;
-    Eigen::MatrixXd work;
-    Eigen::LLT<Eigen::MatrixXd> llt;
-    const Eigen::MatrixXd& b;
-    const int maxit;
+    const vector<size_t>& outer_axes;
+    const size_t row_axis;
+    Image<value_type> dwi_image, dt_image;
+    copy_ptr<Image<bool>> mask_image;
+    copy_ptr<Image<value_type>> b0_image;
+    copy_ptr<Image<value_type>> dkt_image;
+    copy_ptr<Image<value_type>> predict_image;
+    DWI::TensorFit<double> fit;
+    const Eigen::MatrixXd b;
+    Eigen::MatrixXd dwi, p;
+    vector<ssize_t> voxels;
 };
 
-template <class MASKType, class B0Type, class DKTType, class PredictType> 
-inline Processor<MASKType, B0Type, DKTType, PredictType> processor (const Eigen::MatrixXd& b, const int& iter, MASKType* mask_image, B0Type* b0_image, DKTType* dkt_image, PredictType* predict_image) {
-  return { b, iter, mask_image, b0_image, dkt_image, predict_image };
-}
 
 void run ()
 {
@@ -209,6 +216,7 @@ void run ()
   
   Eigen::MatrixXd b = -DWI::grad2bmatrix<double> (grad, opt.size()>0);
 
-  ThreadedLoop("computing tensors", dwi, 0, 3).run (processor (b, iter, mask, b0, dkt, predict), dwi, dt);
+  auto loop = ThreadedLoop ("computing tensors", dwi, 0, 3);
+  loop.run_outer (Processor (b, iter, loop.outer_loop.axes, loop.inner_axes[0], dwi, dt, mask, b0, dkt, predict));
 }
 
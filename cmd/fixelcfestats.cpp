@@ -28,6 +28,7 @@
 #include "stats/cfe.h"
 #include "stats/enhance.h"
 #include "stats/permtest.h"
+#include "stats/subjects.h"
 #include "dwi/tractography/file.h"
 #include "dwi/tractography/mapping/mapper.h"
 #include "dwi/tractography/mapping/loader.h"
@@ -92,6 +93,8 @@ void usage ()
 
   + Stats::PermTest::Options (true)
 
+  + Stats::Subjects::Options()
+
   + OptionGroup ("Parameters for the Connectivity-based Fixel Enhancement algorithm")
 
   + Option ("cfe_dh", "the height increment used in the cfe integration (default: " + str(DEFAULT_CFE_DH, 2) + ")")
@@ -400,41 +403,43 @@ void run() {
   // Load input data
   matrix_type data (mask_fixels, identifiers.size());
   data.setZero();
-  {
-    ProgressBar progress (std::string ("loading input images") + (do_smoothing ? " and smoothing" : ""), identifiers.size());
-    for (size_t subject = 0; subject < identifiers.size(); subject++) {
-      LogLevelLatch log_level (0);
-
-      auto subject_data = Image<value_type>::open (identifiers[subject]).with_direct_io();
-      vector<value_type> subject_data_vector (mask_fixels, 0.0);
-      for (auto i = Loop (index_image, 0, 3)(index_image); i; ++i) {
-        index_image.index(3) = 1;
-        uint32_t offset = index_image.value();
-        uint32_t fixel_index = 0;
-        for (auto f = Fixel::Loop (index_image) (subject_data); f; ++f, ++fixel_index) {
-          if (!std::isfinite(static_cast<value_type>(subject_data.value())))
-            throw Exception ("subject data file " + identifiers[subject] + " contains non-finite value: " + str(subject_data.value()));
-          // Note that immediately on import, data are re-arranged according to fixel mask
-          const int32_t row = fixel2row[offset+fixel_index];
-          if (row >= 0)
-            subject_data_vector[row] = subject_data.value();
+  Stats::Subjects::load (data, identifiers,
+      "fixelcfestats; template: " + std::string (argument[0]) + "; tracks: " + std::string (argument[4])
+      + "; mask: " + (get_options ("mask").size() ? std::string (get_options ("mask")[0][0]) : std::string ("none"))
+      + "; smoothing FWHM: " + output_header.keyval()["smoothing FWHM"]
+      + "; connectivity threshold: " + output_header.keyval()["connectivity threshold"]
+      + "; angular threshold: " + output_header.keyval()["angular threshold"],
+      [&] (size_t subject) {
+        // Each thread requires its own copy of the index image for access
+        auto index = index_image;
+        auto subject_data = Image<value_type>::open (identifiers[subject]).with_direct_io();
+        vector<value_type> subject_data_vector (mask_fixels, 0.0);
+        for (auto i = Loop (index, 0, 3)(index); i; ++i) {
+          index.index(3) = 1;
+          uint32_t offset = index.value();
+          uint32_t fixel_index = 0;
+          for (auto f = Fixel::Loop (index) (subject_data); f; ++f, ++fixel_index) {
+            if (!std::isfinite(static_cast<value_type>(subject_data.value())))
+              throw Exception ("subject data file " + identifiers[subject] + " contains non-finite value: " + str(subject_data.value()));
+            // Note that immediately on import, data are re-arranged according to fixel mask
+            const int32_t row = fixel2row[offset+fixel_index];
+            if (row >= 0)
+              subject_data_vector[row] = subject_data.value();
+          }
         }
-      }
 
-      // Smooth the data
-      if (do_smoothing) {
-        for (size_t fixel = 0; fixel < mask_fixels; ++fixel) {
-          value_type value = 0.0;
-          for (auto i : smoothing_weights[fixel])
-            value += subject_data_vector[i.index()] * i.value();
-          data (fixel, subject) = value;
+        // Smooth the data
+        if (do_smoothing) {
+          for (size_t fixel = 0; fixel < mask_fixels; ++fixel) {
+            value_type value = 0.0;
+            for (auto i : smoothing_weights[fixel])
+              value += subject_data_vector[i.index()] * i.value();
+            data (fixel, subject) = value;
+          }
+        } else {
+          data.col (subject) = Eigen::Map<Eigen::Matrix<value_type, Eigen::Dynamic, 1> > (subject_data_vector.data(), mask_fixels);
         }
-      } else {
-        data.col (subject) = Eigen::Map<Eigen::Matrix<value_type, Eigen::Dynamic, 1> > (subject_data_vector.data(), mask_fixels);
-      }
-      progress++;
-    }
-  }
+      }, std::string ("loading input images") + (do_smoothing ? " and smoothing" : ""));
 
   // Free the memory occupied by the data smoothing filter; no longer required
   Stats::CFE::norm_connectivity_matrix_type().swap (smoothing_weights);
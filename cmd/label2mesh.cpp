@@ -95,9 +95,8 @@ void run ()
   {
     std::mutex mutex;
     ProgressBar progress ("Generating meshes from labels", lower_corners.size() - 1);
-    auto loader = [&] (size_t& out) { static size_t i = 1; out = i++; return (out != lower_corners.size()); };
 
-    auto worker = [&] (const size_t& in)
+    auto mesh_label = [&] (const size_t in, const size_t nthreads)
     {
       vector<int> from, dimensions;
       for (size_t axis = 0; axis != 3; ++axis) {
@@ -113,13 +112,39 @@ void run ()
       if (blocky)
         MR::Surface::Algo::image2mesh_blocky (scratch, meshes[in]);
       else
-        MR::Surface::Algo::image2mesh_mc (scratch, meshes[in], 0.5);
+        MR::Surface::Algo::image2mesh_mc (scratch, meshes[in], 0.5, nthreads);
       meshes[in].set_name (str(in));
       std::lock_guard<std::mutex> lock (mutex);
       ++progress;
-      return true;
     };
 
+    // Balance the work across labels & slabs: any structure that would by
+    //   itself take longer than an even share of the total work is meshed
+    //   using all threads (Marching Cubes only), while the remainder are
+    //   distributed across threads with one label per thread
+    const size_t nthreads = Thread::number_of_threads();
+    vector<size_t> large_labels, small_labels;
+    {
+      vector<size_t> volumes (lower_corners.size(), 0);
+      size_t total_volume = 0;
+      for (size_t in = 1; in != lower_corners.size(); ++in) {
+        volumes[in] = (upper_corners[in] - lower_corners[in] + 1).max (0).prod();
+        total_volume += volumes[in];
+      }
+      for (size_t in = 1; in != lower_corners.size(); ++in) {
+        if (!blocky && nthreads > 1 && volumes[in] * nthreads > total_volume)
+          large_labels.push_back (in);
+        else
+          small_labels.push_back (in);
+      }
+    }
+
+    for (auto in : large_labels)
+      mesh_label (in, nthreads);
+
+    size_t next = 0;
+    auto loader = [&] (size_t& out) { if (next == small_labels.size()) return false; out = small_labels[next++]; return true; };
+    auto worker = [&] (const size_t& in) { mesh_label (in, 1); return true; };
     Thread::run_queue (loader, size_t(), Thread::multi (worker));
   }
 
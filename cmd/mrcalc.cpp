@@ -135,6 +135,8 @@ OPTIONS
 
 
   + DataType::options();
+
+  WRITE_ONCE_OUTPUT = true;
 }
 
 
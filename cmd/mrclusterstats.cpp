@@ -26,6 +26,7 @@
 #include "stats/cluster.h"
 #include "stats/enhance.h"
 #include "stats/permtest.h"
+#include "stats/subjects.h"
 #include "stats/tfce.h"
 
 
@@ -73,6 +74,8 @@ void usage ()
 
   + Stats::TFCE::Options (DEFAULT_TFCE_DH, DEFAULT_TFCE_E, DEFAULT_TFCE_H)
 
+  + Stats::Subjects::Options()
+
   + OptionGroup ("Additional options for mrclusterstats")
 
     + Option ("negative", "automatically test the negative (opposite) contrast. By computing the opposite contrast simultaneously "
@@ -111,6 +114,7 @@ void run() {
   const value_type tfce_dh = get_option_value ("tfce_dh", DEFAULT_TFCE_DH);
   const value_type tfce_H = get_option_value ("tfce_h", DEFAULT_TFCE_H);
   const value_type tfce_E = get_option_value ("tfce_e", DEFAULT_TFCE_E);
+  const bool tfce_stepwise = get_options ("tfce_stepwise").size();
   const bool use_tfce = !std::isfinite (cluster_forming_threshold);
   int num_perms = get_option_value ("nperms", DEFAULT_NUMBER_PERMUTATIONS);
   int nperms_nonstationary = get_option_value ("nperms_nonstationary", DEFAULT_NUMBER_PERMUTATIONS_NONSTATIONARITY);
@@ -166,25 +170,19 @@ void run() {
   const size_t num_vox = mask_indices.size();
 
   matrix_type data (num_vox, subjects.size());
-
-  {
-    // Load images
-    ProgressBar progress("loading images", subjects.size());
-    for (size_t subject = 0; subject < subjects.size(); subject++) {
-      LogLevelLatch log_level (0);
-      auto input_image = Image<float>::open (subjects[subject]); //.with_direct_io (3); <- Should be inputting 3D images?
-      check_dimensions (input_image, mask_image, 0, 3);
-      int index = 0;
-      vector<vector<int> >::iterator it;
-      for (it = mask_indices.begin(); it != mask_indices.end(); ++it) {
-        input_image.index(0) = (*it)[0];
-        input_image.index(1) = (*it)[1];
-        input_image.index(2) = (*it)[2];
-        data (index++, subject) = input_image.value();
-      }
-      progress++;
-    }
-  }
+  Stats::Subjects::load (data, subjects, "mrclusterstats; mask: " + std::string (argument[3]),
+      [&] (size_t subject) {
+        auto input_image = Image<float>::open (subjects[subject]); //.with_direct_io (3); <- Should be inputting 3D images?
+        check_dimensions (input_image, mask_image, 0, 3);
+        int index = 0;
+        vector<vector<int> >::iterator it;
+        for (it = mask_indices.begin(); it != mask_indices.end(); ++it) {
+          input_image.index(0) = (*it)[0];
+          input_image.index(1) = (*it)[1];
+          input_image.index(2) = (*it)[2];
+          data (index++, subject) = input_image.value();
+        }
+      }, "loading images");
   if (!data.allFinite())
     WARN ("input data contains non-finite value(s)");
 
@@ -216,7 +214,9 @@ void run() {
   std::shared_ptr<Stats::EnhancerBase> enhancer;
   if (use_tfce) {
     std::shared_ptr<Stats::TFCE::EnhancerBase> base (new Stats::Cluster::ClusterSize (connector, cluster_forming_threshold));
-    enhancer.reset (new Stats::TFCE::Wrapper (base, tfce_dh, tfce_E, tfce_H));
+    std::shared_ptr<Stats::TFCE::Wrapper> wrapper (new Stats::TFCE::Wrapper (base, tfce_dh, tfce_E, tfce_H));
+    wrapper->set_stepwise (tfce_stepwise);
+    enhancer = wrapper;
   } else {
     enhancer.reset (new Stats::Cluster::ClusterSize (connector, cluster_forming_threshold));
   }
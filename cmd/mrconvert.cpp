@@ -163,6 +163,8 @@ void usage ()
 
   + PhaseEncoding::ImportOptions
   + PhaseEncoding::ExportOptions;
+
+  WRITE_ONCE_OUTPUT = true;
 }
 
 
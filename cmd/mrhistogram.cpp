@@ -17,6 +17,7 @@
 #include "header.h"
 #include "image.h"
 #include "algo/histogram.h"
+#include "algo/per_volume.h"
 
 using namespace MR;
 using namespace App;
@@ -42,58 +43,6 @@ OPTIONS
 
 
 
-class Volume_loop { MEMALIGN(Volume_loop)
-  public:
-    Volume_loop (Image<float>& in) :
-        image (in),
-        is_4D (in.ndim() == 4),
-        status (true)
-    {
-      if (is_4D)
-        image.index(3) = 0;
-    }
-
-    void operator++ ()
-    {
-      if (is_4D) {
-        image.index(3)++;
-      } else {
-        assert (status);
-        status = false;
-      }
-    }
-    operator bool() const
-    {
-      if (is_4D)
-        return (image.index(3) >= 0 && image.index(3) < image.size(3));
-      else
-        return status;
-    }
-
-  private:
-    Image<float>& image;
-    const bool is_4D;
-    bool status;
-};
-
-
-
-template <class Functor>
-void run_volume (Functor& functor, Image<float>& data, Image<bool>& mask)
-{
-  if (mask.valid()) {
-    for (auto l = Loop(0,3) (data, mask); l; ++l) {
-      if (mask.value())
-        functor (float(data.value()));
-    }
-  } else {
-    for (auto l = Loop(0,3) (data); l; ++l)
-      functor (float(data.value()));
-  }
-}
-
-
-
 void run ()
 {
 
@@ -121,8 +70,9 @@ void run ()
   if (opt.size()) {
     calibrator.from_file (opt[0][0]);
   } else {
-    for (auto v = Volume_loop(data); v; ++v)
-      run_volume (calibrator, data, mask);
+    vector<Algo::Histogram::Calibrator> calibrators (1, calibrator);
+    Algo::per_volume (calibrators, data, mask);
+    calibrator.merge (calibrators[0]);
     // If getting min/max using all volumes, but generating a single histogram per volume,
     //   then want the automatic calculation of bin width to be based on the number of
     //   voxels per volume, rather than the total number of values sent to the calibrator
@@ -141,25 +91,13 @@ void run ()
     output << (calibrator.get_min() + ((i+0.5) * calibrator.get_bin_width())) << ",";
   output << "\n";
 
-  if (allvolumes) {
-
-    Algo::Histogram::Data histogram (calibrator);
-    for (auto v = Volume_loop(data); v; ++v)
-      run_volume (histogram, data, mask);
+  // Histograms for all volumes are generated in a single pass over the image
+  const size_t num_histograms = allvolumes || header.ndim() < 4 ? 1 : header.size(3);
+  vector<Algo::Histogram::Data> histograms (num_histograms, Algo::Histogram::Data (calibrator));
+  Algo::per_volume (histograms, data, mask);
+  for (const auto& histogram : histograms) {
     for (size_t i = 0; i != nbins; ++i)
       output << histogram[i] << ",";
     output << "\n";
-
-  } else {
-
-    for (auto v = Volume_loop(data); v; ++v) {
-      Algo::Histogram::Data histogram (calibrator);
-      run_volume (histogram, data, mask);
-      for (size_t i = 0; i != nbins; ++i)
-        output << histogram[i] << ",";
-      output << "\n";
-    }
-
   }
 }
-
@@ -18,7 +18,9 @@
 #include "image_helpers.h"
 #include "filter/reslice.h"
 #include "interp/cubic.h"
+#include "thread_queue.h"
 #include "transform.h"
+#include "file/path.h"
 #include "registration/linear.h"
 #include "registration/nonlinear.h"
 #include "registration/metric/demons.h"
@@ -58,7 +60,13 @@ void usage ()
         "Warps can be saved as two deformation fields that map directly between image1->image2 and image2->image1, or if using -nl_warp_full as a single 5D file "
         "that stores all 4 warps image1->mid->image2, and image2->mid->image1. The 5D warp format stores x,y,z deformations in the 4th dimension, and uses the 5th dimension "
         "to index the 4 warps. The affine transforms estimated (to midway space) are also stored as comments in the image header. The 5D warp file can be used to reinitialise "
-        "subsequent registrations, in addition to transforming images to midway space (e.g. for intra-subject alignment in a 2-time-point longitudinal analysis).";
+        "subsequent registrations, in addition to transforming images to midway space (e.g. for intra-subject alignment in a 2-time-point longitudinal analysis)."
+
+      + "If more than one image1 input is provided, each is registered to image2 within a single process, such that image2 is read, and "
+        "smoothed for each multi-resolution level, only once. In this batch mode, any occurrence of the string \"PRE\" in file names "
+        "provided via command-line options (e.g. -mask1, -affine, -nl_warp_full, -affine_init_matrix) is substituted with the prefix of each "
+        "image1 input (its file name with leading folders and file extension removed); all per-image outputs must contain this string. "
+        "Results are identical to those obtained by registering each image1 to image2 in separate invocations.";
 
   REFERENCES
   + "* If FOD registration is being performed:\n"
@@ -72,7 +80,7 @@ void usage ()
 
 
   ARGUMENTS
-    + Argument ("image1", "input image 1 ('moving')").type_image_in ()
+    + Argument ("image1", "input image 1 ('moving'); multiple images can be provided for batch registration to the same template").type_image_in ().allow_multiple()
     + Argument ("image2", "input image 2 ('template')").type_image_in ();
 
   OPTIONS
@@ -94,6 +102,11 @@ void usage ()
   + Option ("mask2", "a mask to define the region of image2 to use for optimisation.")
     + Argument ("filename").type_image_in ()
 
+  + Option ("batch_jobs", "the number of image1 inputs to register concurrently when performing batch registration (default: 1). "
+                          "Note that each individual registration is itself multi-threaded. When registering several inputs concurrently, "
+                          "their progress is not displayed, and the messages of each registration are displayed once it has completed.")
+    + Argument ("number").type_integer (1)
+
   + Registration::rigid_options
 
   + Registration::affine_options
@@ -113,17 +126,76 @@ using value_type = double;
 
 
 
-void run ()
+// Options providing file names that are specific to each image1 input, and therefore
+//   must contain the substitution string "PRE" in batch mode
+const char* subject_output_options[] = { "transformed", "transformed_midway", "rigid", "rigid_1tomidway", "rigid_2tomidway", "rigid_log",
+                                         "affine", "affine_1tomidway", "affine_2tomidway", "affine_log", "nl_warp", "nl_warp_full", nullptr };
+
+// In batch mode, the prefix of each image1 input is substituted for any occurrence
+//   of "PRE" in file names provided via command-line options
+std::string subject_prefix (const std::string& path)
 {
+  std::string name = Path::basename (path);
+  if (Path::has_suffix (name, ".gz"))
+    name = name.substr (0, name.size() - 3);
+  const size_t i = name.rfind ('.');
+  return (i == std::string::npos || !i) ? name : name.substr (0, i);
+}
+
+
+
+// When running several batch registrations concurrently, the messages of each are held
+//   back, and displayed together once it has completed, so that the output of different
+//   registrations is not interleaved
+thread_local vector<std::pair<std::string,int>>* batch_job_messages = nullptr;
+void (*display_message) (const std::string& msg, int type) = nullptr;
+std::mutex batch_job_mutex;
+
+void report_batch_job_message (const std::string& msg, int type)
+{
+  if (batch_job_messages)
+    batch_job_messages->push_back (std::make_pair (msg, type));
+  else
+    display_message (msg, type);
+}
+
+void display_batch_job_messages (vector<std::pair<std::string,int>>& messages)
+{
+  batch_job_messages = nullptr;
+  std::lock_guard<std::mutex> lock (batch_job_mutex);
+  for (const auto& m : messages)
+    report_to_user_func (m.first, m.second);
+}
+
 
-  Image<value_type> im1_image = Image<value_type>::open (argument[0]).with_direct_io (Stride::contiguous_along_axis (3));
-  Image<value_type> im2_image = Image<value_type>::open (argument[1]).with_direct_io (Stride::contiguous_along_axis (3));
+
+// Register a single image1 input to the template image (image2); when batch processing,
+//   the template image, its mask and its smoothed versions are shared between all calls
+void run_pair (const std::string& im1_path,
+               Image<value_type> im2_image,
+               Image<value_type> im2_mask,
+               std::shared_ptr<Registration::MultiResolutionCache> im2_cache,
+               const std::string& prefix)
+{
+  auto subject_path = [&] (const std::string& path) -> std::string
+  {
+    if (prefix.empty())
+      return path;
+    std::string result (path);
+    for (size_t i = result.find ("PRE"); i != std::string::npos; i = result.find ("PRE", i + prefix.size()))
+      result.replace (i, 3, prefix);
+    return result;
+  };
+
+  if (prefix.size())
+    CONSOLE ("registering image \"" + im1_path + "\"");
+
+  Image<value_type> im1_image = Image<value_type>::open (im1_path).with_direct_io (Stride::contiguous_along_axis (3));
 
   if (im1_image.ndim() != im2_image.ndim())
     throw Exception ("input images do not have the same number of dimensions");
 
   check_3D_nonunity (im1_image);
-  check_3D_nonunity (im2_image);
 
   auto opt = get_options ("type");
   bool do_rigid  = false;
@@ -203,35 +275,29 @@ void run ()
   if (opt.size()){
     Header transformed_header (im2_image);
     transformed_header.datatype() = DataType::from_command_line (DataType::Float32);
-    im1_transformed = Image<value_type>::create (opt[0][0], transformed_header).with_direct_io();
+    im1_transformed = Image<value_type>::create (subject_path (opt[0][0]), transformed_header).with_direct_io();
   }
 
   std::string im1_midway_transformed_path;
   std::string im2_midway_transformed_path;
   opt = get_options ("transformed_midway");
   if (opt.size()){
-    im1_midway_transformed_path = str(opt[0][0]);
-    im2_midway_transformed_path = str(opt[0][1]);
+    im1_midway_transformed_path = subject_path (opt[0][0]);
+    im2_midway_transformed_path = subject_path (opt[0][1]);
   }
 
   opt = get_options ("mask1");
   Image<value_type> im1_mask;
   if (opt.size ()) {
-    im1_mask = Image<value_type>::open(opt[0][0]);
+    im1_mask = Image<value_type>::open(subject_path (opt[0][0]));
     check_dimensions (im1_image, im1_mask, 0, 3);
   }
 
 
-  opt = get_options ("mask2");
-  Image<value_type> im2_mask;
-  if (opt.size ()) {
-    im2_mask = Image<value_type>::open(opt[0][0]);
-    check_dimensions (im2_image, im2_mask, 0, 3);
-  }
-
 
   // ****** RIGID REGISTRATION OPTIONS *******
   Registration::Linear rigid_registration;
+  rigid_registration.set_im2_cache (im2_cache);
   opt = get_options ("rigid");
   bool output_rigid = false;
   std::string rigid_filename;
@@ -239,7 +305,7 @@ void run ()
     if (!do_rigid)
       throw Exception ("rigid transformation output requested when no rigid registration is requested");
     output_rigid = true;
-    rigid_filename = std::string (opt[0][0]);
+    rigid_filename = subject_path (opt[0][0]);
   }
 
   opt = get_options ("rigid_1tomidway");
@@ -249,7 +315,7 @@ void run ()
    if (!do_rigid)
      throw Exception ("midway rigid transformation output requested when no rigid registration is requested");
    output_rigid_1tomid = true;
-   rigid_1tomid_filename = std::string (opt[0][0]);
+   rigid_1tomid_filename = subject_path (opt[0][0]);
   }
 
   opt = get_options ("rigid_2tomidway");
@@ -259,7 +325,7 @@ void run ()
    if (!do_rigid)
      throw Exception ("midway rigid transformation output requested when no rigid registration is requested");
    output_rigid_2tomid = true;
-   rigid_2tomid_filename = std::string (opt[0][0]);
+   rigid_2tomid_filename = subject_path (opt[0][0]);
   }
 
   Registration::Transform::Rigid rigid;
@@ -267,7 +333,7 @@ void run ()
   bool init_rigid_matrix_set = false;
   if (opt.size()) {
     init_rigid_matrix_set = true;
-    transform_type rigid_transform = load_transform (opt[0][0]);
+    transform_type rigid_transform = load_transform (subject_path (opt[0][0]));
     rigid.set_transform (rigid_transform);
     rigid_registration.set_init_translation_type (Registration::Transform::Init::set_centre_mass);
   }
@@ -371,11 +437,12 @@ void run ()
   if (opt.size()) {
     if (!do_rigid)
       throw Exception ("the -rigid_log option has been set when no rigid registration is requested");
-    linear_logstream.open (opt[0][0]);
+    linear_logstream.open (subject_path (opt[0][0]));
     rigid_registration.set_log_stream (linear_logstream.rdbuf());
   }
   // ****** AFFINE REGISTRATION OPTIONS *******
   Registration::Linear affine_registration;
+  affine_registration.set_im2_cache (im2_cache);
   opt = get_options ("affine");
   bool output_affine = false;
   std::string affine_filename;
@@ -383,7 +450,7 @@ void run ()
    if (!do_affine)
      throw Exception ("affine transformation output requested when no affine registration is requested");
    output_affine = true;
-   affine_filename = std::string (opt[0][0]);
+   affine_filename = subject_path (opt[0][0]);
   }
 
   opt = get_options ("affine_1tomidway");
@@ -393,7 +460,7 @@ void run ()
    if (!do_affine)
      throw Exception ("midway affine transformation output requested when no affine registration is requested");
    output_affine_1tomid = true;
-   affine_1tomid_filename = std::string (opt[0][0]);
+   affine_1tomid_filename = subject_path (opt[0][0]);
   }
 
   opt = get_options ("affine_2tomidway");
@@ -403,7 +470,7 @@ void run ()
    if (!do_affine)
      throw Exception ("midway affine transformation output requested when no affine registration is requested");
    output_affine_2tomid = true;
-   affine_2tomid_filename = std::string (opt[0][0]);
+   affine_2tomid_filename = subject_path (opt[0][0]);
   }
 
   Registration::Transform::Affine affine;
@@ -416,7 +483,7 @@ void run ()
       throw Exception ("you cannot initialise with -affine_init_matrix since a rigid registration is being performed");
 
     init_affine_matrix_set = true;
-    transform_type init_affine = load_transform (opt[0][0]);
+    transform_type init_affine = load_transform (subject_path (opt[0][0]));
     affine.set_transform (init_affine);
     affine_registration.set_init_translation_type (Registration::Transform::Init::set_centre_mass);
   }
@@ -519,7 +586,7 @@ void run ()
   if (opt.size()) {
     if (!do_affine)
       throw Exception ("the -affine_log option has been set when no rigid registration is requested");
-    linear_logstream.open (opt[0][0]);
+    linear_logstream.open (subject_path (opt[0][0]));
     affine_registration.set_log_stream (linear_logstream.rdbuf());
   }
 
@@ -549,14 +616,15 @@ void run ()
 
   // ****** NON-LINEAR REGISTRATION OPTIONS *******
   Registration::NonLinear nl_registration;
+  nl_registration.set_im2_cache (im2_cache);
   opt = get_options ("nl_warp");
   std::string warp1_filename;
   std::string warp2_filename;
   if (opt.size()) {
     if (!do_nonlinear)
       throw Exception ("Non-linear warp output requested when no non-linear registration is requested");
-    warp1_filename = std::string (opt[0][0]);
-    warp2_filename = std::string (opt[0][1]);
+    warp1_filename = subject_path (opt[0][0]);
+    warp2_filename = subject_path (opt[0][1]);
   }
 
   opt = get_options ("nl_warp_full");
@@ -564,7 +632,7 @@ void run ()
   if (opt.size()) {
     if (!do_nonlinear)
       throw Exception ("Non-linear warp output requested when no non-linear registration is requested");
-    warp_full_filename = std::string (opt[0][0]);
+    warp_full_filename = subject_path (opt[0][0]);
   }
 
 
@@ -576,7 +644,7 @@ void run ()
     if (!do_nonlinear)
       throw Exception ("the non linear initialisation option -nl_init cannot be used when no non linear registration is requested");
 
-    Image<default_type> input_warps = Image<default_type>::open (opt[0][0]);
+    Image<default_type> input_warps = Image<default_type>::open (subject_path (opt[0][0]));
     if (input_warps.ndim() != 5)
       throw Exception ("non-linear initialisation input is not 5D. Input must be from previous non-linear output");
 
@@ -922,3 +990,102 @@ void run ()
   if (get_options ("affine_log").size() or get_options ("rigid_log").size())
     linear_logstream.close();
 }
+
+
+
+void run ()
+{
+
+  const size_t num_inputs = argument.size() - 1;
+
+  Image<value_type> im2_image = Image<value_type>::open (argument[num_inputs]).with_direct_io (Stride::contiguous_along_axis (3));
+  check_3D_nonunity (im2_image);
+
+  auto opt = get_options ("mask2");
+  Image<value_type> im2_mask;
+  if (opt.size ()) {
+    im2_mask = Image<value_type>::open(opt[0][0]);
+    check_dimensions (im2_image, im2_mask, 0, 3);
+  }
+
+  if (num_inputs == 1) {
+    if (get_options ("batch_jobs").size())
+      WARN ("-batch_jobs option ignored since only one image1 input was provided");
+    run_pair (argument[0], im2_image, im2_mask, nullptr, "");
+    return;
+  }
+
+  // ****** BATCH REGISTRATION *******
+  // The template image is loaded once, and its smoothed versions for each
+  //   multi-resolution level are computed once and shared between all inputs
+  vector<std::string> im1_paths;
+  vector<std::string> prefixes;
+  for (size_t i = 0; i != num_inputs; ++i) {
+    im1_paths.push_back (argument[i]);
+    prefixes.push_back (subject_prefix (im1_paths.back()));
+    for (size_t j = 0; j != i; ++j) {
+      if (prefixes[j] == prefixes[i])
+        throw Exception ("image1 inputs \"" + im1_paths[j] + "\" and \"" + im1_paths[i] + "\" have the same prefix; "
+                         "cannot generate unique output file names");
+    }
+  }
+
+  for (const char** o = subject_output_options; *o; ++o) {
+    opt = get_options (*o);
+    for (size_t i = 0; i != (opt.size() ? opt[0].opt->size() : 0); ++i) {
+      if (std::string (opt[0][i]).find ("PRE") == std::string::npos)
+        throw Exception ("output file name for option -" + std::string (*o) + " must contain the string \"PRE\" "
+                         "when registering multiple image1 inputs");
+    }
+  }
+  if (get_options ("linstage.diagnostics.prefix").size())
+    throw Exception ("option -linstage.diagnostics.prefix cannot be used when registering multiple image1 inputs");
+
+  auto im2_cache = std::make_shared<Registration::MultiResolutionCache> (im2_image);
+
+  size_t next = 0;
+  auto source = [&] (size_t& index)
+  {
+    if (next == num_inputs)
+      return false;
+    index = next++;
+    return true;
+  };
+  const size_t num_jobs = std::min (num_inputs, size_t(get_option_value ("batch_jobs", 1)));
+  auto worker = [&] (const size_t& index)
+  {
+    if (num_jobs == 1) {
+      run_pair (im1_paths[index], im2_image, im2_mask, im2_cache, prefixes[index]);
+      return true;
+    }
+    // the progress bars of concurrent registrations would overwrite each other:
+    ProgressBar::Hide hide_progress;
+    vector<std::pair<std::string,int>> messages;
+    batch_job_messages = &messages;
+    try {
+      run_pair (im1_paths[index], im2_image, im2_mask, im2_cache, prefixes[index]);
+    }
+    catch (...) {
+      display_batch_job_messages (messages);
+      throw;
+    }
+    display_batch_job_messages (messages);
+    return true;
+  };
+
+  if (num_jobs > 1) {
+    display_message = report_to_user_func;
+    report_to_user_func = report_batch_job_message;
+  }
+  try {
+    Thread::run_queue (source, size_t(), Thread::multi (worker, num_jobs));
+  }
+  catch (...) {
+    if (display_message)
+      report_to_user_func = display_message;
+    throw;
+  }
+  if (display_message)
+    report_to_user_func = display_message;
+
+}
@@ -23,8 +23,7 @@
 #include "stats.h"
 #include "types.h"
 
-#include "algo/histogram.h"
-#include "algo/loop.h"
+#include "algo/per_volume.h"
 #include "file/ofstream.h"
 
 
@@ -57,60 +56,6 @@ using value_type = Stats::value_type;
 using complex_type = Stats::complex_type;
 
 
-class Volume_loop
-{ NOMEMALIGN
-  public:
-    Volume_loop (Image<complex_type>& in) :
-        image (in),
-        is_4D (in.ndim() == 4),
-        status (true)
-    {
-      if (is_4D)
-        image.index(3) = 0;
-    }
-
-    void operator++ ()
-    {
-      if (is_4D) {
-        image.index(3)++;
-      } else {
-        assert (status);
-        status = false;
-      }
-    }
-    operator bool() const
-    {
-      if (is_4D)
-        return (image.index(3) >= 0 && image.index(3) < image.size(3));
-      else
-        return status;
-    }
-
-  private:
-    Image<complex_type>& image;
-    const bool is_4D;
-    bool status;
-};
-
-
-
-
-void run_volume (Stats::Stats& stats, Image<complex_type>& data, Image<bool>& mask)
-{
-  if (mask.valid()) {
-    for (auto l = Loop(0,3) (data, mask); l; ++l) {
-      if (mask.value())
-        stats (data.value());
-    }
-  } else {
-    for (auto l = Loop(0,3) (data); l; ++l)
-      stats (data.value());
-  }
-}
-
-
-
-
 void run ()
 {
 
@@ -136,20 +81,26 @@ void run ()
   if (App::log_level && fields.empty())
     Stats::print_header (is_complex);
 
-  if (get_options ("allvolumes").size()) {
+  // The values need only be retained if the median is to be reported
+  const bool keep_values = fields.empty() || std::find (fields.begin(), fields.end(), "median") != fields.end();
+
+  // All volumes are processed in a single pass over the image
+  const bool allvolumes = get_options ("allvolumes").size();
+  const size_t num_volumes = data.ndim() > 3 ? data.size(3) : 1;
+  vector<Stats::Stats> stats (num_volumes, Stats::Stats (is_complex, ignorezero, keep_values));
+  Algo::per_volume (stats, data, mask);
+
+  if (allvolumes) {
 
-    Stats::Stats stats (is_complex, ignorezero);
-    for (auto i = Volume_loop (data); i; ++i)
-      run_volume (stats, data, mask);
-    stats.print (data, fields);
+    for (size_t n = 1; n < num_volumes; ++n)
+      stats[0].merge (stats[n]);
+    // statistics across all volumes are labelled with the number of volumes
+    stats[0].print ("[ " + str(data.ndim() > 3 ? num_volumes : 0) + " ]", fields);
 
   } else {
 
-    for (auto i = Volume_loop (data); i; ++i) {
-      Stats::Stats stats (is_complex, ignorezero);
-      run_volume (stats, data, mask);
-      stats.print (data, fields);
-    }
+    for (size_t n = 0; n != num_volumes; ++n)
+      stats[n].print ("[ " + str(n) + " ]", fields);
 
   }
 }
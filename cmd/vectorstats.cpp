@@ -23,6 +23,7 @@
 #include "math/stats/typedefs.h"
 
 #include "stats/permtest.h"
+#include "stats/subjects.h"
 
 
 using namespace MR;
@@ -48,7 +49,9 @@ void usage ()
 
 
   OPTIONS
-  + Stats::PermTest::Options (false);
+  + Stats::PermTest::Options (false)
+
+  + Stats::Subjects::Options();
 
 }
 
@@ -111,26 +114,21 @@ void run()
 
   // Load input data
   matrix_type data (num_elements, filenames.size());
-  {
-    ProgressBar progress ("Loading input vector data", filenames.size());
-    for (size_t subject = 0; subject < filenames.size(); subject++) {
-
-      const std::string& path (filenames[subject]);
-      vector_type subject_data;
-      try {
-        subject_data = load_vector (path);
-      } catch (Exception& e) {
-        throw Exception (e, "Error loading vector data for subject #" + str(subject) + " (file \"" + path + "\"");
-      }
-
-      if (size_t(subject_data.size()) != num_elements)
-        throw Exception ("Vector data for subject #" + str(subject) + " (file \"" + path + "\") is wrong length (" + str(subject_data.size()) + " , expected " + str(num_elements) + ")");
-
-      data.col(subject) = subject_data;
-
-      ++progress;
-    }
-  }
+  Stats::Subjects::load (data, filenames, "vectorstats",
+      [&] (size_t subject) {
+        const std::string& path (filenames[subject]);
+        vector_type subject_data;
+        try {
+          subject_data = load_vector (path);
+        } catch (Exception& e) {
+          throw Exception (e, "Error loading vector data for subject #" + str(subject) + " (file \"" + path + "\"");
+        }
+
+        if (size_t(subject_data.size()) != num_elements)
+          throw Exception ("Vector data for subject #" + str(subject) + " (file \"" + path + "\") is wrong length (" + str(subject_data.size()) + " , expected " + str(num_elements) + ")");
+
+        data.col(subject) = subject_data;
+      }, "Loading input vector data");
 
   {
     ProgressBar progress ("outputting beta coefficients, effect size and standard deviation...", contrast.cols() + 3);
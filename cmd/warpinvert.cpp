@@ -46,7 +46,14 @@ void usage ()
   + Option ("template", "define a template image grid for the output warp")
   + Argument ("image").type_image_in ()
 
-  + Option ("displacement", "indicates that the input warp field is a displacement field; the output will also be a displacement field");
+  + Option ("displacement", "indicates that the input warp field is a displacement field; the output will also be a displacement field")
+
+  + Option ("neighbour_init", "initialise the inverse at each voxel using the solution at the preceding voxel along the same image row, "
+                              "wherever this is closer to the solution than the default initial estimate")
+
+  + Option ("coarse", "first estimate the inverse on a grid downsampled by the specified factor, "
+                      "and use the result to initialise the inversion at full resolution")
+    + Argument ("factor").type_integer (2);
 }
 
 
@@ -72,9 +79,15 @@ void run ()
   Image<default_type> image_in (header_in.get_image<default_type>());
   Image<default_type> image_out (Image<default_type>::create (argument[1], header_out));
 
+  Registration::Warp::InvertParameters parameters;
+  parameters.neighbour_init = get_options ("neighbour_init").size();
+  parameters.coarse_factor = get_option_value ("coarse", 1);
+
+  Registration::Warp::InvertStatistics statistics;
   if (displacement) {
-    Registration::Warp::invert_displacement (image_in, image_out);
+    statistics = Registration::Warp::invert_displacement (image_in, image_out, parameters);
   } else {
-    Registration::Warp::invert_deformation (image_in, image_out);
+    statistics = Registration::Warp::invert_deformation (image_in, image_out, false, parameters);
   }
+  CONSOLE ("warp inversion: " + statistics.info());
 }
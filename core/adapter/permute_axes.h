@@ -82,6 +82,25 @@ next_axis:
             else parent().index (a) += increment;
           }
 
+          template <class ParentType = ImageType>
+            auto get_values (size_t axis, size_t count, value_type* values) const
+            -> decltype (std::declval<const ParentType&>().get_values (axis, count, values)) {
+              if (axes_[axis] < 0) {
+                for (size_t n = 0; n < count; ++n)
+                  values[n] = parent().value();
+              }
+              else parent().get_values (axes_[axis], count, values);
+            }
+          template <class ParentType = ImageType>
+            auto set_values (size_t axis, size_t count, const value_type* values)
+            -> decltype (std::declval<ParentType&>().set_values (axis, count, values)) {
+              if (axes_[axis] < 0) {
+                if (count)
+                  parent().value() = values[count-1];
+              }
+              else parent().set_values (axes_[axis], count, values);
+            }
+
         private:
           vector<int> axes_;
           vector<size_t> non_existent_axes;
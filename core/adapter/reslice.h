@@ -201,6 +201,35 @@ namespace MR
           return interp.value();
         }
 
+        //! Read interpolated values from all volumes along axis >= 3
+        /*! The sample positions and interpolation weights are computed once
+         * for the current voxel, and applied to all volumes. */
+        Eigen::Matrix<value_type, Eigen::Dynamic, 1> row (size_t axis) {
+          using namespace Eigen;
+          if (oversampling) {
+            Vector3 d (x[0]+from[0], x[1]+from[1], x[2]+from[2]);
+            Matrix<default_type, Dynamic, 1> sum = Matrix<default_type, Dynamic, 1>::Zero (interp.size (axis));
+            Vector3 s;
+            for (int z = 0; z < OS[2]; ++z) {
+              s[2] = d[2] + z*inc[2];
+              for (int y = 0; y < OS[1]; ++y) {
+                s[1] = d[1] + y*inc[1];
+                for (int x = 0; x < OS[0]; ++x) {
+                  s[0] = d[0] + x*inc[0];
+                  if (interp.voxel (direct_transform * s))
+                    sum += interp.row (axis).template cast<default_type>();
+                }
+              }
+            }
+            Matrix<value_type, Dynamic, 1> result (sum.size());
+            for (ssize_t n = 0; n < sum.size(); ++n)
+              result[n] = normalise<value_type> (sum[n], norm);
+            return result;
+          }
+          interp.voxel (direct_transform * Vector3 (x[0], x[1], x[2]));
+          return interp.row (axis);
+        }
+
         ssize_t get_index (size_t axis) const { return axis < 3 ? x[axis] : interp.index(axis); }
         void move_index (size_t axis, ssize_t increment) {
           if (axis < 3) x[axis] += increment;
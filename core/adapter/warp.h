@@ -92,6 +92,17 @@ namespace MR
           return interp.value();
         }
 
+        //! Read interpolated values from all volumes along axis >= 3
+        /*! The warped position and interpolation weights are computed once
+         * for the current voxel, and applied to all volumes. */
+        Eigen::Matrix<value_type, Eigen::Dynamic, 1> row (size_t axis) {
+          Eigen::Vector3 pos = get_position();
+          if (std::isnan(pos[0]) || std::isnan(pos[1]) || std::isnan(pos[2]))
+            return Eigen::Matrix<value_type, Eigen::Dynamic, 1>::Constant (interp.size (axis), value_when_out_of_bounds);
+          interp.scanner (pos);
+          return interp.row (axis);
+        }
+
         ssize_t get_index (size_t axis) const { return axis < 3 ? x[axis] : interp.index(axis); }
         void move_index (size_t axis, ssize_t increment) {
           if (axis < 3) x[axis] += increment;
@@ -22,11 +22,267 @@
 namespace MR
 {
 
+  //! \cond skip
+  namespace {
+
+    template <class ImageType>
+      FORCE_INLINE typename std::enable_if<has_row_access<ImageType>::value>::type
+      __get_row (const ImageType& image, size_t axis, size_t count, typename ImageType::value_type* values) {
+        image.get_values (axis, count, values);
+      }
+
+    template <class ImageType>
+      FORCE_INLINE typename std::enable_if<!has_row_access<ImageType>::value>::type
+      __get_row (ImageType& image, size_t axis, size_t count, typename ImageType::value_type* values) {
+        for (size_t n = 0; n < count; ++n, ++image.index (axis))
+          values[n] = image.value();
+        image.index (axis) -= count;
+      }
+
+    template <class ImageType>
+      FORCE_INLINE typename std::enable_if<has_row_access<ImageType>::value>::type
+      __set_row (ImageType& image, size_t axis, size_t count, const typename ImageType::value_type* values) {
+        image.set_values (axis, count, values);
+      }
+
+    template <class ImageType>
+      FORCE_INLINE typename std::enable_if<!has_row_access<ImageType>::value>::type
+      __set_row (ImageType& image, size_t axis, size_t count, const typename ImageType::value_type* values) {
+        for (size_t n = 0; n < count; ++n, ++image.index (axis))
+          image.value() = values[n];
+        image.index (axis) -= count;
+      }
+
+    template <typename ValueType>
+      FORCE_INLINE const ValueType* __convert_row (const ValueType* in, ValueType*, size_t) {
+        return in;
+      }
+
+    template <typename InputValueType, typename OutputValueType>
+      FORCE_INLINE const OutputValueType* __convert_row (const InputValueType* in, OutputValueType* out, size_t count) {
+        for (size_t n = 0; n < count; ++n)
+          out[n] = in[n];
+        return out;
+      }
+
+
+
+    // use bulk access to rows of voxel values if either image supports it:
+    template <class InputImageType, class OutputImageType>
+      struct __use_row_copy { NOMEMALIGN
+        static bool const value = 
+          has_row_access<typename std::decay<InputImageType>::type>::value ||
+          has_row_access<typename std::decay<OutputImageType>::type>::value;
+      };
+
+
+
+    //! copy one row of voxel values along \a axis at a time
+    /*! The whole row is copied, irrespective of the current position of
+     * either image along \a axis. Each instance holds its own buffers, so
+     * that each thread of a ThreadedLoop operates on its own copy. */
+    template <class InputImageType, class OutputImageType>
+      class __CopyRow { NOMEMALIGN
+        public:
+          using input_value_type = typename std::decay<InputImageType>::type::value_type;
+          using output_value_type = typename std::decay<OutputImageType>::type::value_type;
+
+          __CopyRow (size_t axis, size_t count) : axis (axis), count (count) { }
+          __CopyRow (const __CopyRow& that) : axis (that.axis), count (that.count) { }
+
+          FORCE_INLINE void operator() (InputImageType& in, OutputImageType& out) {
+            if (!in_values) {
+              in_values.reset (new input_value_type [count]);
+              if (!std::is_same<input_value_type, output_value_type>::value)
+                out_values.reset (new output_value_type [count]);
+            }
+            in.index (axis) = 0;
+            out.index (axis) = 0;
+            __get_row (in, axis, count, in_values.get());
+            __set_row (out, axis, count, __convert_row (in_values.get(), out_values.get(), count));
+          }
+
+        protected:
+          const size_t axis, count;
+          std::unique_ptr<input_value_type[]> in_values;
+          std::unique_ptr<output_value_type[]> out_values;
+      };
+
+
+
+    //! copy a plane of voxel values one tile at a time
+    /*! Where the axis of smallest stride differs between the source and
+     * destination, copying rows along either axis means one of the two
+     * images is accessed with a large stride. Instead, the plane spanned by
+     * \a axis_in (the axis of smallest stride in the source) and \a
+     * axis_out (that in the destination) is copied one tile at a time: rows
+     * of the tile are read along \a axis_in, transposed within a buffer
+     * small enough to remain in cache, and written along \a axis_out, so
+     * that both images are accessed contiguously. Tiles are made as long
+     * as possible along \a axis_in (up to max_row voxels), and span
+     * equal fractions of the plane, to minimise the number of rows
+     * accessed. As with __CopyRow, each instance holds its own buffers. */
+    template <class InputImageType, class OutputImageType>
+      class __CopyTile { NOMEMALIGN
+        public:
+          using input_value_type = typename std::decay<InputImageType>::type::value_type;
+          using output_value_type = typename std::decay<OutputImageType>::type::value_type;
+
+          static constexpr size_t max_row = 256, max_tile = 8192;
+
+          __CopyTile (size_t axis_in, size_t axis_out) : axis_in (axis_in), axis_out (axis_out) { }
+          __CopyTile (const __CopyTile& that) : axis_in (that.axis_in), axis_out (that.axis_out) { }
+
+          void operator() (InputImageType& in, OutputImageType& out) {
+            if (!in_values) {
+              in_values.reset (new input_value_type [max_tile]);
+              out_values.reset (new output_value_type [max_tile / 2]);
+            }
+            const ssize_t size_in = in.size (axis_in), size_out = in.size (axis_out);
+            const ssize_t tile_in = split (size_in, max_row);
+            const ssize_t tile_out = split (size_out, std::min<size_t> (max_tile / tile_in, max_tile / 2));
+
+            for (ssize_t j0 = 0; j0 < size_out; j0 += tile_out) {
+              const size_t nj = std::min (tile_out, size_out - j0);
+              for (ssize_t i0 = 0; i0 < size_in; i0 += tile_in) {
+                const size_t ni = std::min (tile_in, size_in - i0);
+                in.index (axis_in) = i0;
+                for (size_t j = 0; j < nj; ++j) {
+                  in.index (axis_out) = j0 + j;
+                  __get_row (in, axis_in, ni, in_values.get() + j*ni);
+                }
+                out.index (axis_out) = j0;
+                for (size_t i = 0; i < ni; ++i) {
+                  for (size_t j = 0; j < nj; ++j)
+                    out_values[j] = in_values[j*ni + i];
+                  out.index (axis_in) = i0 + i;
+                  __set_row (out, axis_out, nj, out_values.get());
+                }
+              }
+            }
+            in.index (axis_in) = in.index (axis_out) = 0;
+            out.index (axis_in) = out.index (axis_out) = 0;
+          }
+
+        protected:
+          const size_t axis_in, axis_out;
+          std::unique_ptr<input_value_type[]> in_values;
+          std::unique_ptr<output_value_type[]> out_values;
+
+          // size of the tiles along an axis of \a size voxels, such that
+          // all tiles are of (near-)equal size, and no larger than \a max:
+          static ssize_t split (ssize_t size, size_t max) {
+            const ssize_t num = (size + max - 1) / max;
+            return (size + num - 1) / num;
+          }
+      };
+
+
+
+    //! the axis of smallest stride amongst \a axes, ignoring axes of unit size
+    template <class ImageType>
+      inline auto __innermost_axis (const ImageType& image, const vector<size_t>& axes, int) -> decltype (image.stride (0), size_t())
+      {
+        size_t innermost = axes[0];
+        for (auto axis : axes) {
+          if (image.size (axis) > 1 && ( image.size (innermost) <= 1 ||
+                std::abs (image.stride (axis)) < std::abs (image.stride (innermost)) ))
+            innermost = axis;
+        }
+        return innermost;
+      }
+
+    // images without strides: assume the axes are already in order of increasing stride
+    template <class ImageType>
+      inline size_t __innermost_axis (const ImageType&, const vector<size_t>& axes, long)
+      {
+        return axes[0];
+      }
+
+    //! sort \a axes in order of increasing stride in \a image
+    template <class ImageType>
+      inline auto __sort_by_stride (const ImageType& image, vector<size_t>& axes, int) -> decltype (image.stride (0), void())
+      {
+        std::stable_sort (axes.begin(), axes.end(), [&] (size_t a, size_t b) {
+            return std::abs (image.stride (a)) < std::abs (image.stride (b)); });
+      }
+
+    template <class ImageType>
+      inline void __sort_by_stride (const ImageType&, vector<size_t>&, long) { }
+
+    //! whether \a source and \a destination should be copied using __CopyTile
+    /*! If so, \a axis_in and \a axis_out are set to the axis of smallest
+     * stride in each image, and \a other_axes to the remaining axes, in
+     * order of increasing stride in \a destination, so that successive
+     * planes are written to neighbouring locations. */
+    template <class InputImageType, class OutputImageType>
+      inline bool __use_tile_copy (const InputImageType& source, const OutputImageType& destination, const vector<size_t>& axes,
+          size_t& axis_in, size_t& axis_out, vector<size_t>& other_axes)
+      {
+        if (axes.size() < 3)
+          return false;
+        axis_in = __innermost_axis (source, axes, 0);
+        axis_out = __innermost_axis (destination, axes, 0);
+        if (axis_in == axis_out || source.size (axis_in) <= 1 || source.size (axis_out) <= 1)
+          return false;
+        other_axes.clear();
+        for (auto axis : axes)
+          if (axis != axis_in && axis != axis_out)
+            other_axes.push_back (axis);
+        __sort_by_stride (destination, other_axes, 0);
+        return true;
+      }
+
+
+
+    template <class InputImageType, class OutputImageType, class... ProgressMessage>
+      inline typename std::enable_if<__use_row_copy<InputImageType,OutputImageType>::value>::type
+      __copy_images (InputImageType& source, OutputImageType& destination, size_t from_axis, size_t to_axis, const ProgressMessage&... message)
+      {
+        const auto axes = Stride::order (source, from_axis, to_axis);
+        if (axes.empty())
+          return;
+        size_t axis_in, axis_out;
+        vector<size_t> other_axes;
+        if (__use_tile_copy (source, destination, axes, axis_in, axis_out, other_axes)) {
+          __CopyTile<InputImageType,OutputImageType> copy_tile (axis_in, axis_out);
+          for (auto i = Loop (message..., other_axes) (source, destination); i; ++i)
+            copy_tile (source, destination);
+          return;
+        }
+        __CopyRow<InputImageType,OutputImageType> copy_row (axes[0], source.size (axes[0]));
+        if (axes.size() == 1) {
+          copy_row (source, destination);
+          return;
+        }
+        for (auto i = Loop (message..., vector<size_t> (axes.begin()+1, axes.end())) (source, destination); i; ++i)
+          copy_row (source, destination);
+      }
+
+    template <class InputImageType, class OutputImageType, class... ProgressMessage>
+      inline typename std::enable_if<!__use_row_copy<InputImageType,OutputImageType>::value>::type
+      __copy_images (InputImageType& source, OutputImageType& destination, size_t from_axis, size_t to_axis, const ProgressMessage&... message)
+      {
+        for (auto i = Loop (message..., source, from_axis, to_axis) (source, destination); i; ++i) 
+          destination.value() = source.value();
+      }
+
+  }
+  //! \endcond
+
+
+
+  //! copy the contents of \a source into \a destination
+  /*! Where either image supports bulk access to rows of voxel values (see
+   * Image::get_values()), the data are copied one row at a time along the
+   * axis of smallest stride in \a source. If the axis of smallest stride
+   * differs in \a destination, the data are instead copied one tile at a
+   * time, so that both images are accessed along their axis of smallest
+   * stride. */
   template <class InputImageType, class OutputImageType>
     void copy (InputImageType&& source, OutputImageType&& destination, size_t from_axis = 0, size_t to_axis = std::numeric_limits<size_t>::max())
     {
-      for (auto i = Loop (source, from_axis, to_axis) (source, destination); i; ++i) 
-        destination.value() = source.value();
+      __copy_images (source, destination, from_axis, to_axis);
     }
 
 
@@ -42,11 +298,9 @@ namespace MR
   template <class InputImageType, class OutputImageType>
     void copy_with_progress_message (const std::string& message, InputImageType&& source, OutputImageType&& destination, size_t from_axis = 0, size_t to_axis = std::numeric_limits<size_t>::max())
     {
-      for (auto i = Loop (message, source, from_axis, to_axis) (source, destination); i; ++i) 
-        destination.value() = source.value();
+      __copy_images (source, destination, from_axis, to_axis, message);
     }
 
-
 }
 
 #endif
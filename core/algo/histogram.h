@@ -60,6 +60,20 @@ namespace MR
             return (*this) (typename T::value_type (val));
           }
 
+          //! discard the values observed so far, retaining the settings
+          void clear () {
+            min = std::numeric_limits<default_type>::infinity();
+            max = -std::numeric_limits<default_type>::infinity();
+            data.clear();
+          }
+
+          //! combine with the values observed by another calibrator
+          void merge (const Calibrator& other) {
+            min = std::min (min, other.min);
+            max = std::max (max, other.max);
+            data.insert (data.end(), other.data.begin(), other.data.end());
+          }
+
           void from_file (const std::string&);
 
           void finalize (const size_t num_volumes, const bool is_integer);
@@ -118,6 +132,17 @@ namespace MR
           }
 
 
+          //! reset all counts to zero, retaining the calibration
+          void clear () {
+            list.setZero();
+          }
+
+          //! add the counts of another histogram with the same calibration
+          void merge (const Data& other) {
+            assert (other.list.size() == list.size());
+            list += other.list;
+          }
+
           size_t operator[] (const size_t index) const {
             assert (index < size_t(list.size()));
             return list[index];
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __algo_per_volume_h__
+#define __algo_per_volume_h__
+
+#include "image.h"
+#include "algo/threaded_loop.h"
+
+namespace MR
+{
+  namespace Algo
+  {
+
+    //! \cond skip
+    namespace {
+      template <class Functor>
+      class __PerVolume { MEMALIGN(__PerVolume<Functor>)
+        public:
+          __PerVolume (const vector<Functor>& empty, vector<std::unique_ptr<vector<Functor>>>& accumulators, const Image<bool>& mask, std::mutex& mutex) :
+            empty (empty),
+            accumulators (accumulators),
+            local (nullptr),
+            mask (mask),
+            mutex (mutex) { }
+
+          __PerVolume (const __PerVolume& that) :
+            empty (that.empty),
+            accumulators (that.accumulators),
+            local (nullptr),
+            mask (that.mask),
+            mutex (that.mutex) { }
+
+          template <class ImageType>
+            void operator() (ImageType& data) {
+              if (mask.valid()) {
+                assign_pos_of (data, 0, 3).to (mask);
+                if (!mask.value())
+                  return;
+              }
+              if (!local) {
+                std::lock_guard<std::mutex> lock (mutex);
+                accumulators.emplace_back (new vector<Functor> (empty));
+                local = accumulators.back().get();
+              }
+              (*local)[local->size() > 1 ? data.index(3) : 0] (typename ImageType::value_type (data.value()));
+            }
+
+        private:
+          const vector<Functor>& empty;
+          vector<std::unique_ptr<vector<Functor>>>& accumulators;
+          vector<Functor>* local;
+          Image<bool> mask;
+          std::mutex& mutex;
+      };
+    }
+    //! \endcond
+
+
+
+    //! feed the values of each volume of an image to a separate functor, in a single threaded pass
+    /*! The values of volume \a n (i.e. with index \a n along axis 3) are
+     * passed to \a functors[n]; if only one functor is supplied, it receives
+     * the values of all volumes. Voxels are skipped where \a mask (if valid)
+     * is false. Each thread accumulates into its own set of functors, starting
+     * from a cleared copy of \a functors; these are merged into \a functors
+     * once the loop has completed. The Functor class must therefore provide
+     * clear() and merge() methods. */
+    template <class Functor, class ImageType>
+      inline void per_volume (vector<Functor>& functors, ImageType& image, const Image<bool>& mask)
+      {
+        vector<Functor> empty (functors);
+        for (auto& functor : empty)
+          functor.clear();
+        vector<std::unique_ptr<vector<Functor>>> accumulators;
+        std::mutex mutex;
+        ThreadedLoop (image).run (__PerVolume<Functor> (empty, accumulators, mask, mutex), image);
+        for (const auto& local : accumulators)
+          for (size_t n = 0; n != functors.size(); ++n)
+            functors[n].merge ((*local)[n]);
+      }
+
+  }
+}
+
+#endif
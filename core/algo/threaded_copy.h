@@ -16,6 +16,7 @@
 #ifndef __algo_threaded_copy_h__
 #define __algo_threaded_copy_h__
 
+#include "algo/copy.h"
 #include "algo/threaded_loop.h"
 
 namespace MR
@@ -31,6 +32,82 @@ namespace MR
         }
     };
 
+
+
+    template <class InputImageType, class OutputImageType>
+      struct __copy_rows_func { NOMEMALIGN
+        const vector<size_t>& outer_axes;
+        const vector<size_t> inner_axes;
+        InputImageType in;
+        OutputImageType out;
+        __CopyRow<InputImageType,OutputImageType> copy_row;
+
+        void operator() (const Iterator& pos) {
+          assign_pos_of (pos, outer_axes).to (in, out);
+          if (inner_axes.empty()) {
+            copy_row (in, out);
+            return;
+          }
+          for (auto i = Loop (inner_axes) (in, out); i; ++i)
+            copy_row (in, out);
+        }
+    };
+
+
+
+    template <class InputImageType, class OutputImageType>
+      struct __copy_tiles_func { NOMEMALIGN
+        const vector<size_t>& outer_axes;
+        InputImageType in;
+        OutputImageType out;
+        __CopyTile<InputImageType,OutputImageType> copy_tile;
+
+        void operator() (const Iterator& pos) {
+          assign_pos_of (pos, outer_axes).to (in, out);
+          copy_tile (in, out);
+        }
+    };
+
+
+
+    // copy a row at a time along the innermost axis if either image
+    // supports bulk access to rows of voxel values, or one tile at a time
+    // if the innermost axes of the two images differ:
+    template <class InputImageType, class OutputImageType, class... ProgressMessage>
+      inline typename std::enable_if<__use_row_copy<InputImageType,OutputImageType>::value>::type
+      __threaded_copy (InputImageType& source, OutputImageType& destination,
+          const vector<size_t>& axes, size_t num_axes_in_thread, const ProgressMessage&... message)
+      {
+        size_t axis_in, axis_out;
+        vector<size_t> other_axes;
+        if (__use_tile_copy (source, destination, axes, axis_in, axis_out, other_axes)) {
+          auto loop = ThreadedLoop (message..., source, other_axes, vector<size_t> { axis_in, axis_out });
+          loop.run_outer (__copy_tiles_func<InputImageType,OutputImageType> {
+              loop.outer_loop.axes, source, destination, { axis_in, axis_out } });
+          check_app_exit_code();
+          return;
+        }
+
+        auto loop = ThreadedLoop (message..., source, axes, num_axes_in_thread);
+        if (loop.inner_axes.empty()) {
+          loop.run (__copy_func(), source, destination);
+          return;
+        }
+        const size_t axis = loop.inner_axes[0];
+        loop.run_outer (__copy_rows_func<InputImageType,OutputImageType> {
+            loop.outer_loop.axes, vector<size_t> (loop.inner_axes.begin()+1, loop.inner_axes.end()),
+            source, destination, { axis, size_t (source.size (axis)) } });
+        check_app_exit_code();
+      }
+
+    template <class InputImageType, class OutputImageType, class... ProgressMessage>
+      inline typename std::enable_if<!__use_row_copy<InputImageType,OutputImageType>::value>::type
+      __threaded_copy (InputImageType& source, OutputImageType& destination,
+          const vector<size_t>& axes, size_t num_axes_in_thread, const ProgressMessage&... message)
+      {
+        ThreadedLoop (message..., source, axes, num_axes_in_thread).run (__copy_func(), source, destination);
+      }
+
   }
 
   //! \endcond
@@ -45,8 +122,7 @@ namespace MR
         const vector<size_t>& axes,
         size_t num_axes_in_thread = 1) 
     {
-      ThreadedLoop (source, axes, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (source, destination, axes, num_axes_in_thread);
     }
 
   template <class InputImageType, class OutputImageType>
@@ -57,8 +133,7 @@ namespace MR
         size_t to_axis = std::numeric_limits<size_t>::max(),
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (source, from_axis, to_axis, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (source, destination, Stride::order (source, from_axis, to_axis), num_axes_in_thread);
     }
 
 
@@ -72,8 +147,7 @@ namespace MR
         const vector<size_t>& axes,
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (message, source, axes, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (source, destination, axes, num_axes_in_thread, message);
     }
 
   template <class InputImageType, class OutputImageType>
@@ -85,8 +159,7 @@ namespace MR
         size_t to_axis = std::numeric_limits<size_t>::max(), 
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (message, source, from_axis, to_axis, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (source, destination, Stride::order (source, from_axis, to_axis), num_axes_in_thread, message);
     }
 
 
@@ -20,6 +20,7 @@
 #include "algo/loop.h"
 #include "algo/iterator.h"
 #include "thread.h"
+#include "image_io/bricked.h"
 
 namespace MR
 {
@@ -447,6 +448,154 @@ namespace MR
 
 
 
+  //! \cond skip
+  namespace {
+
+    // the brick grid of an image, for use with Iterator
+    struct BrickGrid { NOMEMALIGN
+      vector<ssize_t> n;
+      size_t ndim () const { return n.size(); }
+      ssize_t size (size_t axis) const { return n[axis]; }
+    };
+
+    template <class ImageType>
+      inline auto get_brick_size (const ImageType& image, int) -> decltype (image.buffer->get_io(), vector<size_t>())
+      {
+        const auto bricked = dynamic_cast<const ImageIO::Bricked*> (image.buffer->get_io());
+        if (bricked)
+          return bricked->brick_size();
+        return ImageIO::Bricked::default_brick_size();
+      }
+
+    template <class HeaderType>
+      inline vector<size_t> get_brick_size (const HeaderType&, long)
+      {
+        return ImageIO::Bricked::default_brick_size();
+      }
+
+
+    template <class Functor, class... ImageType>
+      struct ThreadedBrickLoopRunInner
+      { MEMALIGN(ThreadedBrickLoopRunInner<Functor,ImageType...>)
+        const vector<size_t>& axes;
+        const vector<size_t>& brick_size;
+        const vector<ssize_t>& size;
+        typename std::remove_reference<Functor>::type func;
+        std::tuple<ImageType...> vox;
+        vector<ssize_t> from, to;
+
+        ThreadedBrickLoopRunInner (const vector<size_t>& axes, const vector<size_t>& brick_size, const vector<ssize_t>& size,
+            const Functor& functor, ImageType&... voxels) :
+          axes (axes),
+          brick_size (brick_size),
+          size (size),
+          func (functor),
+          vox (voxels...),
+          from (axes.size()),
+          to (axes.size()) { }
+
+        void operator() (const Iterator& brick) {
+          // no axes to loop over within the brick (e.g. from_axis == to_axis):
+          if (axes.empty()) {
+            unpack (func, vox);
+            return;
+          }
+          for (size_t n = 0; n < axes.size(); ++n) {
+            const size_t axis = axes[n];
+            from[n] = brick.index (axis) * brick_size[axis];
+            to[n] = std::min<ssize_t> (from[n] + brick_size[axis], size[axis]);
+            apply (set_pos (axis, from[n]), vox);
+          }
+          while (true) {
+            unpack (func, vox);
+            size_t n = 0;
+            for (apply (inc_pos (axes[0]), vox); std::get<0>(vox).index (axes[n]) >= to[n]; apply (inc_pos (axes[n]), vox)) {
+              apply (set_pos (axes[n], from[n]), vox);
+              if (++n == axes.size())
+                return;
+            }
+          }
+        }
+      };
+
+
+
+    template <class OuterLoopType>
+      struct ThreadedBrickLoopRunOuter { MEMALIGN(ThreadedBrickLoopRunOuter<OuterLoopType>)
+        ThreadedLoopRunOuter<OuterLoopType> outer;
+        vector<size_t> axes, brick_size;
+        vector<ssize_t> size;
+
+        //! invoke \a functor (vox...) per voxel, one brick at a time
+        template <class Functor, class... ImageType>
+          void run (Functor&& functor, ImageType&&... vox)
+          {
+            ThreadedBrickLoopRunInner<
+              typename std::remove_reference<Functor>::type,
+              typename std::remove_reference<ImageType>::type...
+                > loop_thread (axes, brick_size, size, functor, vox...);
+            outer.run_outer (loop_thread);
+            check_app_exit_code();
+          }
+      };
+
+
+
+    template <class OuterLoopType, class HeaderType>
+      inline ThreadedBrickLoopRunOuter<OuterLoopType> __threaded_brick_loop (
+          const HeaderType& source, const vector<size_t>& axes, OuterLoopType&& outer_loop)
+      {
+        vector<size_t> brick_size = get_brick_size (source, 0);
+        brick_size.resize (source.ndim(), 1);
+        BrickGrid grid;
+        vector<ssize_t> size (source.ndim());
+        for (size_t n = 0; n < source.ndim(); ++n) {
+          size[n] = source.size (n);
+          grid.n.push_back ((size[n] + brick_size[n] - 1) / brick_size[n]);
+        }
+        return { { grid, std::move (outer_loop), { } }, axes, brick_size, size };
+      }
+
+  }
+  //! \endcond
+
+
+
+
+  //! Multi-threaded loop object that visits the image one brick at a time
+  /*! This operates as ThreadedLoop(), but rather than processing the image
+   * one row (or set of inner axes) at a time, each thread processes a whole
+   * brick of voxels at a time (e.g. 32x32x32 voxels), iterating over the
+   * voxels of each brick in order of increasing stride. For images stored
+   * out-of-core (see ImageIO::Bricked), the bricks match those on file, so
+   * that each brick only needs to be loaded once; for other images, the
+   * brick size is given by the BrickSize config file entry.
+   *
+   * The object returned provides a run (functor, vox...) method, which
+   * invokes \a functor (vox...) for each voxel, as ThreadedLoop().run(). */
+  template <class HeaderType>
+    inline ThreadedBrickLoopRunOuter<decltype(Loop(vector<size_t>()))> ThreadedBrickLoop (
+        const HeaderType& source,
+        size_t from_axis = 0,
+        size_t to_axis = std::numeric_limits<size_t>::max()) {
+      const auto axes = Stride::order (source, from_axis, to_axis);
+      return __threaded_brick_loop (source, axes, Loop (axes));
+    }
+
+  //! Multi-threaded loop object visiting the image brick by brick
+  //* \sa ThreadedBrickLoop() for details */
+  template <class HeaderType>
+    inline ThreadedBrickLoopRunOuter<decltype(Loop("", vector<size_t>()))> ThreadedBrickLoop (
+        const std::string& progress_message,
+        const HeaderType& source,
+        size_t from_axis = 0,
+        size_t to_axis = std::numeric_limits<size_t>::max()) {
+      const auto axes = Stride::order (source, from_axis, to_axis);
+      return __threaded_brick_loop (source, axes, Loop (progress_message, axes));
+    }
+
+
+
 }
 
 #endif
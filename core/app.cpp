@@ -20,6 +20,7 @@
 
 
 #include "app.h"
+#include "cpu.h"
 #include "debug.h"
 #include "progressbar.h"
 #include "file/path.h"
@@ -46,6 +47,7 @@ namespace MR
     OptionList OPTIONS;
     Description REFERENCES;
     bool REQUIRES_AT_LEAST_ONE_ARGUMENT = true;
+    bool WRITE_ONCE_OUTPUT = false;
 
     OptionGroup __standard_options = OptionGroup ("Standard options")
       + Option ("info", "display information messages.")
@@ -574,6 +576,7 @@ namespace MR
         str(8*sizeof (size_t)) + " bit " + MRTRIX_BUILD_TYPE + ", built " + build_date
         + ( project_version ? std::string(" against MRtrix ") + mrtrix_version : std::string("") )
         + ", using Eigen " + str(EIGEN_WORLD_VERSION) + "." + str(EIGEN_MAJOR_VERSION) + "." + str(EIGEN_MINOR_VERSION) + "\n"
+        "CPU dispatch level: " + CPU::name (CPU::level()) + " (detected: " + CPU::name (CPU::detected()) + ")\n"
         "Author(s): " + AUTHOR + "\n" +
         COPYRIGHT + "\n";
 
@@ -953,6 +956,7 @@ namespace MR
         throw 0;
       }
       if (get_options ("version").size()) {
+        File::Config::init ();
         print (version_string());
         throw 0;
       }
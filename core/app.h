@@ -335,6 +335,12 @@ namespace MR
      * arguments. Some commands (e.g. MRView) can operate without arguments. */
     extern bool REQUIRES_AT_LEAST_ONE_ARGUMENT;
 
+    //! set to true if command writes each voxel of its output images only once
+    /*! Images piped to the next command can then be streamed to it as they
+     * are written, if enabled using the PipeStreaming config file entry;
+     * otherwise, they are only passed on once complete. */
+    extern bool WRITE_ONCE_OUTPUT;
+
     //! set the author of the command
     extern const char* AUTHOR;
 
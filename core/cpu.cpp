@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "cpu.h"
+#include "mrtrix.h"
+#include "exception.h"
+#include "file/config.h"
+
+namespace MR
+{
+  namespace CPU
+  {
+
+    Level detected ()
+    {
+#ifdef MRTRIX_CPU_DISPATCH
+      static const Level host = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports ("avx512f"))
+          return Level::avx512;
+        if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+          return Level::avx2;
+        return Level::generic;
+      }();
+      return host;
+#else
+      return Level::generic;
+#endif
+    }
+
+
+
+    //CONF option: CPULevel
+    //CONF default: auto
+    //CONF The highest instruction set to use for kernels that are selected
+    //CONF at runtime according to the capabilities of the CPU (one of: auto,
+    //CONF generic, avx2, avx512). This is mostly useful to check that
+    //CONF results are consistent across levels, or to compare their
+    //CONF performance; levels not supported by the CPU are ignored.
+
+    Level level ()
+    {
+      static const Level selected = [] {
+        const Level host = detected();
+        Level requested = host;
+        const std::string config = lowercase (File::Config::get ("CPULevel", "auto"));
+        if (config == "generic")
+          requested = Level::generic;
+        else if (config == "avx2")
+          requested = Level::avx2;
+        else if (config == "avx512")
+          requested = Level::avx512;
+        else if (config != "auto")
+          WARN ("invalid value \"" + config + "\" for config file entry \"CPULevel\" - ignored");
+
+        if (int(requested) > int(host)) {
+          WARN ("CPU level \"" + name (requested) + "\" requested in config file is not supported by this CPU - using \"" + name (host) + "\"");
+          requested = host;
+        }
+        DEBUG ("using CPU level \"" + name (requested) + "\" for dispatched kernels (detected: \"" + name (host) + "\")");
+        return requested;
+      }();
+      return selected;
+    }
+
+
+
+    std::string name (Level level)
+    {
+      switch (level) {
+        case Level::generic: return "generic";
+        case Level::avx2: return "avx2";
+        case Level::avx512: return "avx512";
+      }
+      return "unknown";
+    }
+
+  }
+}
+
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __cpu_h__
+#define __cpu_h__
+
+#include <string>
+
+// runtime dispatch is only available for x86-64 with GCC-compatible compilers;
+// elsewhere, only the generic versions of the kernels are compiled
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(MRTRIX_NO_CPU_DISPATCH)
+# define MRTRIX_CPU_DISPATCH
+#endif
+
+namespace MR
+{
+  namespace CPU
+  {
+
+    //! instruction set levels for which runtime-dispatched kernels are provided
+    /*! The generic level corresponds to whatever the compiler targets by
+     * default (SSE2 for a generic x86-64 build); the avx2 level also requires
+     * FMA support; the avx512 level requires AVX-512F. */
+    enum class Level { generic = 0, avx2 = 1, avx512 = 2 };
+
+    //! the highest level supported by the host CPU
+    Level detected ();
+
+    //! the level used when dispatching kernels
+    /*! This is the detected level, unless limited using the CPULevel config
+     * file option. It is determined once on first use. */
+    Level level ();
+
+    //! the name of \a level, as used by the CPULevel config file option
+    std::string name (Level level);
+
+  }
+}
+
+#endif
+
@@ -112,9 +112,12 @@ namespace MR {
           }
 
           std::string tag_name () const {
-            if (dict.empty()) init_dict();
-            const char* s = dict[tag()];
-            return (s ? s : "");
+            // initialised exactly once, and only ever read thereafter, such
+            //   that elements can safely be parsed concurrently
+            static const bool initialised = (init_dict(), true);
+            (void) initialised;
+            const auto entry = dict.find (tag());
+            return (entry != dict.end() && entry->second ? entry->second : "");
           }
 
           uint32_t tag () const {
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file/config.h"
+#include "file/path.h"
+#include "file/dicom/scan_cache.h"
+
+// Increment whenever the layout of the cache file or of QuickScan changes
+#define DICOM_SCAN_CACHE_MAGIC "mrtrix DICOM scan cache v1\n"
+
+namespace MR {
+  namespace File {
+    namespace Dicom {
+
+      namespace {
+
+        // Native binary layout: the cache is only ever read back on the
+        // system that wrote it
+        template <typename T>
+          void write_value (std::ostream& out, const T value) {
+            out.write (reinterpret_cast<const char*> (&value), sizeof (T));
+          }
+
+        void write_string (std::ostream& out, const std::string& value) {
+          write_value<uint32_t> (out, value.size());
+          out.write (value.data(), value.size());
+        }
+
+        template <typename T>
+          T read_value (std::istream& in) {
+            T value;
+            in.read (reinterpret_cast<char*> (&value), sizeof (T));
+            if (!in)
+              throw Exception ("unexpected end of file");
+            return value;
+          }
+
+        // Lengths are checked against the size of the file before allocating,
+        //   such that a corrupt cache cannot trigger an arbitrarily large
+        //   allocation
+        std::string read_string (std::istream& in, const uint64_t file_size) {
+          const uint32_t size = read_value<uint32_t> (in);
+          if (size > file_size - uint64_t (in.tellg()))
+            throw Exception ("unexpected end of file");
+          std::string value (size, '\0');
+          in.read (&value[0], size);
+          if (!in)
+            throw Exception ("unexpected end of file");
+          return value;
+        }
+
+        // Entries are keyed by absolute path, such that the cache remains
+        //   valid regardless of the working directory
+        std::string absolute (const std::string& filename) {
+          if (filename.size() && (filename[0] == '/' || (filename.size() > 1 && filename[1] == ':')))
+            return filename;
+          return Path::join (Path::cwd(), filename);
+        }
+
+      }
+
+
+
+      ScanCache::ScanCache () :
+          modified (false)
+      {
+        //CONF option: DICOMScanCache
+        //CONF default: (none)
+        //CONF The path of a file in which to cache the results of scanning
+        //CONF DICOM headers, such that subsequent scans of the same folder
+        //CONF only need to parse those files that have been added or
+        //CONF modified since. Only the entries for the files encountered
+        //CONF in the most recent scan are retained. The cache is disabled
+        //CONF if this is not set.
+        path = File::Config::get ("DICOMScanCache");
+        if (path.size())
+          load();
+      }
+
+
+
+      bool ScanCache::stat (const std::string& filename, ScanResult& result)
+      {
+        struct stat buf;
+        if (::stat (filename.c_str(), &buf))
+          return false;
+        result.size = buf.st_size;
+        result.mtime = buf.st_mtime;
+        return true;
+      }
+
+
+
+      bool ScanCache::find (const std::string& filename, ScanResult& result)
+      {
+        const auto entry = entries.find (absolute (filename));
+        if (entry == entries.end())
+          return false;
+        entry->second.used = true;
+        if (entry->second.size != result.size || entry->second.mtime != result.mtime)
+          return false;
+        result = entry->second;
+        result.scan.filename = filename;
+        return true;
+      }
+
+
+
+      void ScanCache::insert (const ScanResult& result)
+      {
+        if (!enabled())
+          return;
+        const std::string key = absolute (result.scan.filename);
+        ScanResult& entry (entries[key] = result);
+        entry.scan.filename = key;
+        entry.used = true;
+        modified = true;
+      }
+
+
+
+      void ScanCache::load ()
+      {
+        std::ifstream in (path, std::ios_base::in | std::ios_base::binary);
+        if (!in)
+          return;
+        try {
+          in.seekg (0, std::ios_base::end);
+          const uint64_t file_size = in.tellg();
+          in.seekg (0, std::ios_base::beg);
+          const std::string magic (DICOM_SCAN_CACHE_MAGIC);
+          std::string header (magic.size(), '\0');
+          in.read (&header[0], header.size());
+          if (!in || header != magic)
+            throw Exception ("unrecognised format");
+          const uint64_t count = read_value<uint64_t> (in);
+          for (uint64_t n = 0; n != count; ++n) {
+            ScanResult result;
+            QuickScan& scan (result.scan);
+            scan.filename = read_string (in, file_size);
+            result.valid = read_value<uint8_t> (in);
+            result.size = read_value<uint64_t> (in);
+            result.mtime = read_value<int64_t> (in);
+            scan.modality = read_string (in, file_size);
+            scan.patient = read_string (in, file_size);
+            scan.patient_ID = read_string (in, file_size);
+            scan.patient_DOB = read_string (in, file_size);
+            scan.study = read_string (in, file_size);
+            scan.study_ID = read_string (in, file_size);
+            scan.study_date = read_string (in, file_size);
+            scan.study_time = read_string (in, file_size);
+            scan.series = read_string (in, file_size);
+            scan.series_date = read_string (in, file_size);
+            scan.series_time = read_string (in, file_size);
+            scan.sequence = read_string (in, file_size);
+            const uint32_t num_types = read_value<uint32_t> (in);
+            for (uint32_t t = 0; t != num_types; ++t) {
+              const std::string type = read_string (in, file_size);
+              scan.image_type[type] = read_value<uint64_t> (in);
+            }
+            scan.series_number = read_value<uint64_t> (in);
+            scan.bits_alloc = read_value<uint64_t> (in);
+            scan.dim[0] = read_value<uint64_t> (in);
+            scan.dim[1] = read_value<uint64_t> (in);
+            scan.data = read_value<uint64_t> (in);
+            scan.transfer_syntax_supported = read_value<uint8_t> (in);
+            entries[scan.filename] = std::move (result);
+          }
+          DEBUG ("loaded " + str(entries.size()) + " entries from DICOM scan cache \"" + path + "\"");
+        }
+        catch (Exception& e) {
+          WARN ("ignoring contents of DICOM scan cache \"" + path + "\": " + e[0]);
+          entries.clear();
+        }
+      }
+
+
+
+      void ScanCache::save ()
+      {
+        if (!enabled())
+          return;
+        // Drop the entries for files not encountered during this scan
+        //   (e.g. deleted files), such that the cache does not grow without bound
+        for (auto entry = entries.begin(); entry != entries.end();) {
+          if (entry->second.used) {
+            ++entry;
+          } else {
+            entry = entries.erase (entry);
+            modified = true;
+          }
+        }
+        if (!modified)
+          return;
+        // Write to a temporary file first, such that concurrent readers
+        //   never encounter a partially written cache
+        const std::string temp_path = path + "." + str(getpid()) + ".tmp";
+        {
+          std::ofstream out (temp_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+          if (!out) {
+            WARN ("unable to write DICOM scan cache \"" + path + "\": " + strerror (errno));
+            return;
+          }
+          out << DICOM_SCAN_CACHE_MAGIC;
+          write_value<uint64_t> (out, entries.size());
+          for (const auto& entry : entries) {
+            const ScanResult& result (entry.second);
+            const QuickScan& scan (result.scan);
+            write_string (out, scan.filename);
+            write_value<uint8_t> (out, result.valid);
+            write_value<uint64_t> (out, result.size);
+            write_value<int64_t> (out, result.mtime);
+            write_string (out, scan.modality);
+            write_string (out, scan.patient);
+            write_string (out, scan.patient_ID);
+            write_string (out, scan.patient_DOB);
+            write_string (out, scan.study);
+            write_string (out, scan.study_ID);
+            write_string (out, scan.study_date);
+            write_string (out, scan.study_time);
+            write_string (out, scan.series);
+            write_string (out, scan.series_date);
+            write_string (out, scan.series_time);
+            write_string (out, scan.sequence);
+            write_value<uint32_t> (out, scan.image_type.size());
+            for (const auto& type : scan.image_type) {
+              write_string (out, type.first);
+              write_value<uint64_t> (out, type.second);
+            }
+            write_value<uint64_t> (out, scan.series_number);
+            write_value<uint64_t> (out, scan.bits_alloc);
+            write_value<uint64_t> (out, scan.dim[0]);
+            write_value<uint64_t> (out, scan.dim[1]);
+            write_value<uint64_t> (out, scan.data);
+            write_value<uint8_t> (out, scan.transfer_syntax_supported);
+          }
+          if (!out) {
+            WARN ("error writing DICOM scan cache \"" + path + "\"");
+            std::remove (temp_path.c_str());
+            return;
+          }
+        }
+        if (std::rename (temp_path.c_str(), path.c_str())) {
+          WARN ("unable to update DICOM scan cache \"" + path + "\": " + strerror (errno));
+          std::remove (temp_path.c_str());
+        }
+      }
+
+
+    }
+  }
+}
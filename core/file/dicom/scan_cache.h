@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __file_dicom_scan_cache_h__
+#define __file_dicom_scan_cache_h__
+
+#include <unordered_map>
+
+#include "mrtrix.h"
+#include "file/dicom/quick_scan.h"
+
+namespace MR {
+  namespace File {
+    namespace Dicom {
+
+      //! the outcome of scanning the header of a single file
+      class ScanResult { NOMEMALIGN
+        public:
+          ScanResult () : valid (false), size (0), mtime (0), used (false) { }
+          QuickScan scan;
+          //! whether the file could be parsed as DICOM
+          bool valid;
+          //! file size and modification time at the time of scanning
+          uint64_t size;
+          int64_t mtime;
+          //! whether the cache entry was accessed during the current scan
+          bool used;
+      };
+
+
+
+      //! a persistent on-disk cache of DICOM header scan results
+      /*! Entries are keyed by file path, and are only considered valid if
+       * the size and modification time of the file match those recorded at
+       * the time of scanning. The location of the cache file is set using
+       * the DICOMScanCache configuration file option; if this is not set,
+       * the cache is disabled. Entries that were not accessed during the
+       * current scan are dropped when the cache is saved. */
+      class ScanCache { NOMEMALIGN
+        public:
+          ScanCache ();
+
+          bool enabled () const { return path.size(); }
+
+          //! retrieve the cached result for \a filename, if up to date
+          bool find (const std::string& filename, ScanResult& result);
+
+          //! add or replace the entry for \a result.scan.filename
+          void insert (const ScanResult& result);
+
+          //! drop entries not accessed since loading, and write the cache
+          //! back to disk if any entries have been modified
+          void save ();
+
+          //! fill in the size & modification time of \a filename
+          static bool stat (const std::string& filename, ScanResult& result);
+
+        private:
+          std::string path;
+          std::unordered_map<std::string, ScanResult> entries;
+          bool modified;
+
+          void load ();
+      };
+
+
+    }
+  }
+}
+
+#endif
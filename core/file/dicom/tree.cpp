@@ -14,6 +14,7 @@
 
 
 #include "file/path.h"
+#include "thread_queue.h"
 #include "file/dicom/element.h"
 #include "file/dicom/quick_scan.h"
 #include "file/dicom/image.h"
@@ -21,6 +22,7 @@
 #include "file/dicom/study.h"
 #include "file/dicom/patient.h"
 #include "file/dicom/tree.h"
+#include "file/dicom/scan_cache.h"
 
 namespace MR {
   namespace File {
@@ -53,7 +55,7 @@ namespace MR {
 
 
 
-      void Tree::read_dir (const std::string& filename, ProgressBar& progress)
+      void Tree::read_dir (const std::string& filename, vector<std::string>& files, ProgressBar& progress)
       {
         try {
           Path::Dir folder (filename);
@@ -61,15 +63,9 @@ namespace MR {
           while ((entry = folder.read_name()).size()) {
             std::string name (Path::join (filename, entry));
             if (Path::is_dir (name))
-              read_dir (name, progress);
-            else {
-              try {
-                read_file (name);
-              }
-              catch (Exception& E) {
-                E.display (3);
-              }
-            }
+              read_dir (name, files, progress);
+            else
+              files.push_back (name);
             ++progress;
           }
         }
@@ -82,10 +78,82 @@ namespace MR {
 
 
 
+      void Tree::read_files (const vector<std::string>& files, const std::string& message)
+      {
+        vector<ScanResult> results (files.size());
+        ScanCache cache;
+
+        // Files whose cached header details are still up to date need not be re-read
+        vector<size_t> pending;
+        for (size_t n = 0; n != files.size(); ++n) {
+          results[n].scan.filename = files[n];
+          if (cache.enabled() && ScanCache::stat (files[n], results[n]) && cache.find (files[n], results[n]))
+            continue;
+          pending.push_back (n);
+        }
+        if (cache.enabled())
+          INFO ("DICOM scan cache: " + str(files.size() - pending.size()) + " of " + str(files.size()) + " files up to date");
+
+        // Headers are parsed concurrently; each thread writes only to the
+        //   entries of the files it was handed, and the tree is assembled
+        //   afterwards in the original order of traversal
+        if (pending.size()) {
+          ProgressBar progress (message, pending.size());
+          size_t next = 0;
+          auto source = [&] (size_t& index) {
+            if (next >= pending.size())
+              return false;
+            index = pending[next++];
+            return true;
+          };
+          auto scanner = [&] (const size_t& index, size_t& out) {
+            results[index].valid = !results[index].scan.read (files[index]);
+            out = index;
+            return true;
+          };
+          auto sink = [&] (const size_t&) {
+            ++progress;
+            return true;
+          };
+          Thread::run_queue (source, size_t(), Thread::multi (scanner), size_t(), sink);
+        }
+
+        for (size_t n = 0; n != files.size(); ++n) {
+          try {
+            add (results[n]);
+          }
+          catch (Exception& E) {
+            E.display (3);
+          }
+        }
+
+        if (cache.enabled()) {
+          for (const auto n : pending)
+            cache.insert (results[n]);
+          cache.save();
+        }
+      }
+
+
+
+
+
       void Tree::read_file (const std::string& filename)
       {
-        QuickScan reader;
-        if (reader.read (filename)) {
+        ScanResult result;
+        result.valid = !result.scan.read (filename);
+        add (result);
+      }
+
+
+
+
+
+      void Tree::add (const ScanResult& result)
+      {
+        const QuickScan& reader (result.scan);
+        const std::string& filename (reader.filename);
+        if (!result.valid) {
           INFO ("error reading file \"" + filename + "\" - ignored");
           return;
         }
@@ -116,9 +184,14 @@ namespace MR {
 
       void Tree::read (const std::string& filename)
       {
-        ProgressBar progress ("scanning DICOM folder \"" + shorten (filename) + "\"", 0);
-        if (Path::is_dir (filename))
-          read_dir (filename, progress);
+        if (Path::is_dir (filename)) {
+          vector<std::string> files;
+          {
+            ProgressBar progress ("listing DICOM folder \"" + shorten (filename) + "\"", 0);
+            read_dir (filename, files, progress);
+          }
+          read_files (files, "scanning DICOM folder \"" + shorten (filename) + "\"");
+        }
         else {
           try {
             read_file (filename);
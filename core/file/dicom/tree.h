@@ -25,6 +25,7 @@ namespace MR {
 
       class Series; 
       class Patient;
+      class ScanResult;
 
       class Tree : public vector<std::shared_ptr<Patient>> { NOMEMALIGN
         public:
@@ -42,8 +43,10 @@ namespace MR {
           }
 
         protected:
-          void read_dir (const std::string& filename, ProgressBar& progress);
+          void read_dir (const std::string& filename, vector<std::string>& files, ProgressBar& progress);
+          void read_files (const vector<std::string>& files, const std::string& message);
           void read_file (const std::string& filename);
+          void add (const ScanResult& result);
       }; 
 
       std::ostream& operator<< (std::ostream& stream, const Tree& item);
@@ -70,6 +70,10 @@ namespace MR
         bool is_read_write () const {
           return readwrite;
         }
+        //! whether the file is mapped as-is, rather than held in a delayed write-back RAM buffer
+        bool is_mapped () const {
+          return addr;
+        }
         bool changed () const;
 
         friend std::ostream& operator<< (std::ostream& stream, const MMap& m) {
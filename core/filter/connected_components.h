@@ -22,7 +22,6 @@
 
 #include "filter/base.h"
 
-#include <stack>
 #include <iostream>
 
 namespace MR
@@ -46,6 +45,38 @@ namespace MR
     }
 
 
+    //! Compressed sparse row representation of the adjacency between mask elements
+    /*! The neighbours of element \a i are stored contiguously in \a indices,
+     * between positions \a offsets[i] and \a offsets[i+1]. */
+    class Adjacency { NOMEMALIGN
+      public:
+        class Neighbours { NOMEMALIGN
+          public:
+            Neighbours (const uint32_t* first, const uint32_t* last) : first (first), last (last) { }
+            const uint32_t* begin () const { return first; }
+            const uint32_t* end () const { return last; }
+            size_t size () const { return last - first; }
+            uint32_t operator[] (const size_t n) const { return first[n]; }
+          private:
+            const uint32_t* first;
+            const uint32_t* last;
+        };
+
+        Adjacency () : offsets (1, 0) { }
+
+        size_t size () const { return offsets.size() - 1; }
+        Neighbours operator[] (const size_t i) const {
+          return Neighbours (indices.data() + offsets[i], indices.data() + offsets[i+1]);
+        }
+
+        void clear () { offsets.assign (1, 0); indices.clear(); }
+
+        vector<uint32_t> offsets;
+        vector<uint32_t> indices;
+    };
+
+
+
     class Connector { NOMEMALIGN
 
       public:
@@ -59,21 +90,8 @@ namespace MR
         // Perform connected components on the mask.
         const vector<vector<int> >& run (vector<cluster>& clusters,
                                                    vector<uint32_t>& labels) const {
-          labels.resize (adjacent_indices.size(), 0);
-          uint32_t current_label = 1;
-          for (uint32_t i = 0; i < labels.size(); i++) {
-            // this node has not been already clustered
-            if (labels[i] == 0) {
-              cluster cluster;
-              cluster.label = current_label;
-              cluster.size = 0;
-              depth_first_search (i, cluster, labels);
-              clusters.push_back (cluster);
-              current_label++;
-            }
-          }
-          if (clusters.size() > std::numeric_limits<uint32_t>::max())
-            throw Exception ("The number of clusters is larger than can be labelled with an unsigned 32bit integer.");
+          vector<uint8_t> active (adjacent_indices.size(), 1);
+          label (active, clusters, labels);
           return mask_indices;
         }
 
@@ -84,21 +102,13 @@ namespace MR
                   vector<uint32_t>& labels,
                   const VectorType& data,
                   const float threshold) const {
-          labels.resize (adjacent_indices.size(), 0);
-          uint32_t current_label = 1;
-          for (uint32_t i = 0; i < labels.size(); i++) {
-            // this node has not been already clustered and is above threshold
-            if (labels[i] == 0 && data[i] > threshold) {
-              cluster cluster;
-              cluster.label = current_label;
-              cluster.size = 0;
-              depth_first_search (i, cluster, labels, data, threshold);
-              clusters.push_back (cluster);
-              current_label++;
-            }
-          }
-          if (clusters.size() > std::numeric_limits<uint32_t>::max())
-            throw Exception ("The number of clusters is larger than can be labelled with an unsigned 32bit integer.");
+          // Threshold all elements up front in a single branch-free pass, such
+          //   that the labelling below only ever reads a compact byte array
+          const size_t num_elements = adjacent_indices.size();
+          vector<uint8_t> active (num_elements);
+          for (size_t i = 0; i != num_elements; ++i)
+            active[i] = data[i] > threshold;
+          label (active, clusters, labels);
         }
 
 
@@ -112,19 +122,22 @@ namespace MR
         template <class MaskImageType>
         const vector<vector<int> >& precompute_adjacency (MaskImageType& mask) {
 
+          mask_indices.clear();
+          adjacent_indices.clear();
+
+          // Image of (index within mask_indices + 1); zero outside the mask
           auto index_image = Image<uint32_t>::scratch (mask);
 
           // 1st pass, store mask image indices and their index in the array
           for (auto l = Loop (mask) (mask, index_image); l; ++l) {
             if (mask.value() >= 0.5) {
               // For each voxel, store the index within mask_indices for 2nd pass
+              if (mask_indices.size() == std::numeric_limits<uint32_t>::max())
+                throw Exception ("The number of elements in the mask is larger than can be indexed with an unsigned 32bit integer.");
+              mask_indices.push_back (vector<int> (mask.ndim()));
               index_image.value() = mask_indices.size();
-              vector<int> index (mask.ndim());
               for (size_t dim = 0; dim < mask.ndim(); dim++)
-                index[dim] = mask.index(dim);
-              mask_indices.push_back (index);
-            } else {
-              index_image.value() = 0;
+                mask_indices.back()[dim] = mask.index(dim);
             }
           }
           // Here we pre-compute the offsets for our neighbours in 4D space
@@ -139,112 +152,72 @@ namespace MR
                   if ((abs(offset[0]) && dim_to_ignore[0]) || (abs(offset[1]) && dim_to_ignore[1]) ||
                       (abs(offset[2]) && dim_to_ignore[2]) || (abs(offset[3]) && dim_to_ignore[3]))
                     continue;
+                  if (!(offset[0] || offset[1] || offset[2] || offset[3]))
+                    continue;
                   neighbour_offsets.push_back (offset);
                 }
               }
             }
           }
           // 2nd pass, define adjacency
-          MaskImageType mask_neigh (mask);
-          for (vector<vector<int> >::const_iterator it = mask_indices.begin(); it != mask_indices.end(); ++it) {
-            vector<uint32_t> neighbour_indices;
-            for (vector< vector<int> >::const_iterator offset = neighbour_offsets.begin(); offset != neighbour_offsets.end(); ++offset) {
+          adjacent_indices.offsets.reserve (mask_indices.size() + 1);
+          adjacent_indices.indices.reserve (mask_indices.size() * neighbour_offsets.size());
+          for (const auto& position : mask_indices) {
+            for (const auto& offset : neighbour_offsets) {
               for (size_t dim = 0; dim < mask.ndim(); dim++)
-                mask_neigh.index(dim) = (*it)[dim] + (*offset)[dim];
-              if (!is_out_of_bounds (mask_neigh)) {
-                if (mask_neigh.value() >= 0.5) {
-                  assign_pos_of (mask_neigh).to (index_image);
-                  neighbour_indices.push_back (index_image.value());
-                }
+                index_image.index(dim) = position[dim] + offset[dim];
+              if (!is_out_of_bounds (index_image)) {
+                const uint32_t neighbour = index_image.value();
+                if (neighbour)
+                  adjacent_indices.indices.push_back (neighbour - 1);
               }
             }
-            adjacent_indices.push_back (neighbour_indices);
+            adjacent_indices.offsets.push_back (adjacent_indices.indices.size());
           }
+          adjacent_indices.indices.shrink_to_fit();
 
           return mask_indices;
         }
 
 
-        bool next_neighbour (uint32_t& node, vector<uint32_t>& labels) const {
-          for (size_t n = 0; n < adjacent_indices[node].size(); n++) {
-            if (labels[adjacent_indices[node][n]] == 0) {
-              node = adjacent_indices[node][n];
-              return true;
-            }
-          }
-          return false;
-        }
-
-
-        template <class VectorType>
-        bool next_neighbour (uint32_t& node,
-                             vector<uint32_t>& labels,
-                             const VectorType& data,
-                             const float threshold) const {
-          for (size_t n = 0; n < adjacent_indices[node].size(); n++) {
-            if (labels[adjacent_indices[node][n]] == 0 && data[adjacent_indices[node][n]] > threshold) {
-              node = adjacent_indices[node][n];
-              return true;
-            }
-          }
-          return false;
-        }
-
+        bool do_26_connectivity;
+        vector<bool> dim_to_ignore;
+        vector<vector<int> > mask_indices;
+        Adjacency adjacent_indices;
 
-        // use a non-recursive depth first search to agglomerate adjacent voxels
-        void depth_first_search (uint32_t root,
-                                 cluster& cluster,
-                                 vector<uint32_t>& labels) const {
-          uint32_t node = root;
-          std::stack<uint32_t> stack;
-          while (true) {
-            labels[node] = cluster.label;
-            stack.push (node);
-            cluster.size++;
-            if (next_neighbour (node, labels)) {
-              continue;
-            } else {
-              do {
-                if (stack.top() == root)
-                  return;
-                stack.pop();
-                node = stack.top();
-              } while (!next_neighbour (node, labels));
-            }
-          }
-        }
 
-        // use a non-recursive depth first search to agglomerate adjacent voxels
-        template <class VectorType>
-        void depth_first_search (uint32_t root,
-                                 cluster& cluster,
-                                 vector<uint32_t>& labels,
-                                 const VectorType& data,
-                                 const float threshold) const {
-          uint32_t node = root;
-          std::stack<uint32_t> stack;
-          while (true) {
-            labels[node] = cluster.label;
-            stack.push (node);
-            cluster.size++;
-            if (next_neighbour (node, labels, data, threshold)) {
+      protected:
+        // breadth-first search from each unlabelled active element in turn,
+        //   using a single flat array as the queue
+        void label (const vector<uint8_t>& active,
+                    vector<cluster>& clusters,
+                    vector<uint32_t>& labels) const {
+          const size_t num_elements = adjacent_indices.size();
+          labels.assign (num_elements, 0);
+          vector<uint32_t> queue (num_elements);
+          uint32_t current_label = 1;
+          for (uint32_t i = 0; i != num_elements; ++i) {
+            if (!active[i] || labels[i])
               continue;
-            } else {
-              do {
-                if (stack.top() == root)
-                  return;
-                stack.pop();
-                node = stack.top();
-              } while (!next_neighbour (node, labels, data, threshold));
+            if (current_label == std::numeric_limits<uint32_t>::max())
+              throw Exception ("The number of clusters is larger than can be labelled with an unsigned 32bit integer.");
+            size_t head = 0, tail = 0;
+            queue[tail++] = i;
+            labels[i] = current_label;
+            while (head != tail) {
+              for (const auto neighbour : adjacent_indices[queue[head++]]) {
+                if (active[neighbour] && !labels[neighbour]) {
+                  labels[neighbour] = current_label;
+                  queue[tail++] = neighbour;
+                }
+              }
             }
+            cluster cluster;
+            cluster.label = current_label++;
+            cluster.size = tail;
+            clusters.push_back (cluster);
           }
         }
-
-
-        bool do_26_connectivity;
-        vector<bool> dim_to_ignore;
-        vector<vector<int> > mask_indices;
-        vector<vector<uint32_t> > adjacent_indices;
     };
 
 
@@ -18,6 +18,7 @@
 
 #include "adapter/reslice.h"
 #include "algo/threaded_copy.h"
+#include "algo/threaded_loop.h"
 #include "datatype.h"
 
 namespace MR
@@ -25,6 +26,18 @@ namespace MR
   namespace Filter
   {
 
+    // Copy all volumes of a 4D image at once; for the Reslice and Warp adapters,
+    //   this means the interpolation weights are computed only once per voxel
+    class CopyKernel4D { NOMEMALIGN
+      public:
+        template <class InputImageType, class OutputImageType>
+          FORCE_INLINE void operator() (InputImageType& in, OutputImageType& out) const {
+            out.row(3) = in.row(3);
+          }
+    };
+
+
+
     //! convenience function to regrid one Image onto another
     /*! This function resamples (regrids) the Image \a source onto the
      * Image& \a destination, using the templated interpolator class.
@@ -52,7 +65,10 @@ namespace MR
           const typename ImageTypeDestination::value_type value_when_out_of_bounds = Interp::Base<ImageTypeDestination>::default_out_of_bounds_value())
       {
         Adapter::Reslice<Interpolator, ImageTypeSource> interp (source, destination, transform, oversampling, value_when_out_of_bounds);
-        threaded_copy_with_progress_message ("reslicing \"" + source.name() + "\"", interp, destination, 0, source.ndim(), 2);
+        if (source.ndim() == 4 && source.size(3) > 1)
+          ThreadedLoop ("reslicing \"" + source.name() + "\"", interp, 0, 3, 1).run (CopyKernel4D(), interp, destination);
+        else
+          threaded_copy_with_progress_message ("reslicing \"" + source.name() + "\"", interp, destination, 0, source.ndim(), 2);
       }
 
 
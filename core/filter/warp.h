@@ -30,17 +30,6 @@ namespace MR
   {
 
 
-  // TODO if there is a use for this elsewhere then we should have threaded_copy4D convenience functions
-  class CopyKernel4D { NOMEMALIGN
-    public:
-      template <class InputImageType, class OutputImageType>
-        FORCE_INLINE void operator() (InputImageType& in, OutputImageType& out) const {
-          out.row(3) = in.row(3);
-        }
-  };
-
-
-
     //! convenience function to warp one image onto another
     /*! This function resamples (regrids) the Image \a source onto the
      * Image& \a destination, using the templated interpolator class and a supplied deformation field.
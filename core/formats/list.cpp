@@ -28,6 +28,8 @@ namespace MR
     Pipe          pipe_handler;
     MRtrix        mrtrix_handler;
     MRtrix_GZ     mrtrix_gz_handler;
+    MRtrix_bricked mrtrix_bricked_handler;
+    MRtrix_chunked mrtrix_chunked_handler;
     MRI           mri_handler;
     NIfTI1        nifti1_handler;
     NIfTI2        nifti2_handler;
@@ -52,6 +54,8 @@ namespace MR
       &dicom_handler,
       &mrtrix_handler,
       &mrtrix_gz_handler,
+      &mrtrix_bricked_handler,
+      &mrtrix_chunked_handler,
       &nifti1_handler,
       &nifti2_handler,
       &nifti1_gz_handler,
@@ -74,6 +78,8 @@ namespace MR
       ".mih",
       ".mif",
       ".mif.gz",
+      ".mib",
+      ".mifz",
       ".img",
       ".nii",
       ".nii.gz",
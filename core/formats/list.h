@@ -92,6 +92,8 @@ namespace MR
     DECLARE_IMAGEFORMAT (DICOM, "DICOM");
     DECLARE_IMAGEFORMAT (MRtrix, "MRtrix");
     DECLARE_IMAGEFORMAT (MRtrix_GZ, "MRtrix (GZip compressed)");
+    DECLARE_IMAGEFORMAT (MRtrix_bricked, "MRtrix (bricked)");
+    DECLARE_IMAGEFORMAT (MRtrix_chunked, "MRtrix (compressed chunks)");
     DECLARE_IMAGEFORMAT (NIfTI1, "NIfTI-1.1");
     DECLARE_IMAGEFORMAT (NIfTI2, "NIfTI-2");
     DECLARE_IMAGEFORMAT (NIfTI1_GZ, "NIfTI-1.1 (GZip compressed)");
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "header.h"
+#include "image_io/bricked.h"
+#include "formats/list.h"
+#include "formats/mrtrix_utils.h"
+#include "file/ofstream.h"
+#include "file/utils.h"
+#include "file/entry.h"
+#include "file/path.h"
+#include "file/key_value.h"
+
+namespace MR
+{
+  namespace Formats
+  {
+
+    // extensions are:
+    // mib: MRtrix Image, Bricked
+
+    std::unique_ptr<ImageIO::Base> MRtrix_bricked::read (Header& H) const
+    {
+      if (!Path::has_suffix (H.name(), ".mib"))
+        return std::unique_ptr<ImageIO::Base>();
+
+      File::KeyValue kv (H.name(), "mrtrix bricked image");
+
+      read_mrtrix_header (H, kv);
+
+      const auto brick_it = H.keyval().find ("brick_size");
+      if (brick_it == H.keyval().end())
+        throw Exception ("missing \"brick_size\" entry in header for image \"" + H.name() + "\"");
+      vector<size_t> brick_size;
+      for (auto n : parse_ints (brick_it->second))
+        brick_size.push_back (n);
+      H.keyval().erase (brick_it);
+
+      if (brick_size.size() != H.ndim() || ImageIO::Bricked::actual_brick_size (H, brick_size) != brick_size)
+        throw Exception ("invalid brick size specified in header for image \"" + H.name() + "\"");
+
+      std::string fname;
+      size_t offset;
+      get_mrtrix_file_path (H, "file", fname, offset);
+
+      std::unique_ptr<ImageIO::Bricked> io_handler (new ImageIO::Bricked (H, brick_size));
+      io_handler->files.push_back (File::Entry (fname, offset));
+
+      return std::move (io_handler);
+    }
+
+
+
+
+
+    bool MRtrix_bricked::check (Header& H, size_t num_axes) const
+    {
+      if (!Path::has_suffix (H.name(), ".mib"))
+        return false;
+
+      H.ndim() = num_axes;
+      for (size_t i = 0; i < H.ndim(); i++)
+        if (H.size (i) < 1)
+          H.size(i) = 1;
+
+      return true;
+    }
+
+
+
+
+    std::unique_ptr<ImageIO::Base> MRtrix_bricked::create (Header& H) const
+    {
+      const auto brick_size = ImageIO::Bricked::actual_brick_size (H, ImageIO::Bricked::default_brick_size());
+
+      File::OFStream out (H.name(), std::ios::out | std::ios::binary);
+
+      out << "mrtrix bricked image\n";
+
+      write_mrtrix_header (H, out);
+
+      out << "brick_size: " << brick_size[0];
+      for (size_t n = 1; n < brick_size.size(); ++n)
+        out << "," << brick_size[n];
+      out << "\n";
+
+      out << "file: ";
+      int64_t offset = out.tellp() + int64_t(18);
+      offset += ((4 - (offset % 4)) % 4);
+      out << ". " << offset << "\nEND\n";
+
+      out.close();
+
+      File::resize (H.name(), offset + ImageIO::Bricked::footprint (H, brick_size));
+
+      std::unique_ptr<ImageIO::Bricked> io_handler (new ImageIO::Bricked (H, brick_size));
+      io_handler->files.push_back (File::Entry (H.name(), offset));
+
+      return std::move (io_handler);
+    }
+
+
+  }
+}
+
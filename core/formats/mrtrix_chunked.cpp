@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "header.h"
+#include "image_io/chunked.h"
+#include "formats/list.h"
+#include "formats/mrtrix_utils.h"
+#include "file/ofstream.h"
+#include "file/utils.h"
+#include "file/entry.h"
+#include "file/path.h"
+#include "file/key_value.h"
+
+namespace MR
+{
+  namespace Formats
+  {
+
+    // extensions are:
+    // mifz: MRtrix Image, compressed in independent chunks
+
+    namespace {
+      inline std::string compression_for (const Header& H)
+      {
+        return H.datatype().bytes() > 1 ? "shuffle,zlib" : "zlib";
+      }
+    }
+
+
+
+    std::unique_ptr<ImageIO::Base> MRtrix_chunked::read (Header& H) const
+    {
+      if (!Path::has_suffix (H.name(), ".mifz"))
+        return std::unique_ptr<ImageIO::Base>();
+
+      File::KeyValue kv (H.name(), "mrtrix chunked image");
+
+      read_mrtrix_header (H, kv);
+
+      const auto compression_it = H.keyval().find ("compression");
+      if (compression_it == H.keyval().end() || compression_it->second != compression_for (H))
+        throw Exception ("unsupported compression scheme for image \"" + H.name() + "\"");
+      H.keyval().erase (compression_it);
+
+      const auto chunk_it = H.keyval().find ("chunk_size");
+      if (chunk_it == H.keyval().end())
+        throw Exception ("missing \"chunk_size\" entry in header for image \"" + H.name() + "\"");
+      vector<size_t> chunk_size;
+      for (auto n : parse_ints (chunk_it->second))
+        chunk_size.push_back (n);
+      H.keyval().erase (chunk_it);
+
+      if (!ImageIO::Chunked::is_valid_chunk_size (H, chunk_size))
+        throw Exception ("invalid chunk size specified in header for image \"" + H.name() + "\"");
+
+      std::string fname;
+      size_t offset;
+      get_mrtrix_file_path (H, "file", fname, offset);
+
+      std::unique_ptr<ImageIO::Chunked> io_handler (new ImageIO::Chunked (H, chunk_size));
+      io_handler->files.push_back (File::Entry (fname, offset));
+
+      return std::move (io_handler);
+    }
+
+
+
+
+
+    bool MRtrix_chunked::check (Header& H, size_t num_axes) const
+    {
+      if (!Path::has_suffix (H.name(), ".mifz"))
+        return false;
+
+      H.ndim() = num_axes;
+      for (size_t i = 0; i < H.ndim(); i++)
+        if (H.size (i) < 1)
+          H.size(i) = 1;
+
+      return true;
+    }
+
+
+
+
+    std::unique_ptr<ImageIO::Base> MRtrix_chunked::create (Header& H) const
+    {
+      const auto chunk_size = ImageIO::Chunked::default_chunk_size (H);
+
+      File::OFStream out (H.name(), std::ios::out | std::ios::binary);
+
+      out << "mrtrix chunked image\n";
+
+      write_mrtrix_header (H, out);
+
+      out << "compression: " << compression_for (H) << "\n";
+      out << "chunk_size: " << chunk_size[0];
+      for (size_t n = 1; n < chunk_size.size(); ++n)
+        out << "," << chunk_size[n];
+      out << "\n";
+
+      out << "file: ";
+      int64_t offset = out.tellp() + int64_t(18);
+      offset += ((8 - (offset % 8)) % 8);
+      out << ". " << offset << "\nEND\n";
+
+      out.close();
+
+      std::unique_ptr<ImageIO::Chunked> io_handler (new ImageIO::Chunked (H, chunk_size));
+      io_handler->files.push_back (File::Entry (H.name(), offset));
+
+      return std::move (io_handler);
+    }
+
+
+  }
+}
+
+
@@ -21,6 +21,7 @@
 #include "transform.h"
 #include "image_io/default.h"
 #include "image_io/scratch.h"
+#include "image_io/bricked.h"
 #include "file/name_parser.h"
 #include "formats/list.h"
 
@@ -332,6 +333,20 @@ namespace MR
 
 
 
+  Header Header::scratch (const Header& template_header, const std::string& label, const DataType& datatype)
+  {
+    Header H (scratch (template_header, label));
+    if (datatype.undefined() || !ImageIO::Bricked::use_for_scratch (footprint (voxel_count (H), datatype)))
+      return H;
+
+    H.datatype() = datatype;
+    H.format_ = "scratch image (bricked)";
+    H.io = make_unique<ImageIO::Bricked> (H, ImageIO::Bricked::default_brick_size());
+    return H;
+  }
+
+
+
 
 
 
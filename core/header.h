@@ -330,6 +330,11 @@ namespace MR
       static Header open (const std::string& image_name);
       static Header create (const std::string& image_name, const Header& template_header);
       static Header scratch (const Header& template_header, const std::string& label = "scratch image");
+      //! as above, for a scratch image holding values of type \a datatype
+      /*! If the image is large enough (see the ScratchBrickThreshold config
+       * file entry), it will be held out-of-core in bricks rather than in
+       * RAM, and access will be via indirect IO. */
+      static Header scratch (const Header& template_header, const std::string& label, const DataType& datatype);
 
       /*! use to prevent automatic realignment of transform matrix into
        * near-standard (RAS) coordinate system. */
@@ -23,6 +23,7 @@
 #include "debug.h"
 #include "header.h"
 #include "image_io/fetch_store.h"
+#include "image_io/bricked.h"
 #include "image_helpers.h"
 #include "formats/mrtrix_utils.h"
 #include "algo/copy.h"
@@ -85,12 +86,36 @@ namespace MR
         //! get voxel value at current location
       FORCE_INLINE ValueType get_value () const {
           if (data_pointer) return Raw::fetch_native<ValueType> (data_pointer, data_offset);
-          return buffer->get_value (data_offset);
+          return buffer->get_value (data_offset, brick_ref);
         }
       //! set voxel value at current location
         FORCE_INLINE void set_value (ValueType val) {
           if (data_pointer) Raw::store_native<ValueType> (val, data_pointer, data_offset);
-          else buffer->set_value (data_offset, val);
+          else buffer->set_value (data_offset, val, brick_ref);
+        }
+
+        //! get values of \a count voxels along \a axis, starting from the current location
+        /*! This provides bulk access to rows of voxel values, and avoids
+         * the per-voxel overhead of converting data to & from storage when
+         * direct IO is not possible. The current location is not modified. */
+        FORCE_INLINE void get_values (size_t axis, size_t count, ValueType* values) const {
+          if (data_pointer) {
+            size_t offset = data_offset;
+            for (size_t n = 0; n < count; ++n, offset += stride (axis))
+              values[n] = Raw::fetch_native<ValueType> (data_pointer, offset);
+          }
+          else buffer->get_values (data_offset, stride (axis), count, values);
+        }
+        //! set values of \a count voxels along \a axis, starting from the current location
+        /*! \sa get_values() */
+        FORCE_INLINE void set_values (size_t axis, size_t count, const ValueType* values) {
+          if (data_pointer) {
+            size_t offset = data_offset;
+            for (size_t n = 0; n < count; ++n, offset += stride (axis))
+              Raw::store_native<ValueType> (values[n], data_pointer, offset);
+          }
+          else buffer->set_values (data_offset, stride (axis), count, values);
+          buffer->notify_written (data_offset, stride (axis), count);
         }
 
         //! use for debugging
@@ -188,9 +213,15 @@ namespace MR
           return Header::create (image_name, template_header).get_image<ValueType>();
         }
         static Image scratch (const Header& template_header, const std::string& label = "scratch image") {
-          return Header::scratch (template_header, label).get_image<ValueType>();
+          return Header::scratch (template_header, label, DataType::from<ValueType>()).template get_image<ValueType>();
         }
 
+      protected:
+        //! brick currently accessed, for images stored out-of-core
+        /*! This is declared before the buffer, such that it is released
+         * before the buffer is replaced on assignment. */
+        mutable ImageIO::Bricked::BrickRef brick_ref;
+      public:
         //! shared reference to header/buffer
         std::shared_ptr<Buffer> buffer;
       protected:
@@ -221,30 +252,122 @@ namespace MR
         Buffer& operator= (const Buffer&) = delete;
         Buffer& operator= (Buffer&&) = default;
         Buffer (const Buffer& b) : 
-          Header (b), fetch_func (b.fetch_func), store_func (b.store_func) { }
+          Header (b), fetch_func (b.fetch_func), store_func (b.store_func), 
+          fetch_row_func (b.fetch_row_func), store_row_func (b.store_row_func),
+          pending_input (b.pending_input), streaming_output (b.streaming_output) { }
 
 
-        FORCE_INLINE ValueType get_value (size_t offset) const {
+        FORCE_INLINE ValueType get_value (size_t offset, ImageIO::Bricked::BrickRef& brick_ref) const {
+          if (pending_input)
+            wait_for_all_data();
+          if (bricked)
+            return get_bricked_value (offset, brick_ref);
           ssize_t nseg = offset / io->segment_size();
           return fetch_func (io->segment (nseg), offset - nseg*io->segment_size(), intensity_offset(), intensity_scale());
         }
 
-        FORCE_INLINE void set_value (size_t offset, ValueType val) const {
+        FORCE_INLINE void set_value (size_t offset, ValueType val, ImageIO::Bricked::BrickRef& brick_ref) const {
+          if (bricked) {
+            set_bricked_value (offset, val, brick_ref);
+            return;
+          }
           ssize_t nseg = offset / io->segment_size();
           store_func (val, io->segment (nseg), offset - nseg*io->segment_size(), intensity_offset(), intensity_scale());
+          notify_written (offset, 1, 1);
+        }
+
+        void get_values (size_t offset, ssize_t stride, size_t count, ValueType* values) const {
+          if (pending_input)
+            io->wait_for_data (offset, stride, count);
+          if (bricked) {
+            bricked->access (offset, stride, count, false, [&] (const uint8_t* data, size_t index, ssize_t brick_stride, size_t n) {
+                fetch_row_func (data, index, brick_stride, n, values, intensity_offset(), intensity_scale());
+                values += n;
+                });
+            return;
+          }
+          while (count) {
+            ssize_t nseg = offset / io->segment_size();
+            const size_t index = offset - nseg*io->segment_size();
+            const size_t n = std::min (count, count_in_segment (index, stride));
+            fetch_row_func (io->segment (nseg), index, stride, n, values, intensity_offset(), intensity_scale());
+            offset += n * stride;
+            values += n;
+            count -= n;
+          }
+        }
+        void set_values (size_t offset, ssize_t stride, size_t count, const ValueType* values) const {
+          if (bricked) {
+            bricked->access (offset, stride, count, true, [&] (uint8_t* data, size_t index, ssize_t brick_stride, size_t n) {
+                store_row_func (values, data, index, brick_stride, n, intensity_offset(), intensity_scale());
+                values += n;
+                });
+            return;
+          }
+          while (count) {
+            ssize_t nseg = offset / io->segment_size();
+            const size_t index = offset - nseg*io->segment_size();
+            const size_t n = std::min (count, count_in_segment (index, stride));
+            store_row_func (values, io->segment (nseg), index, stride, n, intensity_offset(), intensity_scale());
+            offset += n * stride;
+            values += n;
+            count -= n;
+          }
         }
 
         std::unique_ptr<uint8_t[]> data_buffer;
         void* get_data_pointer ();
 
+        //! notify the IO handler of voxels written, if the image is being streamed
+        /*! Direct IO is not used for streamed images, so that all writes,
+         * whether per voxel or in bulk, are notified. Data written to a
+         * preloaded copy are only notified when written back. */
+        FORCE_INLINE void notify_written (size_t offset, ssize_t stride, size_t count) const {
+          if (streaming_output && !data_buffer)
+            io->data_written (offset, stride, count);
+        }
+
         FORCE_INLINE ImageIO::Base* get_io () const { return io.get(); }
 
       protected:
         std::function<ValueType(const void*,size_t,default_type,default_type)> fetch_func;
         std::function<void(ValueType,void*,size_t,default_type,default_type)> store_func;
+        std::function<void(const void*,size_t,ssize_t,size_t,ValueType*,default_type,default_type)> fetch_row_func;
+        std::function<void(const ValueType*,void*,size_t,ssize_t,size_t,default_type,default_type)> store_row_func;
+        // whether the image is being written / read concurrently by another process:
+        bool pending_input = false, streaming_output = false;
+        // set if the data are stored out-of-core:
+        ImageIO::Bricked* bricked = nullptr;
 
         void set_fetch_store_functions () {
           __set_fetch_store_functions (fetch_func, store_func, datatype());
+          __set_fetch_store_row_functions (fetch_row_func, store_row_func, datatype());
+        }
+
+        //! number of values separated by \a stride from \a index that lie within the same segment
+        size_t count_in_segment (size_t index, ssize_t stride) const {
+          if (stride > 0) return (io->segment_size() - 1 - index) / stride + 1;
+          if (stride < 0) return index / (-stride) + 1;
+          return std::numeric_limits<size_t>::max();
+        }
+
+        ValueType get_bricked_value (size_t offset, ImageIO::Bricked::BrickRef& brick_ref) const {
+          ValueType val;
+          bricked->access (offset, false, brick_ref, [&] (const uint8_t* data, size_t index) {
+              val = fetch_func (data, index, intensity_offset(), intensity_scale());
+              });
+          return val;
+        }
+
+        void set_bricked_value (size_t offset, ValueType val, ImageIO::Bricked::BrickRef& brick_ref) const {
+          bricked->access (offset, true, brick_ref, [&] (uint8_t* data, size_t index) {
+              store_func (val, data, index, intensity_offset(), intensity_scale());
+              });
+        }
+
+        void wait_for_all_data () const {
+          if (io->is_data_pending())
+            io->wait_for_data (0, 1, io->nsegments() * io->segment_size());
         }
     };
 
@@ -294,6 +417,17 @@ namespace MR
 
       FORCE_INLINE value_type get_value () const { return Raw::fetch_native<ValueType> (data, offset); } 
         FORCE_INLINE void set_value (ValueType val) { Raw::store_native<ValueType> (val, data, offset); }
+
+        FORCE_INLINE void get_values (size_t axis, size_t count, ValueType* values) const {
+          size_t o = offset;
+          for (size_t n = 0; n < count; ++n, o += stride (axis))
+            values[n] = Raw::fetch_native<ValueType> (data, o);
+        }
+        FORCE_INLINE void set_values (size_t axis, size_t count, const ValueType* values) {
+          size_t o = offset;
+          for (size_t n = 0; n < count; ++n, o += stride (axis))
+            Raw::store_native<ValueType> (values[n], data, o);
+        }
       };
     
     CHECK_MEM_ALIGN (TmpImage<float>);
@@ -318,6 +452,9 @@ namespace MR
         io->open (*this, footprint<ValueType> (voxel_count (*this)));
         if (io->is_file_backed()) 
           set_fetch_store_functions ();
+        pending_input = io->is_data_pending();
+        bricked = dynamic_cast<ImageIO::Bricked*> (io.get());
+        streaming_output = io->is_streaming_output();
       }
 
 
@@ -332,9 +469,22 @@ namespace MR
         return data_buffer.get();
 
       assert (io && "data pointer will only be set for valid Images");
+      if (bricked) // data are stored out-of-core
+        return nullptr;
+
       if (!io->is_file_backed()) // this is a scratch image
         return io->segment(0);
 
+      // data still being written by another process: access must go via
+      // get_value() / get_values(), which wait for the data to be available
+      if (pending_input && io->is_data_pending())
+        return nullptr;
+
+      // data being read by another process as they are written: writes must
+      // go via set_value() / set_values(), so that they can be tracked
+      if (streaming_output)
+        return nullptr;
+
       // check whether we can still do direct IO
       // if so, return address where mapped
       if (io->nsegments() == 1 && datatype() == DataType::from<ValueType>() && intensity_offset() == 0.0 && intensity_scale() == 1.0)
@@ -386,6 +536,7 @@ namespace MR
   template <typename ValueType>
     Image<ValueType>::~Image () 
     {
+      brick_ref.release();
       if (buffer.unique()) {
         // was image preloaded and read/write? If so,need to write back:
         if (buffer->get_io()) {
@@ -420,6 +571,9 @@ namespace MR
       else 
         with_strides = Stride::get (*this); 
 
+      // data still being streamed from another command:
+      preload |= buffer->get_io()->is_data_pending();
+
       if (!preload) 
         return std::move (*this);
 
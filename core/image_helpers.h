@@ -171,6 +171,21 @@ namespace MR
       static bool const value = std::is_same<ImageType, ::MR::Image<typename ImageType::value_type>>::value;
     };
 
+  //! convenience function for SFINAE on images providing bulk access to rows of voxel values
+  /*! Such images provide get_values() and set_values() methods, as
+   * documented for the Image class. */
+  template<typename ImageType>
+    class has_row_access { NOMEMALIGN
+      typedef char yes[1], no[2];
+      template<typename C> static yes& test (decltype ((void) (
+              std::declval<const C&>().get_values (size_t(0), size_t(0), (typename C::value_type*) nullptr),
+              std::declval<C&>().set_values (size_t(0), size_t(0), (const typename C::value_type*) nullptr)
+              ), 0));
+      template<typename C> static no&  test(...);
+      public:
+      static bool const value = sizeof(test<ImageType>(0)) == sizeof(yes);
+    };
+
   //! convenience function for SFINAE on images NOT of type Image<ValueType>
   template<class ImageType>
     struct is_adapter_type { NOMEMALIGN
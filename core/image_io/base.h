@@ -58,6 +58,20 @@ namespace MR
         void open (const Header& header, size_t buffer_size = 0);
         void close (const Header& header);
 
+        //! whether the image data are still being written by another process
+        /*! If so, direct access to the data is not possible, and
+         * wait_for_data() must be invoked before accessing any voxel. */
+        virtual bool is_data_pending () const { return false; }
+        //! wait until the \a count voxels at \a offset separated by \a stride are available
+        virtual void wait_for_data (size_t offset, ssize_t stride, size_t count) const { }
+
+        //! whether the image data are being read by another process as they are written
+        /*! If so, data_written() should be invoked once voxels have been
+         * written to the data returned by segment(). */
+        virtual bool is_streaming_output () const { return false; }
+        //! notify that the \a count voxels at \a offset separated by \a stride have been written
+        virtual void data_written (size_t offset, ssize_t stride, size_t count) { }
+
         bool is_image_new () const { return is_new; }
         bool is_image_readwrite () const { return writable; }
 
@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "image_io/bricked.h"
+#include "header.h"
+#include "stride.h"
+#include "signal_handler.h"
+#include "file/config.h"
+#include "file/utils.h"
+
+#define NO_SLOT std::numeric_limits<size_t>::max()
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+    namespace {
+      inline size_t log2_ceil (size_t n)
+      {
+        size_t l = 0;
+        while ((size_t (1) << l) < n)
+          ++l;
+        return l;
+      }
+    }
+
+
+
+    //CONF option: BrickSize
+    //CONF default: 32,32,32
+    //CONF The size of the bricks used to store images out-of-core, along
+    //CONF each image axis (axes not listed have a brick size of 1). Sizes
+    //CONF are rounded up to the nearest power of two. This applies to
+    //CONF images created in the MRtrix bricked format (.mib), and to large
+    //CONF scratch images (see ScratchBrickThreshold).
+
+    vector<size_t> Bricked::default_brick_size ()
+    {
+      static const vector<size_t> size = [] {
+        vector<size_t> size;
+        try {
+          for (auto n : parse_ints (File::Config::get ("BrickSize", "32,32,32")))
+            size.push_back (std::max (n, 1));
+        }
+        catch (Exception& E) {
+          E.display();
+          WARN ("invalid value for config file entry \"BrickSize\" - ignored");
+          size = { 32, 32, 32 };
+        }
+        return size;
+      }();
+      return size;
+    }
+
+
+
+    //CONF option: ScratchBrickThreshold
+    //CONF default: 0 (disabled)
+    //CONF The size (in MB) above which scratch images are held out-of-core,
+    //CONF as bricks in a temporary file (see BrickSize and BrickCacheSize),
+    //CONF rather than in RAM. This allows commands such as tckmap to
+    //CONF produce outputs larger than the available RAM, at the expense of
+    //CONF performance.
+
+    bool Bricked::use_for_scratch (int64_t bytes)
+    {
+      static const int64_t threshold = int64_t (File::Config::get_int ("ScratchBrickThreshold", 0)) << 20;
+      return threshold > 0 && bytes > threshold;
+    }
+
+
+
+    vector<size_t> Bricked::actual_brick_size (const Header& header, const vector<size_t>& requested)
+    {
+      vector<size_t> size (header.ndim());
+      for (size_t n = 0; n < header.ndim(); ++n) {
+        const size_t log2 = std::min (log2_ceil (n < requested.size() ? requested[n] : 1), log2_ceil (header.size (n)));
+        size[n] = size_t (1) << log2;
+      }
+      return size;
+    }
+
+
+
+    int64_t Bricked::footprint (const Header& header, const vector<size_t>& brick_size)
+    {
+      int64_t voxels_per_brick = 1, num_bricks = 1;
+      for (size_t n = 0; n < header.ndim(); ++n) {
+        voxels_per_brick *= brick_size[n];
+        num_bricks *= (header.size (n) + brick_size[n] - 1) / brick_size[n];
+      }
+      return num_bricks * ((header.datatype().bits() * voxels_per_brick + 7) / 8);
+    }
+
+
+
+
+
+    Bricked::Bricked (const Header& header, const vector<size_t>& brick_size) :
+      Bricked (header, actual_brick_size (header, brick_size), false) { }
+
+    Bricked::Bricked (const Header& header, const vector<size_t>& brick_size, bool contiguous) :
+      Base (header),
+      bricks (brick_size),
+      contiguous (contiguous),
+      bits_per_voxel (0),
+      brick_voxels (0),
+      brick_bytes (0),
+      num_bricks (0),
+      fd (-1),
+      temporary (false),
+      cache_capacity (0),
+      most_recent (NO_SLOT),
+      least_recent (NO_SLOT) { }
+
+
+    bool Bricked::is_file_backed () const { return true; }
+
+
+
+    //CONF option: BrickCacheSize
+    //CONF default: 1024
+    //CONF The maximum amount of RAM (in MB) used to hold the bricks of
+    //CONF each image stored out-of-core (see BrickSize).
+
+    void Bricked::init_layout (const Header& header)
+    {
+      // image axes in order of increasing stride:
+      const auto strides = Stride::get_actual (Stride::get (header), header);
+      const auto order = Stride::order (strides);
+
+      dim.resize (header.ndim());
+      brick_voxels = 1;
+      num_bricks = 1;
+      for (size_t n = 0; n < dim.size(); ++n) {
+        const size_t axis = order[n];
+        dim[n].size = header.size (axis);
+        dim[n].stride = std::abs (strides[axis]);
+        dim[n].brick = bricks[axis];
+        dim[n].brick_log2 = log2_ceil (bricks[axis]);
+        dim[n].brick_shift = log2_ceil (brick_voxels);
+        dim[n].grid_stride = num_bricks;
+        brick_voxels *= dim[n].brick;
+        num_bricks *= (dim[n].size + dim[n].brick - 1) / dim[n].brick;
+      }
+      if (contiguous)
+        num_bricks = (voxel_count (header) + brick_voxels - 1) / brick_voxels;
+
+      bits_per_voxel = header.datatype().bits();
+      brick_bytes = (bits_per_voxel * brick_voxels + 7) / 8;
+
+      cache_capacity = std::max<int64_t> ((int64_t (File::Config::get_int ("BrickCacheSize", 1024)) << 20) / brick_bytes, 1);
+      cache.reserve (std::min (cache_capacity, num_bricks));
+      slot_of_brick.assign (num_bricks, NO_SLOT);
+    }
+
+
+
+    void Bricked::load (const Header& header, size_t)
+    {
+      if (files.size() > 1)
+        throw Exception ("bricked images must be stored in a single file");
+
+      init_layout (header);
+      const int64_t data_size = num_bricks * brick_bytes;
+
+      if (files.empty()) {
+        // scratch image: hold bricks in a temporary file
+        temporary = true;
+        files.push_back (File::Entry (File::create_tempfile (data_size, "bricks")));
+        SignalHandler::mark_file_for_deletion (files[0].name);
+      }
+
+      DEBUG ("opening bricked image \"" + header.name() + "\" in file \"" + files[0].name + "\" with brick size " + str(bricks)
+          + " (" + str(num_bricks) + " bricks of " + str(brick_bytes) + " bytes)");
+
+      fd = ::open (files[0].name.c_str(), ( writable || is_new || temporary ) ? O_RDWR : O_RDONLY);
+      if (fd < 0)
+        throw Exception ("error opening file \"" + files[0].name + "\": " + strerror (errno));
+
+      // data are not directly addressable, but an entry is required to mark
+      // the image as loaded:
+      addresses.resize (1);
+    }
+
+
+
+    void Bricked::unload (const Header& header)
+    {
+      if (fd < 0)
+        return;
+
+      if (!temporary && (writable || is_new)) {
+        DEBUG ("writing back bricks for image \"" + header.name() + "\"...");
+        flush();
+      }
+
+      ::close (fd);
+      fd = -1;
+      cache.clear();
+      slot_of_brick.clear();
+      most_recent = least_recent = NO_SLOT;
+
+      if (temporary) {
+        DEBUG ("deleting temporary file \"" + files[0].name + "\" for bricked image \"" + header.name() + "\"...");
+        unlink (files[0].name.c_str());
+        SignalHandler::unmark_file_for_deletion (files[0].name);
+      }
+    }
+
+
+
+
+
+    void Bricked::read_brick (size_t brick, uint8_t* data)
+    {
+      int64_t offset = files[0].start + int64_t (brick) * brick_bytes;
+      size_t remaining = brick_bytes;
+      while (remaining) {
+        const ssize_t n = pread (fd, data, remaining, offset);
+        if (n < 0)
+          throw Exception ("error reading brick from file \"" + files[0].name + "\": " + strerror (errno));
+        if (n == 0) { // beyond end of file
+          memset (data, 0, remaining);
+          return;
+        }
+        data += n;
+        offset += n;
+        remaining -= n;
+      }
+    }
+
+
+
+    void Bricked::write_brick (size_t brick, const uint8_t* data)
+    {
+      int64_t offset = files[0].start + int64_t (brick) * brick_bytes;
+      size_t remaining = brick_bytes;
+      while (remaining) {
+        const ssize_t n = pwrite (fd, data, remaining, offset);
+        if (n <= 0)
+          throw Exception ("error writing brick to file \"" + files[0].name + "\": " + strerror (errno));
+        data += n;
+        offset += n;
+        remaining -= n;
+      }
+    }
+
+
+
+
+
+    uint8_t* Bricked::get_brick (size_t brick, bool write, std::unique_lock<std::mutex>& lock)
+    {
+      assert (brick < num_bricks);
+      size_t slot;
+
+      // wait for any other thread currently reading this brick:
+      while ((slot = slot_of_brick[brick]) != NO_SLOT && cache[slot].loading)
+        loaded.wait (lock);
+
+      if (slot == NO_SLOT) {
+        // bricks still being read by other threads, or held by a BrickRef,
+        // cannot be evicted:
+        size_t victim = least_recent;
+        while (victim != NO_SLOT && (cache[victim].loading || cache[victim].pins))
+          victim = cache[victim].previous;
+
+        if (cache.size() < cache_capacity || victim == NO_SLOT) {
+          slot = cache.size();
+          cache.push_back ({ NO_SLOT, NO_SLOT, NO_SLOT, 0, false, false, std::unique_ptr<uint8_t[]> (new uint8_t [brick_bytes]) });
+        }
+        else {
+          // evict least recently used brick:
+          slot = victim;
+          Slot& evicted (cache[slot]);
+          if (evicted.dirty)
+            write_brick (evicted.brick, evicted.data.get());
+          if (evicted.brick != NO_SLOT)
+            slot_of_brick[evicted.brick] = NO_SLOT;
+          unlink_slot (slot);
+        }
+
+        cache[slot].brick = brick;
+        cache[slot].dirty = false;
+        cache[slot].loading = true;
+        link_slot (slot);
+        slot_of_brick[brick] = slot;
+
+        // other threads may grow the cache in the meantime, so only the
+        // data pointer itself is retained while unlocked:
+        uint8_t* data = cache[slot].data.get();
+        lock.unlock();
+        try {
+          read_brick (brick, data);
+        }
+        catch (...) {
+          lock.lock();
+          slot_of_brick[brick] = NO_SLOT;
+          cache[slot].brick = NO_SLOT;
+          cache[slot].loading = false;
+          loaded.notify_all();
+          throw;
+        }
+        lock.lock();
+        cache[slot].loading = false;
+        loaded.notify_all();
+      }
+      else if (slot != most_recent) {
+        unlink_slot (slot);
+        link_slot (slot);
+      }
+
+      Slot& entry (cache[slot]);
+      entry.dirty |= write;
+      return entry.data.get();
+    }
+
+
+
+    void Bricked::pin (size_t brick, bool write, BrickRef& ref)
+    {
+      if (ref.owner != this)
+        ref.release();
+      std::unique_lock<std::mutex> lock (mutex);
+      if (ref.owner) {
+        --cache[slot_of_brick[ref.brick]].pins;
+        ref.owner = nullptr;
+      }
+      ref.data = get_brick (brick, write, lock);
+      ++cache[slot_of_brick[brick]].pins;
+      ref.owner = this;
+      ref.brick = brick;
+      ref.writable = write;
+    }
+
+
+
+    void Bricked::unpin (BrickRef& ref)
+    {
+      std::lock_guard<std::mutex> lock (mutex);
+      --cache[slot_of_brick[ref.brick]].pins;
+      ref.owner = nullptr;
+    }
+
+
+
+    void Bricked::unlink_slot (size_t slot)
+    {
+      Slot& entry (cache[slot]);
+      if (entry.previous != NO_SLOT)
+        cache[entry.previous].next = entry.next;
+      else
+        most_recent = entry.next;
+      if (entry.next != NO_SLOT)
+        cache[entry.next].previous = entry.previous;
+      else
+        least_recent = entry.previous;
+    }
+
+
+
+    void Bricked::link_slot (size_t slot)
+    {
+      // insert at front of list:
+      Slot& entry (cache[slot]);
+      entry.previous = NO_SLOT;
+      entry.next = most_recent;
+      if (most_recent != NO_SLOT)
+        cache[most_recent].previous = slot;
+      most_recent = slot;
+      if (least_recent == NO_SLOT)
+        least_recent = slot;
+    }
+
+
+
+    void Bricked::flush ()
+    {
+      std::lock_guard<std::mutex> lock (mutex);
+      for (auto& entry : cache) {
+        if (entry.dirty) {
+          write_brick (entry.brick, entry.data.get());
+          entry.dirty = false;
+        }
+      }
+    }
+
+
+
+    size_t Bricked::find_axis (ssize_t stride) const
+    {
+      const size_t s = std::abs (stride);
+      for (size_t n = 0; n < dim.size(); ++n)
+        if (dim[n].stride == s && dim[n].size > 1)
+          return n;
+      throw Exception ("FIXME: invalid stride for access to bricked image");
+    }
+
+  }
+}
+
+
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __image_io_bricked_h__
+#define __image_io_bricked_h__
+
+#include <mutex>
+#include <condition_variable>
+
+#include "image_io/base.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+
+    //! handler for images stored out-of-core as a grid of fixed-size bricks
+    /*! The image is divided into bricks (by default 32x32x32 voxels, see the
+     * BrickSize config file entry), each of which is stored contiguously on
+     * file. Bricks are only loaded into RAM when accessed, and held in a
+     * least-recently-used cache of bounded size (see BrickCacheSize);
+     * modified bricks are written back to file when evicted from the cache,
+     * and when the image is closed. This allows images larger than the
+     * available RAM or address space to be processed.
+     *
+     * This handler is used for the MRtrix bricked format (.mib), and for
+     * large scratch images (see ScratchBrickThreshold), in which case the
+     * bricks are held in a temporary file.
+     *
+     * Bricked images cannot be accessed using direct IO: all access goes
+     * via access(), which is invoked by Image::Buffer as required. Bricks
+     * are defined along the axes of the image sorted by increasing stride,
+     * and their size along each axis is a power of two. Within each brick,
+     * voxels are also stored in order of increasing stride.
+     *
+     * Derived classes may instead store the image as contiguous chunks, each
+     * spanning the full extent of the image along all axes of smaller stride
+     * than its own (e.g. a slab of slices, or a number of volumes), in which
+     * case the voxels of each chunk are stored in the same order as in the
+     * image, and no padding is required (see ImageIO::Chunked). */
+    class Bricked : public Base
+    { NOMEMALIGN
+      public:
+        //! \a brick_size holds the size of the bricks along each image axis
+        Bricked (const Header& header, const vector<size_t>& brick_size);
+
+        virtual bool is_file_backed () const;
+
+        //! the brick size as set in the config file
+        static vector<size_t> default_brick_size ();
+        //! the actual brick size that will be used for an image with \a header
+        /*! This rounds the sizes requested up to a power of two, no larger
+         * than required to hold the image along each axis. */
+        static vector<size_t> actual_brick_size (const Header& header, const vector<size_t>& requested);
+        //! the amount of storage required for all bricks of the image
+        static int64_t footprint (const Header& header, const vector<size_t>& brick_size);
+        //! whether a scratch image of size \a bytes should be bricked
+        static bool use_for_scratch (int64_t bytes);
+
+        //! the brick size along each image axis
+        const vector<size_t>& brick_size () const { return bricks; }
+
+        //! a brick held in the cache on behalf of a single accessor
+        /*! While set, the brick cannot be evicted from the cache, so that
+         * successive accesses to voxels within it need not lock the cache.
+         * Each accessor (e.g. each per-thread copy of an Image) holds its
+         * own; copies are therefore initially empty. */
+        class BrickRef { NOMEMALIGN
+          public:
+            BrickRef () : owner (nullptr), brick (0), data (nullptr), writable (false) { }
+            BrickRef (const BrickRef&) : BrickRef () { }
+            BrickRef (BrickRef&& that) : owner (that.owner), brick (that.brick), data (that.data), writable (that.writable) { that.owner = nullptr; }
+            BrickRef& operator= (const BrickRef&) { release(); return *this; }
+            BrickRef& operator= (BrickRef&& that) {
+              release();
+              std::swap (owner, that.owner);
+              brick = that.brick;
+              data = that.data;
+              writable = that.writable;
+              return *this;
+            }
+            ~BrickRef () { release(); }
+
+            void release () {
+              if (owner)
+                owner->unpin (*this);
+            }
+
+          private:
+            Bricked* owner;
+            size_t brick;
+            uint8_t* data;
+            bool writable;
+            friend class Bricked;
+        };
+
+        //! invoke \a func (data, index) for the voxel at \a offset
+        /*! \a data points to the start of the brick containing the voxel,
+         * and \a index is the position of the voxel within it; \a offset is
+         * the offset of the voxel in the image as computed from its strides.
+         * The brick is retained in \a ref, such that the cache only needs to
+         * be locked when the next access falls within a different brick. */
+        template <class Functor>
+          void access (size_t offset, bool write, BrickRef& ref, Functor&& func) {
+            size_t index;
+            const size_t brick = locate (offset, index);
+            if (ref.owner != this || ref.brick != brick || (write && !ref.writable))
+              pin (brick, write, ref);
+            func (ref.data, index);
+          }
+
+        //! invoke \a func (data, index, stride, count) for the \a count voxels from \a offset separated by \a stride
+        /*! This splits the voxels specified into runs within the same brick,
+         * and invokes \a func for each run in turn, with the index and
+         * stride of the voxels within the brick. */
+        template <class Functor>
+          void access (size_t offset, ssize_t stride, size_t count, bool write, Functor&& func) {
+            const size_t axis = count > 1 ? find_axis (stride) : 0;
+            while (count) {
+              size_t index, n = 1;
+              ssize_t brick_stride = 0;
+              const size_t brick = locate (offset, index);
+              if (count > 1 && contiguous) {
+                brick_stride = stride;
+                n = std::min (count, stride > 0 ? (brick_voxels - 1 - index) / stride + 1 : index / (-stride) + 1);
+              }
+              else if (count > 1) {
+                const size_t pos = position (offset, axis) & (dim[axis].brick - 1);
+                brick_stride = ssize_t (1) << dim[axis].brick_shift;
+                if (stride > 0)
+                  n = std::min (count, dim[axis].brick - pos);
+                else {
+                  n = std::min (count, pos + 1);
+                  brick_stride = -brick_stride;
+                }
+              }
+              {
+                std::unique_lock<std::mutex> lock (mutex);
+                func (get_brick (brick, write, lock), index, brick_stride, n);
+              }
+              offset += n * stride;
+              count -= n;
+            }
+          }
+
+      protected:
+        //! for use by derived classes: if \a contiguous is set, \a brick_size is used as-is
+        Bricked (const Header& header, const vector<size_t>& brick_size, bool contiguous);
+
+        // layout of the image along each axis, in order of increasing stride:
+        struct Axis { NOMEMALIGN
+          size_t size, stride;                 // image size & stride (in voxels)
+          size_t brick, brick_log2;            // brick size, as a power of two
+          size_t brick_shift;                  // offset of this axis within the brick index (in bits)
+          size_t grid_stride;                  // stride of bricks along this axis
+        };
+
+        const vector<size_t> bricks;
+        const bool contiguous;
+        vector<Axis> dim;
+        size_t bits_per_voxel, brick_voxels, brick_bytes, num_bricks;
+        int fd;
+        bool temporary;
+
+        // cache of bricks, as a doubly-linked list in order of last access:
+        struct Slot { NOMEMALIGN
+          size_t brick, previous, next;
+          size_t pins;                         // number of BrickRefs holding this brick
+          bool dirty, loading;
+          std::unique_ptr<uint8_t[]> data;
+        };
+        std::mutex mutex;
+        std::condition_variable loaded;
+        vector<Slot> cache;
+        vector<size_t> slot_of_brick;
+        size_t cache_capacity, most_recent, least_recent;
+
+        virtual void load (const Header&, size_t);
+        virtual void unload (const Header&);
+
+        //! compute the layout of the bricks, and set up the cache
+        void init_layout (const Header& header);
+
+        //! read the contents of \a brick from storage into \a data
+        /*! This is invoked with the cache unlocked, so that several bricks
+         * can be read concurrently. */
+        virtual void read_brick (size_t brick, uint8_t* data);
+        //! write the contents of \a brick from \a data back to storage
+        virtual void write_brick (size_t brick, const uint8_t* data);
+
+        //! return the contents of \a brick, loading it into the cache if required
+        /*! \a lock must hold the cache mutex; it is released while the brick
+         * is read from storage. */
+        uint8_t* get_brick (size_t brick, bool write, std::unique_lock<std::mutex>& lock);
+        //! retain \a brick in \a ref, releasing any brick it previously held
+        void pin (size_t brick, bool write, BrickRef& ref);
+        void unpin (BrickRef& ref);
+        void unlink_slot (size_t slot);
+        void link_slot (size_t slot);
+        void flush ();
+
+        size_t find_axis (ssize_t stride) const;
+
+        size_t position (size_t offset, size_t axis) const {
+          offset /= dim[axis].stride;
+          return axis+1 < dim.size() ? offset % dim[axis].size : offset;
+        }
+
+        //! return the brick containing voxel at \a offset, and its \a index within the brick
+        size_t locate (size_t offset, size_t& index) const {
+          if (contiguous) {
+            index = offset % brick_voxels;
+            return offset / brick_voxels;
+          }
+          size_t brick = 0;
+          index = 0;
+          for (size_t n = 0; n < dim.size(); ++n) {
+            size_t pos = offset;
+            if (n+1 < dim.size()) {
+              pos = offset % dim[n].size;
+              offset /= dim[n].size;
+            }
+            brick += (pos >> dim[n].brick_log2) * dim[n].grid_stride;
+            index |= (pos & (dim[n].brick - 1)) << dim[n].brick_shift;
+          }
+          return brick;
+        }
+    };
+
+
+  }
+}
+
+#endif
+
+
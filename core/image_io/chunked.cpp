@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <atomic>
+#include <limits>
+
+#include "image_io/chunked.h"
+#include "header.h"
+#include "stride.h"
+#include "raw.h"
+#include "thread.h"
+#include "progressbar.h"
+#include "file/config.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+    namespace {
+
+      void read_all (int fd, uint8_t* data, size_t size, int64_t offset, const std::string& filename)
+      {
+        while (size) {
+          const ssize_t n = pread (fd, data, size, offset);
+          if (n <= 0)
+            throw Exception ("error reading from file \"" + filename + "\": " + ( n < 0 ? strerror (errno) : "unexpected end of file" ));
+          data += n;
+          offset += n;
+          size -= n;
+        }
+      }
+
+      void write_all (int fd, const uint8_t* data, size_t size, int64_t offset, const std::string& filename)
+      {
+        while (size) {
+          const ssize_t n = pwrite (fd, data, size, offset);
+          if (n <= 0)
+            throw Exception ("error writing to file \"" + filename + "\": " + strerror (errno));
+          data += n;
+          offset += n;
+          size -= n;
+        }
+      }
+
+    }
+
+
+
+    //CONF option: CompressedChunkSize
+    //CONF default: 1024
+    //CONF The approximate size (in kB, prior to compression) of the chunks
+    //CONF used to store images in the compressed MRtrix format (.mifz).
+    //CONF Chunks consist of whole rows, slices or volumes where possible.
+    //CONF Smaller chunks allow faster access to small parts of the image,
+    //CONF at the expense of slightly less effective compression.
+
+    vector<size_t> Chunked::default_chunk_size (const Header& header)
+    {
+      static const int64_t target_bits = std::max (int64_t (File::Config::get_int ("CompressedChunkSize", 1024)), int64_t (1)) << 13;
+
+      const auto order = Stride::order (Stride::get_actual (Stride::get (header), header));
+      vector<size_t> chunk_size (header.ndim(), 1);
+      int64_t bits = header.datatype().bits();
+      for (auto axis : order) {
+        if (bits * header.size (axis) > target_bits) {
+          chunk_size[axis] = std::max (target_bits / bits, int64_t (1));
+          break;
+        }
+        chunk_size[axis] = header.size (axis);
+        bits *= header.size (axis);
+      }
+      return chunk_size;
+    }
+
+
+
+    bool Chunked::is_valid_chunk_size (const Header& header, const vector<size_t>& chunk_size)
+    {
+      if (chunk_size.size() != header.ndim())
+        return false;
+      bool partial = false;
+      for (auto axis : Stride::order (Stride::get_actual (Stride::get (header), header))) {
+        if (chunk_size[axis] < 1 || ssize_t (chunk_size[axis]) > header.size (axis))
+          return false;
+        if (partial && chunk_size[axis] != 1)
+          return false;
+        if (ssize_t (chunk_size[axis]) < header.size (axis))
+          partial = true;
+      }
+      return true;
+    }
+
+
+
+
+    Chunked::Chunked (const Header& header, const vector<size_t>& chunk_size) :
+      Bricked (header, chunk_size, true),
+      bytes_per_voxel (0),
+      data_start (0) { }
+
+
+
+    void Chunked::load (const Header& header, size_t)
+    {
+      if (files.size() != 1)
+        throw Exception ("compressed chunked images must be stored in a single file");
+
+      init_layout (header);
+      bytes_per_voxel = header.datatype().bytes();
+      data_start = files[0].start + (num_bricks+1) * sizeof (uint64_t);
+
+      DEBUG ("opening compressed image \"" + header.name() + "\" with chunk size " + str(bricks)
+          + " (" + str(num_bricks) + " chunks of " + str(brick_bytes) + " bytes)");
+
+      fd = ::open (files[0].name.c_str(), ( writable || is_new ) ? O_RDWR : O_RDONLY);
+      if (fd < 0)
+        throw Exception ("error opening file \"" + files[0].name + "\": " + strerror (errno));
+
+      if (!is_new) {
+        vector<uint8_t> index ((num_bricks+1) * sizeof (uint64_t));
+        read_all (fd, index.data(), index.size(), files[0].start, files[0].name);
+        chunk_offsets.resize (num_bricks+1);
+        for (size_t n = 0; n <= num_bricks; ++n)
+          chunk_offsets[n] = Raw::fetch_LE<uint64_t> (index.data(), n);
+
+        struct stat info;
+        if (fstat (fd, &info))
+          throw Exception ("error querying file \"" + files[0].name + "\": " + strerror (errno));
+        if (chunk_offsets[0] != 0 || data_start + chunk_offsets[num_bricks] > info.st_size)
+          throw Exception ("invalid chunk index in compressed image \"" + header.name() + "\"");
+        for (size_t n = 0; n < num_bricks; ++n)
+          if (chunk_offsets[n+1] < chunk_offsets[n])
+            throw Exception ("invalid chunk index in compressed image \"" + header.name() + "\"");
+      }
+
+      // new or modified images can only be compressed once complete, so
+      // their chunks must never be evicted from the cache (see write_brick()):
+      if (writable || is_new)
+        cache_capacity = std::numeric_limits<size_t>::max();
+
+      addresses.resize (1);
+    }
+
+
+
+
+    class Chunked::Compressor { NOMEMALIGN
+      public:
+        Compressor (Chunked& parent, vector<vector<uint8_t>>& compressed, std::atomic<size_t>& next) :
+          parent (parent), compressed (compressed), next (next) { }
+
+        void execute () {
+          size_t n;
+          while ((n = next++) < compressed.size()) {
+            std::unique_lock<std::mutex> lock (parent.mutex);
+            if (!parent.is_new && !parent.is_modified (n)) {
+              // unmodified chunks are copied as-is from the existing file:
+              lock.unlock();
+              compressed[n].resize (parent.chunk_offsets[n+1] - parent.chunk_offsets[n]);
+              read_all (parent.fd, compressed[n].data(), compressed[n].size(), parent.data_start + parent.chunk_offsets[n], parent.files[0].name);
+              continue;
+            }
+            const uint8_t* data = parent.get_brick (n, false, lock);
+            lock.unlock();
+            parent.compress (data, compressed[n]);
+          }
+        }
+
+      protected:
+        Chunked& parent;
+        vector<vector<uint8_t>>& compressed;
+        std::atomic<size_t>& next;
+    };
+
+
+
+    void Chunked::unload (const Header& header)
+    {
+      if (fd < 0)
+        return;
+
+      // images opened read-write need only be rewritten if modified:
+      bool modified = is_new;
+      for (const auto& entry : cache)
+        modified |= entry.dirty;
+
+      if (modified) {
+        vector<vector<uint8_t>> compressed (num_bricks);
+        {
+          ProgressBar progress ("compressing image \"" + shorten (header.name()) + "\"");
+          std::atomic<size_t> next (0);
+          Compressor compressor (*this, compressed, next);
+          auto threads = Thread::run (Thread::multi (compressor), "compression threads");
+          threads.wait();
+        }
+        write_file (compressed);
+        for (auto& entry : cache)
+          entry.dirty = false;
+      }
+
+      Bricked::unload (header);
+    }
+
+
+
+
+    bool Chunked::is_modified (size_t chunk) const
+    {
+      const size_t slot = slot_of_brick[chunk];
+      return slot < cache.size() && cache[slot].dirty;
+    }
+
+
+
+
+    void Chunked::write_file (const vector<vector<uint8_t>>& compressed)
+    {
+      vector<uint8_t> index ((num_bricks+1) * sizeof (uint64_t));
+      int64_t offset = 0;
+      for (size_t n = 0; n < num_bricks; ++n) {
+        Raw::store_LE<uint64_t> (offset, index.data(), n);
+        offset += compressed[n].size();
+      }
+      Raw::store_LE<uint64_t> (offset, index.data(), num_bricks);
+      write_all (fd, index.data(), index.size(), files[0].start, files[0].name);
+
+      offset = data_start;
+      for (const auto& chunk : compressed) {
+        write_all (fd, chunk.data(), chunk.size(), offset, files[0].name);
+        offset += chunk.size();
+      }
+      if (ftruncate (fd, offset))
+        throw Exception ("error resizing file \"" + files[0].name + "\": " + strerror (errno));
+    }
+
+
+
+
+    //CONF option: CompressionLevel
+    //CONF default: 1
+    //CONF The zlib compression level (1 to 9) used to store images in the
+    //CONF compressed MRtrix format (.mifz). Higher levels produce slightly
+    //CONF smaller files, but take substantially longer to write.
+
+    void Chunked::compress (const uint8_t* data, vector<uint8_t>& compressed) const
+    {
+      static const int level = std::min (std::max (File::Config::get_int ("CompressionLevel", 1), 1), 9);
+
+      vector<uint8_t> shuffled;
+      if (bytes_per_voxel > 1) {
+        shuffled.resize (brick_bytes);
+        for (size_t i = 0; i < brick_voxels; ++i)
+          for (size_t b = 0; b < bytes_per_voxel; ++b)
+            shuffled[b*brick_voxels + i] = data[i*bytes_per_voxel + b];
+        data = shuffled.data();
+      }
+
+      uLongf size = compressBound (brick_bytes);
+      compressed.resize (size);
+      if (compress2 (compressed.data(), &size, data, brick_bytes, level) != Z_OK)
+        throw Exception ("error compressing data for file \"" + files[0].name + "\"");
+      compressed.resize (size);
+    }
+
+
+
+
+    void Chunked::read_brick (size_t brick, uint8_t* data)
+    {
+      if (chunk_offsets.empty()) { // new image
+        memset (data, 0, brick_bytes);
+        return;
+      }
+
+      vector<uint8_t> compressed (chunk_offsets[brick+1] - chunk_offsets[brick]);
+      read_all (fd, compressed.data(), compressed.size(), data_start + chunk_offsets[brick], files[0].name);
+
+      vector<uint8_t> shuffled (bytes_per_voxel > 1 ? brick_bytes : 0);
+      uLongf size = brick_bytes;
+      if (uncompress (bytes_per_voxel > 1 ? shuffled.data() : data, &size, compressed.data(), compressed.size()) != Z_OK || size != brick_bytes)
+        throw Exception ("error uncompressing chunk " + str(brick) + " from file \"" + files[0].name + "\"");
+
+      if (bytes_per_voxel > 1) {
+        for (size_t i = 0; i < brick_voxels; ++i)
+          for (size_t b = 0; b < bytes_per_voxel; ++b)
+            data[i*bytes_per_voxel + b] = shuffled[b*brick_voxels + i];
+      }
+    }
+
+
+
+    void Chunked::write_brick (size_t brick, const uint8_t*)
+    {
+      // chunks are only ever written as a whole in unload(), and since the
+      // cache capacity of new or writable images is unlimited (see load()),
+      // modified chunks are never evicted; the Compressor also relies on
+      // this, since it accesses the chunks with the cache unlocked:
+      assert (0);
+      throw Exception ("chunk " + str(brick) + " of compressed image \"" + files[0].name + "\" cannot be written individually");
+    }
+
+
+  }
+}
+
+
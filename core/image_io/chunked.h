@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __image_io_chunked_h__
+#define __image_io_chunked_h__
+
+#include "image_io/bricked.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+
+    //! handler for images stored as independently compressed chunks
+    /*! The image is divided into contiguous chunks (e.g. a slab of slices,
+     * or a number of volumes, see the CompressedChunkSize config file
+     * entry), each of which is compressed independently using zlib. For
+     * datatypes larger than one byte, the bytes of each chunk are shuffled
+     * prior to compression (i.e. all first bytes, then all second bytes,
+     * etc.), which substantially improves the compression of floating-point
+     * data.
+     *
+     * On file, the data consist of an index of the chunks, as (number of
+     * chunks + 1) little-endian 64-bit offsets relative to the end of the
+     * index, followed by the compressed chunks themselves.
+     *
+     * Existing images are read lazily: chunks are only decompressed when
+     * accessed, and held in the brick cache (see ImageIO::Bricked); since
+     * chunks are decompressed with the cache unlocked, multi-threaded
+     * access decompresses several chunks concurrently. New or writable
+     * images are held entirely in RAM, and compressed using multiple
+     * threads when the image is closed; for existing images, only the
+     * chunks that were modified are compressed again, and the file is left
+     * untouched if none were. */
+    class Chunked : public Bricked
+    { NOMEMALIGN
+      public:
+        //! \a chunk_size holds the size of the chunks along each image axis
+        Chunked (const Header& header, const vector<size_t>& chunk_size);
+
+        //! the chunk size to use for an image with \a header, as set in the config file
+        static vector<size_t> default_chunk_size (const Header& header);
+        //! whether \a chunk_size describes contiguous chunks for an image with \a header
+        static bool is_valid_chunk_size (const Header& header, const vector<size_t>& chunk_size);
+
+      protected:
+        size_t bytes_per_voxel;
+        int64_t data_start;
+        vector<int64_t> chunk_offsets;
+
+        virtual void load (const Header&, size_t);
+        virtual void unload (const Header&);
+
+        virtual void read_brick (size_t brick, uint8_t* data);
+        virtual void write_brick (size_t brick, const uint8_t* data);
+
+        void compress (const uint8_t* data, vector<uint8_t>& compressed) const;
+        //! whether \a chunk has been modified since it was loaded
+        /*! This must be invoked with the cache locked. */
+        bool is_modified (size_t chunk) const;
+        void write_file (const vector<vector<uint8_t>>& compressed);
+
+        class Compressor;
+    };
+
+
+  }
+}
+
+#endif
+
+
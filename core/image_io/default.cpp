@@ -19,6 +19,7 @@
 #include "header.h"
 #include "file/ofstream.h"
 #include "image_io/default.h"
+#include "image_io/segments.h"
 
 namespace MR
 {
@@ -99,10 +100,11 @@ namespace MR
 
       if (is_new) memset (addresses[0].get(), 0, files.size() * bytes_per_segment);
       else {
-        for (size_t n = 0; n < files.size(); n++) {
-          File::MMap file (files[n], false, false, bytes_per_segment);
-          memcpy (addresses[0].get() + n*bytes_per_segment, file.address(), bytes_per_segment);
-        }
+        uint8_t* data = addresses[0].get();
+        const int64_t bytes = bytes_per_segment;
+        read_segments (files, bytes, [data,bytes] (size_t n, const uint8_t* address) {
+            memcpy (data + n*bytes, address, bytes);
+            });
       }
 
       if (addresses.size() > 1)
@@ -14,6 +14,7 @@
 
 
 #include "image_io/fetch_store.h"
+#include "math/kernels.h"
 
 namespace MR
 {
@@ -134,6 +135,110 @@ namespace MR
       }
 
 
+
+
+    // for rows of values:
+
+    // contiguous values in native byte order can be converted using the
+    // vectorised kernels, where these exist for the types involved:
+    template <typename RAMType, typename DiskType>
+      inline auto __convert_kernel (const DiskType* in, size_t count, RAMType* out, default_type offset, default_type scale, int) 
+      -> decltype (Math::Kernels::convert (count, in, out, offset, scale), bool()) {
+        Math::Kernels::convert (count, in, out, offset, scale);
+        return true;
+      }
+
+    template <typename RAMType, typename DiskType>
+      inline bool __convert_kernel (const DiskType*, size_t, RAMType*, default_type, default_type, long) {
+        return false;
+      }
+
+    // ... or copied directly if no conversion is required:
+    template <typename RAMType, typename DiskType>
+      inline bool __fetch_contiguous (const DiskType* in, size_t count, RAMType* out, default_type offset, default_type scale) {
+        if (std::is_same<RAMType,DiskType>::value && offset == 0.0 && scale == 1.0) {
+          memcpy (out, in, count*sizeof(DiskType));
+          return true;
+        }
+        return __convert_kernel (in, count, out, offset, scale, 0);
+      }
+
+    template <typename RAMType, typename DiskType>
+      inline bool __store_contiguous (const RAMType* in, size_t count, DiskType* out, default_type offset, default_type scale) {
+        if (std::is_same<RAMType,DiskType>::value && offset == 0.0 && scale == 1.0) {
+          memcpy (out, in, count*sizeof(DiskType));
+          return true;
+        }
+        return false;
+      }
+
+    // single-bit values are never contiguous in memory:
+    template <typename DiskType>
+      constexpr bool __is_addressable () { return !std::is_same<DiskType,bool>::value; }
+
+
+
+    // for single-byte types:
+
+    template <typename RAMType, typename DiskType> 
+      void __fetch_row (const void* data, size_t i, ssize_t stride, size_t count, RAMType* values, default_type offset, default_type scale) {
+        if (__is_addressable<DiskType>() && stride == 1 && 
+            __fetch_contiguous (reinterpret_cast<const DiskType*> (data) + i, count, values, offset, scale))
+          return;
+        for (size_t n = 0; n < count; ++n, i += stride)
+          values[n] = __fetch<RAMType,DiskType> (data, i, offset, scale);
+      }
+
+    template <typename RAMType, typename DiskType> 
+      void __store_row (const RAMType* values, void* data, size_t i, ssize_t stride, size_t count, default_type offset, default_type scale) {
+        if (__is_addressable<DiskType>() && stride == 1 && 
+            __store_contiguous (values, count, reinterpret_cast<DiskType*> (data) + i, offset, scale))
+          return;
+        for (size_t n = 0; n < count; ++n, i += stride)
+          __store<RAMType,DiskType> (values[n], data, i, offset, scale);
+      }
+
+    // for little-endian multi-byte types:
+
+    template <typename RAMType, typename DiskType> 
+      void __fetch_row_LE (const void* data, size_t i, ssize_t stride, size_t count, RAMType* values, default_type offset, default_type scale) {
+        if (!MRTRIX_IS_BIG_ENDIAN && stride == 1 && 
+            __fetch_contiguous (reinterpret_cast<const DiskType*> (data) + i, count, values, offset, scale))
+          return;
+        for (size_t n = 0; n < count; ++n, i += stride)
+          values[n] = __fetch_LE<RAMType,DiskType> (data, i, offset, scale);
+      }
+
+    template <typename RAMType, typename DiskType> 
+      void __store_row_LE (const RAMType* values, void* data, size_t i, ssize_t stride, size_t count, default_type offset, default_type scale) {
+        if (!MRTRIX_IS_BIG_ENDIAN && stride == 1 && 
+            __store_contiguous (values, count, reinterpret_cast<DiskType*> (data) + i, offset, scale))
+          return;
+        for (size_t n = 0; n < count; ++n, i += stride)
+          __store_LE<RAMType,DiskType> (values[n], data, i, offset, scale);
+      }
+
+    // for big-endian multi-byte types:
+
+    template <typename RAMType, typename DiskType> 
+      void __fetch_row_BE (const void* data, size_t i, ssize_t stride, size_t count, RAMType* values, default_type offset, default_type scale) {
+        if (MRTRIX_IS_BIG_ENDIAN && stride == 1 && 
+            __fetch_contiguous (reinterpret_cast<const DiskType*> (data) + i, count, values, offset, scale))
+          return;
+        for (size_t n = 0; n < count; ++n, i += stride)
+          values[n] = __fetch_BE<RAMType,DiskType> (data, i, offset, scale);
+      }
+
+    template <typename RAMType, typename DiskType> 
+      void __store_row_BE (const RAMType* values, void* data, size_t i, ssize_t stride, size_t count, default_type offset, default_type scale) {
+        if (MRTRIX_IS_BIG_ENDIAN && stride == 1 && 
+            __store_contiguous (values, count, reinterpret_cast<DiskType*> (data) + i, offset, scale))
+          return;
+        for (size_t n = 0; n < count; ++n, i += stride)
+          __store_BE<RAMType,DiskType> (values[n], data, i, offset, scale);
+      }
+
+
   }
 
 
@@ -244,6 +349,110 @@ namespace MR
       }
     }
 
+  template <typename ValueType>
+    typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_row_functions (
+        std::function<void(const void*,size_t,ssize_t,size_t,ValueType*,default_type,default_type)>& fetch_row_func,
+        std::function<void(const ValueType*,void*,size_t,ssize_t,size_t,default_type,default_type)>& store_row_func, 
+        DataType datatype) {
+
+      switch (datatype()) {
+        case DataType::Bit:
+          fetch_row_func = __fetch_row<ValueType,bool>;
+          store_row_func = __store_row<ValueType,bool>;
+          return;
+        case DataType::Int8:
+          fetch_row_func = __fetch_row<ValueType,int8_t>;
+          store_row_func = __store_row<ValueType,int8_t>;
+          return;
+        case DataType::UInt8:
+          fetch_row_func = __fetch_row<ValueType,uint8_t>;
+          store_row_func = __store_row<ValueType,uint8_t>;
+          return;
+        case DataType::Int16LE:
+          fetch_row_func = __fetch_row_LE<ValueType,int16_t>;
+          store_row_func = __store_row_LE<ValueType,int16_t>;
+          return;
+        case DataType::UInt16LE:
+          fetch_row_func = __fetch_row_LE<ValueType,uint16_t>;
+          store_row_func = __store_row_LE<ValueType,uint16_t>;
+          return;
+        case DataType::Int16BE:
+          fetch_row_func = __fetch_row_BE<ValueType,int16_t>;
+          store_row_func = __store_row_BE<ValueType,int16_t>;
+          return;
+        case DataType::UInt16BE:
+          fetch_row_func = __fetch_row_BE<ValueType,uint16_t>;
+          store_row_func = __store_row_BE<ValueType,uint16_t>;
+          return;
+        case DataType::Int32LE:
+          fetch_row_func = __fetch_row_LE<ValueType,int32_t>;
+          store_row_func = __store_row_LE<ValueType,int32_t>;
+          return;
+        case DataType::UInt32LE:
+          fetch_row_func = __fetch_row_LE<ValueType,uint32_t>;
+          store_row_func = __store_row_LE<ValueType,uint32_t>;
+          return;
+        case DataType::Int32BE:
+          fetch_row_func = __fetch_row_BE<ValueType,int32_t>;
+          store_row_func = __store_row_BE<ValueType,int32_t>;
+          return;
+        case DataType::UInt32BE:
+          fetch_row_func = __fetch_row_BE<ValueType,uint32_t>;
+          store_row_func = __store_row_BE<ValueType,uint32_t>;
+          return;
+        case DataType::Int64LE:
+          fetch_row_func = __fetch_row_LE<ValueType,int64_t>;
+          store_row_func = __store_row_LE<ValueType,int64_t>;
+          return;
+        case DataType::UInt64LE:
+          fetch_row_func = __fetch_row_LE<ValueType,uint64_t>;
+          store_row_func = __store_row_LE<ValueType,uint64_t>;
+          return;
+        case DataType::Int64BE:
+          fetch_row_func = __fetch_row_BE<ValueType,int64_t>;
+          store_row_func = __store_row_BE<ValueType,int64_t>;
+          return;
+        case DataType::UInt64BE:
+          fetch_row_func = __fetch_row_BE<ValueType,uint64_t>;
+          store_row_func = __store_row_BE<ValueType,uint64_t>;
+          return;
+        case DataType::Float32LE:
+          fetch_row_func = __fetch_row_LE<ValueType,float>;
+          store_row_func = __store_row_LE<ValueType,float>;
+          return;
+        case DataType::Float32BE:
+          fetch_row_func = __fetch_row_BE<ValueType,float>;
+          store_row_func = __store_row_BE<ValueType,float>;
+          return;
+        case DataType::Float64LE:
+          fetch_row_func = __fetch_row_LE<ValueType,double>;
+          store_row_func = __store_row_LE<ValueType,double>;
+          return;
+        case DataType::Float64BE:
+          fetch_row_func = __fetch_row_BE<ValueType,double>;
+          store_row_func = __store_row_BE<ValueType,double>;
+          return;
+        case DataType::CFloat32LE:
+          fetch_row_func = __fetch_row_LE<ValueType,cfloat>;
+          store_row_func = __store_row_LE<ValueType,cfloat>;
+          return;
+        case DataType::CFloat32BE:
+          fetch_row_func = __fetch_row_BE<ValueType,cfloat>;
+          store_row_func = __store_row_BE<ValueType,cfloat>;
+          return;
+        case DataType::CFloat64LE:
+          fetch_row_func = __fetch_row_LE<ValueType,cdouble>;
+          store_row_func = __store_row_LE<ValueType,cdouble>;
+          return;
+        case DataType::CFloat64BE:
+          fetch_row_func = __fetch_row_BE<ValueType,cdouble>;
+          store_row_func = __store_row_BE<ValueType,cdouble>;
+          return;
+        default:
+          throw Exception ("invalid data type in image header");
+      }
+    }
+
 #undef MRTRIX_EXTERN
 #define MRTRIX_EXTERN
   __DEFINE_FETCH_STORE_FUNCTIONS;
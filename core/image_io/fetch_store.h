@@ -38,12 +38,36 @@ namespace MR
         DataType datatype);
 
 
+  template <typename ValueType>
+    typename std::enable_if<!is_data_type<ValueType>::value, void>::type __set_fetch_store_row_functions (
+        std::function<void(const void*,size_t,ssize_t,size_t,ValueType*,default_type,default_type)>& /*fetch_row_func*/,
+        std::function<void(const ValueType*,void*,size_t,ssize_t,size_t,default_type,default_type)>& /*store_row_func*/,
+        DataType /*datatype*/) { }
+
+
+
+  //! set functions to convert rows of values to & from storage
+  /*! These convert \a count values at once, starting at index \a i and
+   * separated by \a stride, using vectorised kernels where possible. This
+   * avoids the overhead of invoking the per-voxel functions for bulk
+   * access, as used when copying images. */
+  template <typename ValueType>
+    typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_row_functions (
+        std::function<void(const void*,size_t,ssize_t,size_t,ValueType*,default_type,default_type)>& fetch_row_func,
+        std::function<void(const ValueType*,void*,size_t,ssize_t,size_t,default_type,default_type)>& store_row_func,
+        DataType datatype);
+
+
   // define fetch/store methods for all types using C++11 extern templates, 
   // to avoid massive recompile times...
 #define __DEFINE_FETCH_STORE_FUNCTION_FOR_TYPE(ValueType) \
   MRTRIX_EXTERN template void __set_fetch_store_functions<ValueType> ( \
       std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func, \
         std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func, \
+        DataType datatype); \
+  MRTRIX_EXTERN template void __set_fetch_store_row_functions<ValueType> ( \
+      std::function<void(const void*,size_t,ssize_t,size_t,ValueType*,default_type,default_type)>& fetch_row_func, \
+        std::function<void(const ValueType*,void*,size_t,ssize_t,size_t,default_type,default_type)>& store_row_func, \
         DataType datatype) 
 
 #define __DEFINE_FETCH_STORE_FUNCTIONS \
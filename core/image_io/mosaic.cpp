@@ -16,9 +16,9 @@
 #include <limits>
 
 #include "app.h"
-#include "progressbar.h"
 #include "header.h"
 #include "image_io/mosaic.h"
+#include "image_io/segments.h"
 
 namespace MR
 {
@@ -43,26 +43,20 @@ namespace MR
       if (!addresses[0])
         throw Exception ("failed to allocate memory for image \"" + header.name() + "\"");
 
-      ProgressBar progress ("reformatting DICOM mosaic images", slices*files.size());
+      const size_t bytes = header.datatype().bytes();
+      const size_t tiles_per_row = m_xdim / xdim;
       uint8_t* data = addresses[0].get();
-      for (size_t n = 0; n < files.size(); n++) {
-        File::MMap file (files[n], false, false, m_xdim * m_ydim * header.datatype().bytes());
-        size_t nx = 0, ny = 0;
-        for (size_t z = 0; z < slices; z++) {
-          size_t ox = nx*xdim;
-          size_t oy = ny*ydim;
-          for (size_t y = 0; y < ydim; y++) {
-            memcpy (data, file.address() + header.datatype().bytes() * (ox + m_xdim* (y+oy)), xdim * header.datatype().bytes());
-            data += xdim * header.datatype().bytes();
+      read_segments (files, m_xdim * m_ydim * bytes, [&] (size_t n, const uint8_t* address) {
+          uint8_t* out = data + n * bytes_per_segment;
+          for (size_t z = 0; z < slices; z++) {
+            const size_t ox = (z % tiles_per_row) * xdim;
+            const size_t oy = (z / tiles_per_row) * ydim;
+            for (size_t y = 0; y < ydim; y++) {
+              memcpy (out, address + bytes * (ox + m_xdim * (y+oy)), xdim * bytes);
+              out += xdim * bytes;
+            }
           }
-          nx++;
-          if (nx >= m_xdim / xdim) {
-            nx = 0;
-            ny++;
-          }
-          ++progress;
-        }
-      }
+          }, "reformatting DICOM mosaic images");
 
       segsize = std::numeric_limits<size_t>::max();
     }
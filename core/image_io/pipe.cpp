@@ -14,17 +14,92 @@
 
 
 #include <limits>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
 #include <unistd.h>
 
+#include "app.h"
 #include "signal_handler.h"
 #include "header.h"
 #include "image_io/pipe.h"
+#include "file/config.h"
+#include "file/path.h"
+#include "file/utils.h"
+
+// when data are not yet available, wait for this fraction of the image
+// to be written ahead of the voxels requested:
+#define PIPE_STREAMING_LOOKAHEAD 64
 
 namespace MR
 {
   namespace ImageIO
   {
 
+    namespace {
+      const char control_magic[8] = { 'm', 'r', 's', 't', 'r', 'e', 'a', 'm' };
+
+      inline std::string control_file (const std::string& image_file)
+      {
+        return image_file + ".stream";
+      }
+    }
+
+
+
+    // layout of the control file shared between the two ends of a streamed
+    // pipe; this is followed by one flag per voxel:
+    class Pipe::Control { NOMEMALIGN
+      public:
+        enum : uint32_t { writing = 1, done = 2, failed = 3 };
+
+        char magic[8];
+        int64_t pid;
+        uint64_t num_voxels;
+        std::atomic<uint32_t> state;
+        uint32_t padding;
+
+        static size_t size (size_t num_voxels) {
+          return sizeof (Control) + num_voxels;
+        }
+    };
+
+#if ATOMIC_INT_LOCK_FREE != 2 || ATOMIC_CHAR_LOCK_FREE != 2
+# error streaming of piped images requires lock-free atomics
+#endif
+
+
+
+
+    //CONF option: PipeStreaming
+    //CONF default: 0 (false)
+    //CONF Send the name of each image piped to the next command as soon as
+    //CONF it has been created, rather than once it has been fully written, so
+    //CONF that the commands of a pipeline can run concurrently. Commands that
+    //CONF read images in bulk (e.g. mrconvert) can then process each voxel as
+    //CONF soon as it has been written; others will wait until the previous
+    //CONF command has completed its output. Only commands that write each
+    //CONF voxel of their output once (e.g. mrconvert, mrcalc) stream their
+    //CONF output; others pass it on once complete, as usual. This has no
+    //CONF effect if the temporary directory resides on a networked
+    //CONF filesystem. Can also be set using the environment variable
+    //CONF MRTRIX_PIPE_STREAMING.
+
+    bool Pipe::streaming ()
+    {
+      static const bool enabled = [] {
+        const char* from_env = getenv ("MRTRIX_PIPE_STREAMING");
+        if (from_env)
+          return to<bool> (from_env);
+        return File::Config::get_bool ("PipeStreaming", false);
+      }();
+      return enabled;
+    }
+
+
+
 
     void Pipe::load (const Header& header, size_t)
     {
@@ -40,6 +115,17 @@ namespace MR
       mmap.reset (new File::MMap (files[0], writable, !is_new, bytes_per_segment));
       addresses.resize (1);
       addresses[0].reset (mmap->address());
+
+      if (is_new) {
+        // a voxel is released to the next command as soon as it has been
+        // written, so this is only safe if it is never written again; data
+        // are also only visible to the next command on completion if not
+        // mapped as-is:
+        if (streaming() && App::WRITE_ONCE_OUTPUT && mmap->is_mapped())
+          start_streaming();
+      }
+      else
+        open_stream();
     }
 
 
@@ -47,17 +133,178 @@ namespace MR
     {
       if (mmap) {
         mmap.reset();
-        if (is_new)
-          std::cout << files[0].name << "\n";
+        if (is_new) {
+          if (control)
+            finish_streaming();
+          else
+            std::cout << files[0].name << "\n";
+        }
         addresses[0].release();
       }
 
+      control = nullptr;
+      written = nullptr;
+      control_mmap.reset();
+
       if (!is_new && files.size() == 1) {
         DEBUG ("deleting piped image file \"" + files[0].name + "\"...");
         unlink (files[0].name.c_str());
         SignalHandler::unmark_file_for_deletion (files[0].name);
+        const std::string control_name = control_file (files[0].name);
+        if (Path::exists (control_name)) {
+          unlink (control_name.c_str());
+          SignalHandler::unmark_file_for_deletion (control_name);
+        }
+      }
+
+    }
+
+
+
+
+
+    void Pipe::start_streaming ()
+    {
+      const std::string control_name = control_file (files[0].name);
+      DEBUG ("streaming piped image \"" + files[0].name + "\" via control file \"" + control_name + "\"");
+
+      File::create (control_name, Control::size (segsize));
+      SignalHandler::mark_file_for_deletion (control_name);
+      control_mmap.reset (new File::MMap (control_name, true, false));
+      control = reinterpret_cast<Control*> (control_mmap->address());
+      written = reinterpret_cast<std::atomic<uint8_t>*> (control_mmap->address() + sizeof (Control));
+
+      memcpy (control->magic, control_magic, sizeof (control_magic));
+      control->pid = getpid();
+      control->num_voxels = segsize;
+      control->state.store (Control::writing, std::memory_order_release);
+
+      // let the next command start right away:
+      std::cout << files[0].name << std::endl;
+    }
+
+
+
+    void Pipe::open_stream ()
+    {
+      const std::string control_name = control_file (files[0].name);
+      if (!Path::exists (control_name))
+        return;
+
+      SignalHandler::mark_file_for_deletion (control_name);
+      control_mmap.reset (new File::MMap (control_name));
+      if (control_mmap->size() < int64_t (Control::size (segsize)))
+        throw Exception ("control file for streamed image \"" + files[0].name + "\" is truncated");
+      control = reinterpret_cast<Control*> (control_mmap->address());
+      written = reinterpret_cast<std::atomic<uint8_t>*> (control_mmap->address() + sizeof (Control));
+
+      if (memcmp (control->magic, control_magic, sizeof (control_magic)) || control->num_voxels != segsize)
+        throw Exception ("invalid control file for streamed image \"" + files[0].name + "\"");
+
+      complete = control->state.load (std::memory_order_acquire) == Control::done;
+      DEBUG ("reading streamed image \"" + files[0].name + "\"" + ( complete ? " (already complete)" : "" ));
+    }
+
+
+
+    void Pipe::finish_streaming ()
+    {
+      // don't let the next command process incomplete data:
+      const bool failed = std::uncaught_exception();
+      control->state.store (failed ? Control::failed : Control::done, std::memory_order_release);
+    }
+
+
+
+
+
+    // each voxel is flagged as soon as it has been written, so that the
+    // reading command never accesses a voxel before it has been written,
+    // in whatever order the voxels are written; since the voxel can then be
+    // read straight away, it must not be written again (see load()):
+    void Pipe::data_written (size_t offset, ssize_t stride, size_t count)
+    {
+      for (size_t n = 0; n < count; ++n, offset += stride)
+        written[offset].store (1, std::memory_order_release);
+    }
+
+
+
+    void Pipe::wait_for_data (size_t offset, ssize_t stride, size_t count) const
+    {
+      if (complete || !count)
+        return;
+
+      if (stride == 1 || stride == -1) {
+        size_t first = stride > 0 ? offset : offset - (count-1);
+        if (num_written (first, count) < count) {
+          // rather than resuming as soon as these voxels have been written,
+          // wait for the writing command to get some way ahead, to avoid
+          // switching between the two commands too frequently:
+          const size_t lookahead = std::max<size_t> (segsize / PIPE_STREAMING_LOOKAHEAD, 1);
+          if (stride > 0)
+            count = std::min (segsize - first, count + lookahead);
+          else {
+            const size_t extra = std::min (first, lookahead);
+            first -= extra;
+            count += extra;
+          }
+          wait_until_written (first, count);
+        }
+        if (first == 0 && count == segsize)
+          complete = true;
+      }
+      else {
+        for (size_t n = 0; n < count; ++n, offset += stride)
+          wait_until_written (offset, 1);
       }
+    }
+
+
+
+
 
+    // the number of contiguous voxels from \a offset (up to \a count) that
+    // have been written:
+    size_t Pipe::num_written (size_t offset, size_t count) const
+    {
+      for (size_t n = 0; n < count; ++n) {
+        if (!written[offset+n].load (std::memory_order_acquire))
+          return n;
+      }
+      return count;
+    }
+
+
+
+    void Pipe::wait_until_written (size_t offset, size_t count) const
+    {
+      std::chrono::microseconds delay (50);
+      while (true) {
+        // only check voxels not already known to have been written:
+        const size_t n = num_written (offset, count);
+        offset += n;
+        count -= n;
+        if (!count)
+          return;
+
+        const auto state = control->state.load (std::memory_order_acquire);
+        if (state == Control::done) {
+          // voxels never written by the producer are only available now:
+          complete = true;
+          return;
+        }
+        if (state == Control::failed)
+          throw Exception ("command writing piped image \"" + files[0].name + "\" failed");
+#ifndef MRTRIX_WINDOWS
+        // check the state again once the producer is known to have terminated,
+        // since it may have completed the data just before exiting:
+        if (kill (control->pid, 0) && errno == ESRCH && control->state.load (std::memory_order_acquire) != Control::done)
+          throw Exception ("command writing piped image \"" + files[0].name + "\" terminated before completing it");
+#endif
+        std::this_thread::sleep_for (delay);
+        delay = std::min (2*delay, std::chrono::microseconds (10000));
+      }
     }
 
   }
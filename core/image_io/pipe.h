@@ -16,6 +16,8 @@
 #ifndef __image_io_pipe_h__
 #define __image_io_pipe_h__
 
+#include <atomic>
+
 #include "memory.h"
 #include "image_io/base.h"
 #include "file/mmap.h"
@@ -25,16 +27,55 @@ namespace MR
   namespace ImageIO
   {
 
+    //! handler for images passed between commands via a Unix pipe
+    /*! The image is written to a temporary file, the name of which is sent
+     * to the next command in the pipeline via standard output. By default,
+     * the name is only sent once the image has been closed. If streaming is
+     * enabled (see the PipeStreaming config file entry), and the command
+     * writes each voxel only once (see App::WRITE_ONCE_OUTPUT), the name is
+     * sent as soon as the image has been created, and each voxel written by the
+     * writing command is flagged in a shared control file, so that the
+     * reading command can access each voxel as soon as it is available. */
     class Pipe : public Base
     { NOMEMALIGN
       public:
-        Pipe (Base&& io_handler) : Base (std::move (io_handler)) { }
+        Pipe (Base&& io_handler) :
+          Base (std::move (io_handler)),
+          control (nullptr),
+          written (nullptr),
+          complete (true) { }
+
+        virtual bool is_data_pending () const { return !complete; }
+        virtual void wait_for_data (size_t offset, ssize_t stride, size_t count) const;
+
+        virtual bool is_streaming_output () const { return is_new && written; }
+        virtual void data_written (size_t offset, ssize_t stride, size_t count);
+
+        //! whether piped images should be streamed, as set by PipeStreaming
+        static bool streaming ();
 
       protected:
+        class Control;
+
         std::unique_ptr<File::MMap> mmap;
 
+        // state shared with the process at the other end of the pipe when
+        // streaming, held in a separate memory-mapped control file:
+        std::unique_ptr<File::MMap> control_mmap;
+        Control* control;
+        // one flag per voxel, set once it has been written:
+        std::atomic<uint8_t>* written;
+        // consumer: whether all data have been written
+        mutable std::atomic<bool> complete;
+
         virtual void load (const Header&, size_t);
         virtual void unload (const Header&);
+
+        void start_streaming ();
+        void open_stream ();
+        void finish_streaming ();
+        size_t num_written (size_t offset, size_t count) const;
+        void wait_until_written (size_t offset, size_t count) const;
     };
 
   }
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "progressbar.h"
+#include "thread_queue.h"
+#include "file/mmap.h"
+#include "image_io/segments.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+
+    namespace
+    {
+      // a run of consecutive entries referring to the same file; long runs
+      //   are split such that large multi-frame files are still spread
+      //   across threads
+      class Run { NOMEMALIGN
+        public:
+          size_t first, last;
+      };
+      constexpr size_t max_entries_per_run = 64;
+    }
+
+
+
+    void read_segments (const vector<File::Entry>& files, int64_t bytes_per_segment,
+        std::function<void(size_t, const uint8_t*)> func, const std::string& message)
+    {
+      vector<Run> runs;
+      for (size_t n = 0; n < files.size(); ++n) {
+        if (runs.empty() || files[n].name != files[runs.back().first].name || n - runs.back().first >= max_entries_per_run)
+          runs.push_back ({ n, n+1 });
+        else
+          runs.back().last = n+1;
+      }
+
+      std::unique_ptr<ProgressBar> progress (message.size() ? new ProgressBar (message, files.size()) : nullptr);
+
+      size_t next = 0;
+      auto source = [&] (Run& run) {
+        if (next >= runs.size())
+          return false;
+        run = runs[next++];
+        return true;
+      };
+
+      auto loader = [&] (const Run& run, size_t& count) {
+        int64_t start = files[run.first].start, end = start + bytes_per_segment;
+        for (size_t n = run.first+1; n < run.last; ++n) {
+          start = std::min (start, files[n].start);
+          end = std::max (end, files[n].start + bytes_per_segment);
+        }
+        File::MMap file (File::Entry (files[run.first].name, start), false, false, end - start);
+        for (size_t n = run.first; n < run.last; ++n)
+          func (n, file.address() + (files[n].start - start));
+        count = run.last - run.first;
+        return true;
+      };
+
+      auto sink = [&] (const size_t& count) {
+        if (progress)
+          for (size_t n = 0; n < count; ++n)
+            ++(*progress);
+        return true;
+      };
+
+      Thread::run_queue (source, Run(), Thread::multi (loader), size_t(), sink);
+    }
+
+
+  }
+}
+
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __image_io_segments_h__
+#define __image_io_segments_h__
+
+#include <functional>
+
+#include "types.h"
+#include "file/entry.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+    //! read the segments of data held in a set of files, using multiple threads
+    /*! For each entry \a n in \a files, \a func is invoked as func (n, address),
+     * where \a address points to the \a bytes_per_segment bytes of data
+     * starting at the offset given in that entry; \a func is expected to
+     * copy these data to their destination, and will be invoked concurrently
+     * for different entries.
+     *
+     * Consecutive entries that refer to the same file (as for multi-frame
+     * DICOM) are handled together using a single mapping of that file, and
+     * each thread only holds one file open at any one time, such that the
+     * number of open files is bounded by the number of threads. */
+    void read_segments (const vector<File::Entry>& files, int64_t bytes_per_segment,
+        std::function<void(size_t, const uint8_t*)> func, const std::string& message = std::string());
+
+  }
+}
+
+#endif
+
@@ -18,6 +18,7 @@
 
 #include "types.h"
 #include "interp/base.h"
+#include "math/kernels.h"
 #include "math/cubic_spline.h"
 #include "math/least_squares.h"
 
@@ -204,7 +205,7 @@ namespace MR
             }
           }
 
-          return coeff_matrix * weights_vec;
+          return Math::Kernels::mult (coeff_matrix, weights_vec);
         }
 
       protected:
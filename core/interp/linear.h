@@ -22,6 +22,7 @@
 #include "datatype.h"
 #include "types.h"
 #include "interp/base.h"
+#include "math/kernels.h"
 
 
 namespace MR
@@ -241,7 +242,7 @@ namespace MR
             }
           }
 
-          return coeff_matrix * factors;
+          return Math::Kernels::mult (coeff_matrix, factors);
         }
 
       protected:
@@ -17,6 +17,7 @@
 #define __math_SH_h__
 
 #include "math/legendre.h"
+#include "math/kernels.h"
 #include "math/least_squares.h"
 
 #define MAX_DIR_CHANGE 0.2
@@ -165,11 +166,11 @@ namespace MR
             }
           template <class VectorType1, class VectorType2>
             void A2SH (VectorType1& sh, const VectorType2& amplitudes) const {
-              sh.noalias() = iSHT * amplitudes;
+              Kernels::mult (sh, iSHT, amplitudes);
             }
           template <class VectorType1, class VectorType2>
             void SH2A (VectorType1& amplitudes, const VectorType2& sh) const {
-              amplitudes.noalias() = SHT * sh;
+              Kernels::mult (amplitudes, SHT, sh);
             }
 
           size_t n_SH () const {
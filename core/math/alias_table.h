@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __math_alias_table_h__
+#define __math_alias_table_h__
+
+#include <random>
+
+#include "types.h"
+#include "exception.h"
+
+namespace MR
+{
+  namespace Math
+  {
+
+    //! draw indices from a discrete distribution using Walker's alias method
+    /*! The table is constructed once from a set of non-negative weights, in
+     * time proportional to the number of entries. Each draw then requires
+     * exactly one uniform integer and one uniform real number, regardless of
+     * how the weights are distributed; no draws are ever rejected.
+     *
+     * Drawing is a const operation, and can therefore be performed
+     * concurrently from multiple threads provided that each thread uses its
+     * own random number generator. */
+    class AliasTable
+    { NOMEMALIGN
+      public:
+        AliasTable () { }
+
+        template <class ContainerType>
+        AliasTable (const ContainerType& weights)
+        {
+          const size_t N = weights.size();
+          if (!N)
+            throw Exception ("Cannot construct alias table from empty set of weights");
+          if (N > size_t(std::numeric_limits<uint32_t>::max()))
+            throw Exception ("Too many entries for alias table");
+          default_type sum = 0.0;
+          for (const auto w : weights) {
+            if (!(w >= 0.0))
+              throw Exception ("Cannot construct alias table from negative or non-finite weights");
+            sum += w;
+          }
+          if (!(sum > 0.0) || !std::isfinite (sum))
+            throw Exception ("Cannot construct alias table: sum of weights is not positive and finite");
+
+          probability.resize (N);
+          alias.resize (N);
+          vector<uint32_t> small, large;
+          size_t i = 0;
+          for (const auto w : weights) {
+            probability[i] = w * N / sum;
+            (probability[i] < 1.0 ? small : large).push_back (i);
+            ++i;
+          }
+          while (small.size() && large.size()) {
+            const uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            alias[s] = l;
+            probability[l] -= 1.0 - probability[s];
+            if (probability[l] < 1.0) {
+              large.pop_back();
+              small.push_back (l);
+            }
+          }
+          // Remaining entries differ from unity only through rounding error
+          for (const auto l : large) { probability[l] = 1.0; alias[l] = l; }
+          for (const auto s : small) { probability[s] = 1.0; alias[s] = s; }
+        }
+
+        size_t size () const { return probability.size(); }
+
+        template <class RNGType>
+        size_t operator() (RNGType& rng) const {
+          assert (size());
+          const size_t i = std::uniform_int_distribution<size_t> (0, probability.size()-1) (rng);
+          return std::uniform_real_distribution<default_type>() (rng) < probability[i] ? i : alias[i];
+        }
+
+      private:
+        vector<default_type> probability;
+        vector<uint32_t> alias;
+    };
+
+  }
+}
+
+#endif
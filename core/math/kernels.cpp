@@ -0,0 +1,565 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "math/kernels.h"
+
+#ifdef MRTRIX_CPU_DISPATCH
+# include <immintrin.h>
+# define TARGET_AVX2 __attribute__((target("avx2,fma")))
+# define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+namespace MR
+{
+  namespace Math
+  {
+    namespace Kernels
+    {
+
+      namespace
+      {
+
+        // generic versions: these defer to Eigen, and hence use whichever
+        // instruction set the build itself targets
+
+        template <typename T>
+          using vector_map = Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, 1>>;
+        template <typename T>
+          using const_vector_map = Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, 1>>;
+
+        template <typename T>
+          void axpy_generic (size_t n, T alpha, const T* x, T* y)
+          {
+            vector_map<T> (y, n) += alpha * const_vector_map<T> (x, n);
+          }
+
+        template <typename T>
+          T dot_generic (size_t n, const T* x, const T* y)
+          {
+            return const_vector_map<T> (x, n).dot (const_vector_map<T> (y, n));
+          }
+
+        template <typename T>
+          void gemv_generic (size_t rows, size_t cols, const T* A, const T* x, T* y)
+          {
+            vector_map<T> (y, rows).noalias() =
+              Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> (A, rows, cols) * const_vector_map<T> (x, cols);
+          }
+
+
+
+        template <typename In, typename Out>
+          void convert_generic (size_t n, const In* in, Out* out, double offset, double scale)
+          {
+            for (size_t i = 0; i != n; ++i)
+              out[i] = offset + scale * in[i];
+          }
+
+
+
+#ifdef MRTRIX_CPU_DISPATCH
+
+        // Each of these clears the upper halves of the vector registers on
+        // exit: the compiler does not do so reliably at low optimisation
+        // levels, and the calling code may use legacy SSE instructions,
+        // which stall on the transition
+
+        TARGET_AVX2 void axpy_avx2 (size_t n, float alpha, const float* x, float* y)
+        {
+          const __m256 a = _mm256_set1_ps (alpha);
+          size_t i = 0;
+          for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps (y+i, _mm256_fmadd_ps (a, _mm256_loadu_ps (x+i), _mm256_loadu_ps (y+i)));
+          for (; i != n; ++i)
+            y[i] += alpha * x[i];
+          _mm256_zeroupper();
+        }
+
+        TARGET_AVX2 void axpy_avx2 (size_t n, double alpha, const double* x, double* y)
+        {
+          const __m256d a = _mm256_set1_pd (alpha);
+          size_t i = 0;
+          for (; i + 4 <= n; i += 4)
+            _mm256_storeu_pd (y+i, _mm256_fmadd_pd (a, _mm256_loadu_pd (x+i), _mm256_loadu_pd (y+i)));
+          for (; i != n; ++i)
+            y[i] += alpha * x[i];
+          _mm256_zeroupper();
+        }
+
+        TARGET_AVX2 float dot_avx2 (size_t n, const float* x, const float* y)
+        {
+          __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            s0 = _mm256_fmadd_ps (_mm256_loadu_ps (x+i), _mm256_loadu_ps (y+i), s0);
+            s1 = _mm256_fmadd_ps (_mm256_loadu_ps (x+i+8), _mm256_loadu_ps (y+i+8), s1);
+          }
+          for (; i + 8 <= n; i += 8)
+            s0 = _mm256_fmadd_ps (_mm256_loadu_ps (x+i), _mm256_loadu_ps (y+i), s0);
+          s0 = _mm256_add_ps (s0, s1);
+          __m128 s = _mm_add_ps (_mm256_castps256_ps128 (s0), _mm256_extractf128_ps (s0, 1));
+          s = _mm_add_ps (s, _mm_movehl_ps (s, s));
+          s = _mm_add_ss (s, _mm_shuffle_ps (s, s, 1));
+          float sum = _mm_cvtss_f32 (s);
+          for (; i != n; ++i)
+            sum += x[i] * y[i];
+          _mm256_zeroupper();
+          return sum;
+        }
+
+        TARGET_AVX2 double dot_avx2 (size_t n, const double* x, const double* y)
+        {
+          __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+          size_t i = 0;
+          for (; i + 8 <= n; i += 8) {
+            s0 = _mm256_fmadd_pd (_mm256_loadu_pd (x+i), _mm256_loadu_pd (y+i), s0);
+            s1 = _mm256_fmadd_pd (_mm256_loadu_pd (x+i+4), _mm256_loadu_pd (y+i+4), s1);
+          }
+          for (; i + 4 <= n; i += 4)
+            s0 = _mm256_fmadd_pd (_mm256_loadu_pd (x+i), _mm256_loadu_pd (y+i), s0);
+          s0 = _mm256_add_pd (s0, s1);
+          __m128d s = _mm_add_pd (_mm256_castpd256_pd128 (s0), _mm256_extractf128_pd (s0, 1));
+          s = _mm_add_sd (s, _mm_unpackhi_pd (s, s));
+          double sum = _mm_cvtsd_f64 (s);
+          for (; i != n; ++i)
+            sum += x[i] * y[i];
+          _mm256_zeroupper();
+          return sum;
+        }
+
+        // rows are processed in blocks of 4 vector registers, with even & odd
+        // columns accumulated separately: this provides enough independent
+        // accumulators to hide the latency of the FMA units
+        TARGET_AVX2 void gemv_avx2 (size_t rows, size_t cols, const float* A, const float* x, float* y)
+        {
+          size_t r = 0;
+          for (; r + 32 <= rows; r += 32) {
+            __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+            __m256 t0 = _mm256_setzero_ps(), t1 = _mm256_setzero_ps(), t2 = _mm256_setzero_ps(), t3 = _mm256_setzero_ps();
+            size_t c = 0;
+            for (; c + 2 <= cols; c += 2) {
+              const float* a = A + c*rows + r;
+              const float* b = a + rows;
+              const __m256 xa = _mm256_set1_ps (x[c]), xb = _mm256_set1_ps (x[c+1]);
+              s0 = _mm256_fmadd_ps (_mm256_loadu_ps (a), xa, s0);
+              s1 = _mm256_fmadd_ps (_mm256_loadu_ps (a+8), xa, s1);
+              s2 = _mm256_fmadd_ps (_mm256_loadu_ps (a+16), xa, s2);
+              s3 = _mm256_fmadd_ps (_mm256_loadu_ps (a+24), xa, s3);
+              t0 = _mm256_fmadd_ps (_mm256_loadu_ps (b), xb, t0);
+              t1 = _mm256_fmadd_ps (_mm256_loadu_ps (b+8), xb, t1);
+              t2 = _mm256_fmadd_ps (_mm256_loadu_ps (b+16), xb, t2);
+              t3 = _mm256_fmadd_ps (_mm256_loadu_ps (b+24), xb, t3);
+            }
+            if (c != cols) {
+              const float* a = A + c*rows + r;
+              const __m256 xa = _mm256_set1_ps (x[c]);
+              s0 = _mm256_fmadd_ps (_mm256_loadu_ps (a), xa, s0);
+              s1 = _mm256_fmadd_ps (_mm256_loadu_ps (a+8), xa, s1);
+              s2 = _mm256_fmadd_ps (_mm256_loadu_ps (a+16), xa, s2);
+              s3 = _mm256_fmadd_ps (_mm256_loadu_ps (a+24), xa, s3);
+            }
+            _mm256_storeu_ps (y+r, _mm256_add_ps (s0, t0));
+            _mm256_storeu_ps (y+r+8, _mm256_add_ps (s1, t1));
+            _mm256_storeu_ps (y+r+16, _mm256_add_ps (s2, t2));
+            _mm256_storeu_ps (y+r+24, _mm256_add_ps (s3, t3));
+          }
+          for (; r + 8 <= rows; r += 8) {
+            __m256 s = _mm256_setzero_ps();
+            for (size_t c = 0; c != cols; ++c)
+              s = _mm256_fmadd_ps (_mm256_loadu_ps (A + c*rows + r), _mm256_set1_ps (x[c]), s);
+            _mm256_storeu_ps (y+r, s);
+          }
+          for (; r != rows; ++r) {
+            float s = 0.0f;
+            for (size_t c = 0; c != cols; ++c)
+              s += A[c*rows + r] * x[c];
+            y[r] = s;
+          }
+          _mm256_zeroupper();
+        }
+
+        TARGET_AVX2 void gemv_avx2 (size_t rows, size_t cols, const double* A, const double* x, double* y)
+        {
+          size_t r = 0;
+          for (; r + 16 <= rows; r += 16) {
+            __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(), s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+            __m256d t0 = _mm256_setzero_pd(), t1 = _mm256_setzero_pd(), t2 = _mm256_setzero_pd(), t3 = _mm256_setzero_pd();
+            size_t c = 0;
+            for (; c + 2 <= cols; c += 2) {
+              const double* a = A + c*rows + r;
+              const double* b = a + rows;
+              const __m256d xa = _mm256_set1_pd (x[c]), xb = _mm256_set1_pd (x[c+1]);
+              s0 = _mm256_fmadd_pd (_mm256_loadu_pd (a), xa, s0);
+              s1 = _mm256_fmadd_pd (_mm256_loadu_pd (a+4), xa, s1);
+              s2 = _mm256_fmadd_pd (_mm256_loadu_pd (a+8), xa, s2);
+              s3 = _mm256_fmadd_pd (_mm256_loadu_pd (a+12), xa, s3);
+              t0 = _mm256_fmadd_pd (_mm256_loadu_pd (b), xb, t0);
+              t1 = _mm256_fmadd_pd (_mm256_loadu_pd (b+4), xb, t1);
+              t2 = _mm256_fmadd_pd (_mm256_loadu_pd (b+8), xb, t2);
+              t3 = _mm256_fmadd_pd (_mm256_loadu_pd (b+12), xb, t3);
+            }
+            if (c != cols) {
+              const double* a = A + c*rows + r;
+              const __m256d xa = _mm256_set1_pd (x[c]);
+              s0 = _mm256_fmadd_pd (_mm256_loadu_pd (a), xa, s0);
+              s1 = _mm256_fmadd_pd (_mm256_loadu_pd (a+4), xa, s1);
+              s2 = _mm256_fmadd_pd (_mm256_loadu_pd (a+8), xa, s2);
+              s3 = _mm256_fmadd_pd (_mm256_loadu_pd (a+12), xa, s3);
+            }
+            _mm256_storeu_pd (y+r, _mm256_add_pd (s0, t0));
+            _mm256_storeu_pd (y+r+4, _mm256_add_pd (s1, t1));
+            _mm256_storeu_pd (y+r+8, _mm256_add_pd (s2, t2));
+            _mm256_storeu_pd (y+r+12, _mm256_add_pd (s3, t3));
+          }
+          for (; r + 4 <= rows; r += 4) {
+            __m256d s = _mm256_setzero_pd();
+            for (size_t c = 0; c != cols; ++c)
+              s = _mm256_fmadd_pd (_mm256_loadu_pd (A + c*rows + r), _mm256_set1_pd (x[c]), s);
+            _mm256_storeu_pd (y+r, s);
+          }
+          for (; r != rows; ++r) {
+            double s = 0.0;
+            for (size_t c = 0; c != cols; ++c)
+              s += A[c*rows + r] * x[c];
+            y[r] = s;
+          }
+          _mm256_zeroupper();
+        }
+
+
+
+
+        // AVX-512 versions handle the remaining elements using masked loads & stores
+        TARGET_AVX512 inline __mmask16 tail_mask16 (size_t n) { return __mmask16 ((1u << n) - 1u); }
+        TARGET_AVX512 inline __mmask8 tail_mask8 (size_t n) { return __mmask8 ((1u << n) - 1u); }
+
+        TARGET_AVX512 void axpy_avx512 (size_t n, float alpha, const float* x, float* y)
+        {
+          const __m512 a = _mm512_set1_ps (alpha);
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16)
+            _mm512_storeu_ps (y+i, _mm512_fmadd_ps (a, _mm512_loadu_ps (x+i), _mm512_loadu_ps (y+i)));
+          if (i != n) {
+            const __mmask16 m = tail_mask16 (n - i);
+            _mm512_mask_storeu_ps (y+i, m, _mm512_fmadd_ps (a, _mm512_maskz_loadu_ps (m, x+i), _mm512_maskz_loadu_ps (m, y+i)));
+          }
+          _mm256_zeroupper();
+        }
+
+        TARGET_AVX512 void axpy_avx512 (size_t n, double alpha, const double* x, double* y)
+        {
+          const __m512d a = _mm512_set1_pd (alpha);
+          size_t i = 0;
+          for (; i + 8 <= n; i += 8)
+            _mm512_storeu_pd (y+i, _mm512_fmadd_pd (a, _mm512_loadu_pd (x+i), _mm512_loadu_pd (y+i)));
+          if (i != n) {
+            const __mmask8 m = tail_mask8 (n - i);
+            _mm512_mask_storeu_pd (y+i, m, _mm512_fmadd_pd (a, _mm512_maskz_loadu_pd (m, x+i), _mm512_maskz_loadu_pd (m, y+i)));
+          }
+          _mm256_zeroupper();
+        }
+
+        TARGET_AVX512 float dot_avx512 (size_t n, const float* x, const float* y)
+        {
+          __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+          size_t i = 0;
+          for (; i + 32 <= n; i += 32) {
+            s0 = _mm512_fmadd_ps (_mm512_loadu_ps (x+i), _mm512_loadu_ps (y+i), s0);
+            s1 = _mm512_fmadd_ps (_mm512_loadu_ps (x+i+16), _mm512_loadu_ps (y+i+16), s1);
+          }
+          for (; i + 16 <= n; i += 16)
+            s0 = _mm512_fmadd_ps (_mm512_loadu_ps (x+i), _mm512_loadu_ps (y+i), s0);
+          if (i != n) {
+            const __mmask16 m = tail_mask16 (n - i);
+            s1 = _mm512_fmadd_ps (_mm512_maskz_loadu_ps (m, x+i), _mm512_maskz_loadu_ps (m, y+i), s1);
+          }
+          const float sum = _mm512_reduce_add_ps (_mm512_add_ps (s0, s1));
+          _mm256_zeroupper();
+          return sum;
+        }
+
+        TARGET_AVX512 double dot_avx512 (size_t n, const double* x, const double* y)
+        {
+          __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+          size_t i = 0;
+          for (; i + 16 <= n; i += 16) {
+            s0 = _mm512_fmadd_pd (_mm512_loadu_pd (x+i), _mm512_loadu_pd (y+i), s0);
+            s1 = _mm512_fmadd_pd (_mm512_loadu_pd (x+i+8), _mm512_loadu_pd (y+i+8), s1);
+          }
+          for (; i + 8 <= n; i += 8)
+            s0 = _mm512_fmadd_pd (_mm512_loadu_pd (x+i), _mm512_loadu_pd (y+i), s0);
+          if (i != n) {
+            const __mmask8 m = tail_mask8 (n - i);
+            s1 = _mm512_fmadd_pd (_mm512_maskz_loadu_pd (m, x+i), _mm512_maskz_loadu_pd (m, y+i), s1);
+          }
+          const double sum = _mm512_reduce_add_pd (_mm512_add_pd (s0, s1));
+          _mm256_zeroupper();
+          return sum;
+        }
+
+        TARGET_AVX512 void gemv_avx512 (size_t rows, size_t cols, const float* A, const float* x, float* y)
+        {
+          size_t r = 0;
+          for (; r + 64 <= rows; r += 64) {
+            __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+            __m512 t0 = _mm512_setzero_ps(), t1 = _mm512_setzero_ps(), t2 = _mm512_setzero_ps(), t3 = _mm512_setzero_ps();
+            size_t c = 0;
+            for (; c + 2 <= cols; c += 2) {
+              const float* a = A + c*rows + r;
+              const float* b = a + rows;
+              const __m512 xa = _mm512_set1_ps (x[c]), xb = _mm512_set1_ps (x[c+1]);
+              s0 = _mm512_fmadd_ps (_mm512_loadu_ps (a), xa, s0);
+              s1 = _mm512_fmadd_ps (_mm512_loadu_ps (a+16), xa, s1);
+              s2 = _mm512_fmadd_ps (_mm512_loadu_ps (a+32), xa, s2);
+              s3 = _mm512_fmadd_ps (_mm512_loadu_ps (a+48), xa, s3);
+              t0 = _mm512_fmadd_ps (_mm512_loadu_ps (b), xb, t0);
+              t1 = _mm512_fmadd_ps (_mm512_loadu_ps (b+16), xb, t1);
+              t2 = _mm512_fmadd_ps (_mm512_loadu_ps (b+32), xb, t2);
+              t3 = _mm512_fmadd_ps (_mm512_loadu_ps (b+48), xb, t3);
+            }
+            if (c != cols) {
+              const float* a = A + c*rows + r;
+              const __m512 xa = _mm512_set1_ps (x[c]);
+              s0 = _mm512_fmadd_ps (_mm512_loadu_ps (a), xa, s0);
+              s1 = _mm512_fmadd_ps (_mm512_loadu_ps (a+16), xa, s1);
+              s2 = _mm512_fmadd_ps (_mm512_loadu_ps (a+32), xa, s2);
+              s3 = _mm512_fmadd_ps (_mm512_loadu_ps (a+48), xa, s3);
+            }
+            _mm512_storeu_ps (y+r, _mm512_add_ps (s0, t0));
+            _mm512_storeu_ps (y+r+16, _mm512_add_ps (s1, t1));
+            _mm512_storeu_ps (y+r+32, _mm512_add_ps (s2, t2));
+            _mm512_storeu_ps (y+r+48, _mm512_add_ps (s3, t3));
+          }
+          for (; r < rows; r += 16) {
+            const __mmask16 m = rows - r >= 16 ? __mmask16 (0xFFFF) : tail_mask16 (rows - r);
+            __m512 s = _mm512_setzero_ps();
+            for (size_t c = 0; c != cols; ++c)
+              s = _mm512_fmadd_ps (_mm512_maskz_loadu_ps (m, A + c*rows + r), _mm512_set1_ps (x[c]), s);
+            _mm512_mask_storeu_ps (y+r, m, s);
+          }
+          _mm256_zeroupper();
+        }
+
+        TARGET_AVX512 void gemv_avx512 (size_t rows, size_t cols, const double* A, const double* x, double* y)
+        {
+          size_t r = 0;
+          for (; r + 32 <= rows; r += 32) {
+            __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd(), s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+            __m512d t0 = _mm512_setzero_pd(), t1 = _mm512_setzero_pd(), t2 = _mm512_setzero_pd(), t3 = _mm512_setzero_pd();
+            size_t c = 0;
+            for (; c + 2 <= cols; c += 2) {
+              const double* a = A + c*rows + r;
+              const double* b = a + rows;
+              const __m512d xa = _mm512_set1_pd (x[c]), xb = _mm512_set1_pd (x[c+1]);
+              s0 = _mm512_fmadd_pd (_mm512_loadu_pd (a), xa, s0);
+              s1 = _mm512_fmadd_pd (_mm512_loadu_pd (a+8), xa, s1);
+              s2 = _mm512_fmadd_pd (_mm512_loadu_pd (a+16), xa, s2);
+              s3 = _mm512_fmadd_pd (_mm512_loadu_pd (a+24), xa, s3);
+              t0 = _mm512_fmadd_pd (_mm512_loadu_pd (b), xb, t0);
+              t1 = _mm512_fmadd_pd (_mm512_loadu_pd (b+8), xb, t1);
+              t2 = _mm512_fmadd_pd (_mm512_loadu_pd (b+16), xb, t2);
+              t3 = _mm512_fmadd_pd (_mm512_loadu_pd (b+24), xb, t3);
+            }
+            if (c != cols) {
+              const double* a = A + c*rows + r;
+              const __m512d xa = _mm512_set1_pd (x[c]);
+              s0 = _mm512_fmadd_pd (_mm512_loadu_pd (a), xa, s0);
+              s1 = _mm512_fmadd_pd (_mm512_loadu_pd (a+8), xa, s1);
+              s2 = _mm512_fmadd_pd (_mm512_loadu_pd (a+16), xa, s2);
+              s3 = _mm512_fmadd_pd (_mm512_loadu_pd (a+24), xa, s3);
+            }
+            _mm512_storeu_pd (y+r, _mm512_add_pd (s0, t0));
+            _mm512_storeu_pd (y+r+8, _mm512_add_pd (s1, t1));
+            _mm512_storeu_pd (y+r+16, _mm512_add_pd (s2, t2));
+            _mm512_storeu_pd (y+r+24, _mm512_add_pd (s3, t3));
+          }
+          for (; r < rows; r += 8) {
+            const __mmask8 m = rows - r >= 8 ? __mmask8 (0xFF) : tail_mask8 (rows - r);
+            __m512d s = _mm512_setzero_pd();
+            for (size_t c = 0; c != cols; ++c)
+              s = _mm512_fmadd_pd (_mm512_maskz_loadu_pd (m, A + c*rows + r), _mm512_set1_pd (x[c]), s);
+            _mm512_mask_storeu_pd (y+r, m, s);
+          }
+          _mm256_zeroupper();
+        }
+
+
+
+
+        // conversion: 8 values at a time, widened to double precision
+        TARGET_AVX2 inline void widen (__m256i v, __m256d& lo, __m256d& hi)
+        {
+          lo = _mm256_cvtepi32_pd (_mm256_castsi256_si128 (v));
+          hi = _mm256_cvtepi32_pd (_mm256_extracti128_si256 (v, 1));
+        }
+
+        TARGET_AVX2 inline void load8 (const int8_t* p, __m256d& lo, __m256d& hi)
+        {
+          widen (_mm256_cvtepi8_epi32 (_mm_loadl_epi64 (reinterpret_cast<const __m128i*> (p))), lo, hi);
+        }
+
+        TARGET_AVX2 inline void load8 (const uint8_t* p, __m256d& lo, __m256d& hi)
+        {
+          widen (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 (reinterpret_cast<const __m128i*> (p))), lo, hi);
+        }
+
+        TARGET_AVX2 inline void load8 (const int16_t* p, __m256d& lo, __m256d& hi)
+        {
+          widen (_mm256_cvtepi16_epi32 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (p))), lo, hi);
+        }
+
+        TARGET_AVX2 inline void load8 (const uint16_t* p, __m256d& lo, __m256d& hi)
+        {
+          widen (_mm256_cvtepu16_epi32 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (p))), lo, hi);
+        }
+
+        TARGET_AVX2 inline void load8 (const int32_t* p, __m256d& lo, __m256d& hi)
+        {
+          widen (_mm256_loadu_si256 (reinterpret_cast<const __m256i*> (p)), lo, hi);
+        }
+
+        TARGET_AVX2 inline void load8 (const float* p, __m256d& lo, __m256d& hi)
+        {
+          const __m256 v = _mm256_loadu_ps (p);
+          lo = _mm256_cvtps_pd (_mm256_castps256_ps128 (v));
+          hi = _mm256_cvtps_pd (_mm256_extractf128_ps (v, 1));
+        }
+
+        TARGET_AVX2 inline void store8 (float* p, __m256d lo, __m256d hi)
+        {
+          _mm256_storeu_ps (p, _mm256_insertf128_ps (_mm256_castps128_ps256 (_mm256_cvtpd_ps (lo)), _mm256_cvtpd_ps (hi), 1));
+        }
+
+        TARGET_AVX2 inline void store8 (double* p, __m256d lo, __m256d hi)
+        {
+          _mm256_storeu_pd (p, lo);
+          _mm256_storeu_pd (p+4, hi);
+        }
+
+        // multiply & add are not fused, to match the scalar version exactly
+        template <typename In, typename Out>
+          TARGET_AVX2 void convert_avx2 (size_t n, const In* in, Out* out, double offset, double scale)
+          {
+            const __m256d o = _mm256_set1_pd (offset), s = _mm256_set1_pd (scale);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+              __m256d lo, hi;
+              load8 (in+i, lo, hi);
+              store8 (out+i, _mm256_add_pd (o, _mm256_mul_pd (s, lo)), _mm256_add_pd (o, _mm256_mul_pd (s, hi)));
+            }
+            for (; i != n; ++i)
+              out[i] = offset + scale * in[i];
+            _mm256_zeroupper();
+          }
+
+#endif
+
+
+
+        template <typename In, typename Out>
+          using convert_func = void (*) (size_t, const In*, Out*, double, double);
+
+        template <typename In, typename Out>
+          convert_func<In,Out> select_convert ()
+          {
+#ifdef MRTRIX_CPU_DISPATCH
+            // conversion is limited by memory bandwidth: AVX-512 provides no benefit
+            if (CPU::level() != CPU::Level::generic)
+              return convert_avx2<In,Out>;
+#endif
+            return convert_generic<In,Out>;
+          }
+
+        template <typename In, typename Out>
+          FORCE_INLINE void run_convert (size_t n, const In* in, Out* out, double offset, double scale)
+          {
+            static const convert_func<In,Out> kernel = select_convert<In,Out>();
+            kernel (n, in, out, offset, scale);
+          }
+
+
+
+        template <typename T>
+          struct Table { NOMEMALIGN
+            void (*axpy) (size_t, T, const T*, T*);
+            T (*dot) (size_t, const T*, const T*);
+            void (*gemv) (size_t, size_t, const T*, const T*, T*);
+          };
+
+        template <typename T>
+          Table<T> select ()
+          {
+            Table<T> table { axpy_generic<T>, dot_generic<T>, gemv_generic<T> };
+#ifdef MRTRIX_CPU_DISPATCH
+            switch (CPU::level()) {
+              case CPU::Level::avx512:
+                table.axpy = axpy_avx512;
+                table.dot = dot_avx512;
+                table.gemv = gemv_avx512;
+                break;
+              case CPU::Level::avx2:
+                table.axpy = axpy_avx2;
+                table.dot = dot_avx2;
+                table.gemv = gemv_avx2;
+                break;
+              case CPU::Level::generic:
+                break;
+            }
+#endif
+            return table;
+          }
+
+        template <typename T>
+          FORCE_INLINE const Table<T>& table ()
+          {
+            static const Table<T> kernels = select<T>();
+            return kernels;
+          }
+
+      }
+
+
+
+      void axpy (size_t n, float alpha, const float* x, float* y) { table<float>().axpy (n, alpha, x, y); }
+      void axpy (size_t n, double alpha, const double* x, double* y) { table<double>().axpy (n, alpha, x, y); }
+
+      float dot (size_t n, const float* x, const float* y) { return table<float>().dot (n, x, y); }
+      double dot (size_t n, const double* x, const double* y) { return table<double>().dot (n, x, y); }
+
+      void gemv (size_t rows, size_t cols, const float* A, const float* x, float* y) { table<float>().gemv (rows, cols, A, x, y); }
+      void gemv (size_t rows, size_t cols, const double* A, const double* x, double* y) { table<double>().gemv (rows, cols, A, x, y); }
+
+#define __DEFINE_CONVERT(In, Out) \
+      void convert (size_t n, const In* in, Out* out, double offset, double scale) { run_convert (n, in, out, offset, scale); }
+
+      __DEFINE_CONVERT (int8_t, float)
+      __DEFINE_CONVERT (uint8_t, float)
+      __DEFINE_CONVERT (int16_t, float)
+      __DEFINE_CONVERT (uint16_t, float)
+      __DEFINE_CONVERT (int32_t, float)
+      __DEFINE_CONVERT (float, float)
+      __DEFINE_CONVERT (int8_t, double)
+      __DEFINE_CONVERT (uint8_t, double)
+      __DEFINE_CONVERT (int16_t, double)
+      __DEFINE_CONVERT (uint16_t, double)
+      __DEFINE_CONVERT (int32_t, double)
+      __DEFINE_CONVERT (float, double)
+
+#undef __DEFINE_CONVERT
+
+    }
+  }
+}
+
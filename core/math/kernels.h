@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __math_kernels_h__
+#define __math_kernels_h__
+
+#include "types.h"
+#include "cpu.h"
+
+namespace MR
+{
+  namespace Math
+  {
+
+    //! Hot numerical kernels with runtime selection of the instruction set
+    /*! Each of these kernels is compiled for each of the levels listed in
+     * CPU::Level, and the version matching CPU::level() is selected on first
+     * use. This allows binaries built for a generic x86-64 target to make use
+     * of the AVX2 / AVX-512 units of the host they are deployed to.
+     *
+     * The functions in this namespace operate on contiguous arrays. The
+     * mult() helpers route matrix-vector products of dense Eigen objects
+     * through gemv() where possible, and revert to the Eigen expression
+     * otherwise. */
+    namespace Kernels
+    {
+
+      //! y += alpha * x
+      void axpy (size_t n, float alpha, const float* x, float* y);
+      void axpy (size_t n, double alpha, const double* x, double* y);
+
+      //! return the inner product of x & y
+      float dot (size_t n, const float* x, const float* y);
+      double dot (size_t n, const double* x, const double* y);
+
+      //! y = A * x, for A a column-major matrix with \a rows rows & \a cols columns
+      void gemv (size_t rows, size_t cols, const float* A, const float* x, float* y);
+      void gemv (size_t rows, size_t cols, const double* A, const double* x, double* y);
+
+      //! out = offset + scale * in
+      /*! This is the conversion applied when reading image intensities from
+       * storage. It is computed in double precision, and the results are
+       * identical to those obtained by converting each value individually. */
+      void convert (size_t n, const int8_t* in, float* out, double offset, double scale);
+      void convert (size_t n, const uint8_t* in, float* out, double offset, double scale);
+      void convert (size_t n, const int16_t* in, float* out, double offset, double scale);
+      void convert (size_t n, const uint16_t* in, float* out, double offset, double scale);
+      void convert (size_t n, const int32_t* in, float* out, double offset, double scale);
+      void convert (size_t n, const float* in, float* out, double offset, double scale);
+      void convert (size_t n, const int8_t* in, double* out, double offset, double scale);
+      void convert (size_t n, const uint8_t* in, double* out, double offset, double scale);
+      void convert (size_t n, const int16_t* in, double* out, double offset, double scale);
+      void convert (size_t n, const uint16_t* in, double* out, double offset, double scale);
+      void convert (size_t n, const int32_t* in, double* out, double offset, double scale);
+      void convert (size_t n, const float* in, double* out, double offset, double scale);
+
+
+
+      //! compute the matrix-vector product A * x
+      template <class MatrixType, class VectorType>
+        inline Eigen::Matrix<typename MatrixType::Scalar, Eigen::Dynamic, 1> mult (const MatrixType& A, const VectorType& x)
+        {
+          return A * x;
+        }
+
+      template <typename ValueType, int Cols>
+        inline Eigen::Matrix<ValueType, Eigen::Dynamic, 1> __mult (const Eigen::Matrix<ValueType, Eigen::Dynamic, Cols>& A, const Eigen::Matrix<ValueType, Cols, 1>& x)
+        {
+          assert (A.cols() == x.size());
+          Eigen::Matrix<ValueType, Eigen::Dynamic, 1> y (A.rows());
+          gemv (A.rows(), A.cols(), A.data(), x.data(), y.data());
+          return y;
+        }
+
+      template <int Cols>
+        inline Eigen::Matrix<float, Eigen::Dynamic, 1> mult (const Eigen::Matrix<float, Eigen::Dynamic, Cols>& A, const Eigen::Matrix<float, Cols, 1>& x)
+        {
+          return __mult (A, x);
+        }
+
+      template <int Cols>
+        inline Eigen::Matrix<double, Eigen::Dynamic, 1> mult (const Eigen::Matrix<double, Eigen::Dynamic, Cols>& A, const Eigen::Matrix<double, Cols, 1>& x)
+        {
+          return __mult (A, x);
+        }
+
+
+
+      //! compute y = A * x
+      template <class VectorType1, class MatrixType, class VectorType2>
+        inline void mult (VectorType1& y, const MatrixType& A, const VectorType2& x)
+        {
+          y.noalias() = A * x;
+        }
+
+      inline void mult (Eigen::VectorXf& y, const Eigen::MatrixXf& A, const Eigen::VectorXf& x)
+      {
+        assert (A.cols() == x.size());
+        y.resize (A.rows());
+        gemv (A.rows(), A.cols(), A.data(), x.data(), y.data());
+      }
+
+      inline void mult (Eigen::VectorXd& y, const Eigen::MatrixXd& A, const Eigen::VectorXd& x)
+      {
+        assert (A.cols() == x.size());
+        y.resize (A.rows());
+        gemv (A.rows(), A.cols(), A.data(), x.data(), y.data());
+      }
+
+    }
+  }
+}
+
+#endif
+
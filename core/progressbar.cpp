@@ -141,6 +141,8 @@ namespace MR
   void (*ProgressInfo::display_func) (ProgressInfo& p) = display_func_terminal;
   void (*ProgressInfo::done_func) (ProgressInfo& p) = done_func_terminal;
 
+  thread_local size_t ProgressBar::hidden = 0;
+
 
 
 
@@ -218,7 +218,17 @@ namespace MR
        * computed from the number of times the ProgressBar::operator++()
        * function was called relative to the value specified with \a target. */
       ProgressBar (const std::string& text, size_t target = 0, int log_level = 1) :
-        show (App::log_level >= log_level), text (text), target (target) { }
+        show (App::log_level >= log_level && !hidden), text (text), target (target) { }
+
+      //! hide any ProgressBar created by the calling thread while this object exists
+      /*! Unlike LogLevelLatch, this only affects the current thread, and can
+       * therefore be used to hide the progress of intermediate steps within
+       * operations that may run concurrently with others (e.g. batch jobs). */
+      class Hide { NOMEMALIGN
+        public:
+          Hide () { ++hidden; }
+          ~Hide () { --hidden; }
+      };
 
       //! returns whether the progress will be shown
       /*! The progress may not be shown if the -quiet option has been supplied
@@ -308,6 +318,8 @@ namespace MR
       std::string text;
       size_t target;
       std::unique_ptr<ProgressInfo> prog;
+
+      static thread_local size_t hidden;
   };
 
 
@@ -35,41 +35,72 @@ namespace MR
     using complex_type = cdouble;
 
 
+    //! accumulate summary statistics over a stream of values
+    /*! The mean and standard deviation are accumulated using Welford's
+     * algorithm, which remains accurate for large numbers of values. Separate
+     * instances may be used by different threads, and combined at the end
+     * using merge().
+     *
+     * The median requires all values to be retained; if \a keep_values is
+     * false, they are not stored, and the median is not available. */
     class Stats { NOMEMALIGN
       public:
-        Stats (const bool is_complex = false, const bool ignorezero = false) :
+        Stats (const bool is_complex = false, const bool ignorezero = false, const bool keep_values = true) :
             mean (0.0, 0.0),
             std (0.0, 0.0),
+            m2 (0.0, 0.0),
             min (INFINITY, INFINITY),
             max (-INFINITY, -INFINITY),
             count (0),
             is_complex (is_complex),
-            ignore_zero (ignorezero) { }
+            ignore_zero (ignorezero),
+            keep_values (keep_values && !is_complex) { }
 
 
         void operator() (complex_type val) {
           if (std::isfinite (val.real()) && std::isfinite (val.imag()) && !(ignore_zero && val.real() == 0.0 && val.imag() == 0.0)) {
-            mean += val;
-            std += cdouble (val.real()*val.real(), val.imag()*val.imag());
+            count++;
+            const complex_type delta = val - mean;
+            mean += delta / double (count);
+            m2 += complex_type (delta.real() * (val.real() - mean.real()), delta.imag() * (val.imag() - mean.imag()));
             if (min.real() > val.real()) min = complex_type (val.real(), min.imag());
             if (min.imag() > val.imag()) min = complex_type (min.real(), val.imag());
             if (max.real() < val.real()) max = complex_type (val.real(), max.imag());
             if (max.imag() < val.imag()) max = complex_type (max.real(), val.imag());
-            count++;
-            if (!is_complex)
+            if (keep_values)
               values.push_back(val.real());
           }
         }
 
-        template <class ImageType> void print (ImageType& ima, const vector<std::string>& fields) {
+        //! discard the values accumulated so far, retaining the settings
+        void clear () {
+          mean = std = m2 = complex_type (0.0, 0.0);
+          min = complex_type (INFINITY, INFINITY);
+          max = complex_type (-INFINITY, -INFINITY);
+          count = 0;
+          values.clear();
+        }
 
-          if (count) {
-            mean /= double (count);
-            std = complex_type (sqrt (std.real()/double(count) - mean.real()*mean.real()),
-                sqrt (std.imag()/double(count) - mean.imag()*mean.imag()));
-          }
+        //! combine with the statistics accumulated by another instance
+        void merge (const Stats& other) {
+          if (!other.count)
+            return;
+          const size_t total = count + other.count;
+          const complex_type delta = other.mean - mean;
+          const double weight = double (count) * double (other.count) / double (total);
+          mean += delta * (double (other.count) / double (total));
+          m2 += other.m2 + complex_type (delta.real() * delta.real() * weight, delta.imag() * delta.imag() * weight);
+          min = complex_type (std::min (min.real(), other.min.real()), std::min (min.imag(), other.min.imag()));
+          max = complex_type (std::max (max.real(), other.max.real()), std::max (max.imag(), other.max.imag()));
+          count = total;
+          values.insert (values.end(), other.values.begin(), other.values.end());
+        }
+
+        //! print the statistics, labelling the row with \a volume if \a fields is empty
+        void print (const std::string& volume, const vector<std::string>& fields) {
 
-          std::sort (values.begin(), values.end());
+          if (count)
+            std = complex_type (sqrt (m2.real()/double(count)), sqrt (m2.imag()/double(count)));
 
           if (fields.size()) {
             if (!count) {
@@ -82,7 +113,11 @@ namespace MR
             }
             for (size_t n = 0; n < fields.size(); ++n) {
               if (fields[n] == "mean") std::cout << str(mean) << " ";
-              else if (fields[n] == "median") std::cout << Math::median (values) << " ";
+              else if (fields[n] == "median") {
+                if (!keep_values)
+                  throw Exception ("Cannot output median; values not retained");
+                std::cout << Math::median (values) << " ";
+              }
               else if (fields[n] == "std") std::cout << str(std) << " ";
               else if (fields[n] == "min") std::cout << str(min) << " ";
               else if (fields[n] == "max") std::cout << str(max) << " ";
@@ -93,21 +128,13 @@ namespace MR
           }
           else {
 
-            std::string s = "[ ";
-            if (ima.ndim() > 3)
-              for (size_t n = 3; n < ima.ndim(); n++)
-                s += str (ima.index(n)) + " ";
-            else
-              s += "0 ";
-            s += "]";
-
             int width = is_complex ? 20 : 10;
-            std::cout << std::setw(12) << std::right << s << " ";
+            std::cout << std::setw(12) << std::right << volume << " ";
 
             std::cout << std::setw(width) << std::right << ( count ? str(mean) : "N/A" );
 
             if (!is_complex) {
-              std::cout << " " << std::setw(width) << std::right << ( count ? str(Math::median (values)) : "N/A" );
+              std::cout << " " << std::setw(width) << std::right << ( count && keep_values ? str(Math::median (values)) : "N/A" );
             }
             std::cout << " " << std::setw(width) << std::right << ( count > 1 ? str(std) : "N/A" )
               << " " << std::setw(width) << std::right << ( count ? str(min) : "N/A" )
@@ -118,10 +145,10 @@ namespace MR
         }
 
       private:
-        cdouble mean, std;
+        cdouble mean, std, m2;
         complex_type min, max;
         size_t count;
-        const bool is_complex, ignore_zero;
+        const bool is_complex, ignore_zero, keep_values;
         vector<float> values;
     };
 
@@ -19,6 +19,7 @@
 #include "app.h"
 #include "thread.h"
 #include "file/config.h"
+#include "file/ofstream.h"
 #include "thread_queue.h"
 
 namespace MR
@@ -79,6 +80,150 @@ namespace MR
 
 
 
+    namespace {
+
+      struct QueueProfile { NOMEMALIGN
+        bool enabled;
+        std::string file;
+      };
+
+      //CONF option: QueueProfile
+      //CONF default: 0 (false)
+      //CONF Print a summary of the time spent by each stage of any
+      //CONF multi-threaded pipeline (busy, or waiting on its input or output
+      //CONF queue), along with the throughput and occupancy of each queue, as
+      //CONF each pipeline completes. Can also be enabled by setting the
+      //CONF environment variable MRTRIX_QUEUE_PROFILE.
+
+      //CONF option: QueueProfileFile
+      //CONF default: none
+      //CONF If set, append the multi-threaded pipeline statistics described
+      //CONF for QueueProfile to this file, as one JSON record per line, rather
+      //CONF than printing them. Can also be set using the environment
+      //CONF variable MRTRIX_QUEUE_PROFILE_FILE.
+
+      const QueueProfile& queue_profile ()
+      {
+        static const QueueProfile profile = [] {
+          QueueProfile p;
+          const char* file_from_env = getenv ("MRTRIX_QUEUE_PROFILE_FILE");
+          p.file = file_from_env ? file_from_env : File::Config::get ("QueueProfileFile");
+          const char* from_env = getenv ("MRTRIX_QUEUE_PROFILE");
+          if (from_env)
+            p.enabled = to<bool> (from_env);
+          else
+            p.enabled = File::Config::get_bool ("QueueProfile", false);
+          p.enabled = p.enabled || p.file.size();
+          return p;
+        }();
+        return profile;
+      }
+
+    }
+
+
+
+    __QueueStats::__QueueStats (const std::string& name, size_t capacity) :
+        enabled (queue_profile().enabled),
+        name (name),
+        capacity (capacity),
+        batch_size (1),
+        writers (0),
+        readers (0),
+        pushed (0),
+        popped (0),
+        items_pushed (0),
+        items_popped (0),
+        writer_time (0.0),
+        reader_time (0.0),
+        push_wait (0.0),
+        pop_wait (0.0),
+        occupancy (enabled ? 10 : 0, 0) { }
+
+
+
+    void __report_queue_statistics (const vector<std::string>& stages, const vector<const __QueueStats*>& queues, double wall_time)
+    {
+      assert (stages.size() == queues.size() + 1);
+
+      struct Stage { NOMEMALIGN
+        size_t threads, items;
+        double time, wait_in, wait_out;
+      };
+      vector<Stage> summary;
+      for (size_t n = 0; n != stages.size(); ++n) {
+        const __QueueStats* in = n ? queues[n-1] : nullptr;
+        const __QueueStats* out = n < queues.size() ? queues[n] : nullptr;
+        Stage stage;
+        stage.threads = out ? out->writers : in->readers;
+        stage.time = out ? out->writer_time : in->reader_time;
+        stage.items = out ? out->items_pushed : in->items_popped;
+        stage.wait_in = in ? in->pop_wait : 0.0;
+        stage.wait_out = out ? out->push_wait : 0.0;
+        summary.push_back (stage);
+      }
+
+      auto percent = [] (double value, double total) { return total > 0.0 ? 100.0 * value / total : 0.0; };
+
+      if (queue_profile().file.size()) {
+        std::string json = "{\"command\": \"" + App::NAME + "\", \"nthreads\": " + str(number_of_threads())
+            + ", \"wall_time\": " + str(wall_time, 6) + ", \"stages\": [";
+        for (size_t n = 0; n != stages.size(); ++n) {
+          const Stage& stage (summary[n]);
+          json += std::string (n ? ", " : "") + "{\"name\": \"" + stages[n] + "\", \"threads\": " + str(stage.threads)
+              + ", \"thread_time\": " + str(stage.time, 6)
+              + ", \"busy_time\": " + str(stage.time - stage.wait_in - stage.wait_out, 6)
+              + ", \"input_wait\": " + str(stage.wait_in, 6)
+              + ", \"output_wait\": " + str(stage.wait_out, 6)
+              + ", \"items\": " + str(stage.items)
+              + ", \"items_per_second\": " + str(wall_time > 0.0 ? stage.items / wall_time : 0.0, 6) + "}";
+        }
+        json += "], \"queues\": [";
+        for (size_t n = 0; n != queues.size(); ++n) {
+          json += std::string (n ? ", " : "") + "{\"name\": \"" + queues[n]->name + "\", \"capacity\": " + str(queues[n]->capacity)
+              + ", \"batch_size\": " + str(queues[n]->batch_size) + ", \"occupancy\": [";
+          for (size_t i = 0; i != queues[n]->occupancy.size(); ++i)
+            json += std::string (i ? ", " : "") + str(queues[n]->occupancy[i]);
+          json += "]}";
+        }
+        json += "]}\n";
+
+        static std::mutex file_mutex;
+        std::lock_guard<std::mutex> lock (file_mutex);
+        File::OFStream out (queue_profile().file, std::ios_base::out | std::ios_base::app);
+        out << json;
+        return;
+      }
+
+      std::string report = App::NAME + ": [queue profile] pipeline completed in " + str(wall_time, 4) + " s:\n";
+      report += App::NAME + ": [queue profile]   stage    threads   active     busy  in-wait out-wait      items/s\n";
+      for (size_t n = 0; n != stages.size(); ++n) {
+        const Stage& stage (summary[n]);
+        report += App::NAME + ": [queue profile]   " + MR::printf ("%-8s %7zu %7.1f%% %7.1f%% %7.1f%% %7.1f%% %12.1f\n",
+            stages[n].c_str(), stage.threads,
+            percent (stage.time, stage.threads * wall_time),
+            percent (stage.time - stage.wait_in - stage.wait_out, stage.time),
+            percent (stage.wait_in, stage.time),
+            percent (stage.wait_out, stage.time),
+            wall_time > 0.0 ? stage.items / wall_time : 0.0);
+      }
+      for (const auto q : queues) {
+        size_t samples = 0;
+        for (const auto count : q->occupancy)
+          samples += count;
+        report += App::NAME + ": [queue profile]   queue \"" + q->name + "\" (capacity " + str(q->capacity)
+            + (q->batch_size > 1 ? ", batches of " + str(q->batch_size) : std::string()) + ") occupancy:";
+        for (size_t i = 0; i != q->occupancy.size(); ++i)
+          report += MR::printf (" %.0f%%", percent (q->occupancy[i], samples));
+        report += "\n";
+      }
+      std::cerr << report;
+    }
+
+
+
+
+
     void (*__Backend::previous_print_func) (const std::string& msg) = nullptr;
     void (*__Backend::previous_report_to_user_func) (const std::string& msg, int type) = nullptr;
 
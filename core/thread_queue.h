@@ -17,6 +17,7 @@
 #define __mrtrix_thread_queue_h__
 
 #include <stack>
+#include <chrono>
 #include <condition_variable>
 
 #include "exception.h"
@@ -81,6 +82,57 @@ namespace MR
 
     }
 
+
+
+    //! statistics gathered by a Thread::Queue when pipeline profiling is enabled
+    /*! Profiling is enabled by setting the environment variable
+     * MRTRIX_QUEUE_PROFILE (or the QueueProfile config file option), in which
+     * case a summary of each Thread::run_queue() pipeline is printed on
+     * completion; the same information can also be appended as one JSON
+     * record per pipeline to the file given by the environment variable
+     * MRTRIX_QUEUE_PROFILE_FILE (or the QueueProfileFile config file option).
+     *
+     * All members are protected by the mutex of the owning queue; the times
+     * accumulated for writers & readers are the sums over all threads of the
+     * time spent between their first access to the queue and unregistering
+     * from it. */
+    class __QueueStats { NOMEMALIGN
+      public:
+        __QueueStats (const std::string& name, size_t capacity);
+
+        static double now () {
+          return std::chrono::duration<double> (std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        //! record the number of items waiting in the queue
+        FORCE_INLINE void sample (size_t size) {
+          ++occupancy[size * occupancy.size() / capacity];
+        }
+
+        const bool enabled;
+        const std::string name;
+        const size_t capacity;
+        size_t batch_size, writers, readers, pushed, popped, items_pushed, items_popped;
+        double writer_time, reader_time, push_wait, pop_wait;
+        vector<size_t> occupancy;
+    };
+
+    //! print and/or save the statistics of a completed Thread::run_queue() pipeline
+    /*! \a stages lists the name of each stage of the pipeline, and \a queues
+     * the statistics of the queues between successive stages. */
+    void __report_queue_statistics (const vector<std::string>& stages, const vector<const __QueueStats*>& queues, double wall_time);
+
+
+    namespace {
+
+      // number of actual items in a queued element, accounting for batches
+      template <class X>
+        FORCE_INLINE size_t __num_items (const X&, bool) { return 1; }
+      template <class X>
+        FORCE_INLINE size_t __num_items (const vector<X>& batch, bool is_batch) { return is_batch ? batch.size() : 1; }
+
+    }
+
     //! \endcond
 
 
@@ -363,7 +415,8 @@ namespace MR
           capacity (buffer_size),
           writer_count (0),
           reader_count (0),
-          name (description) {
+          name (description),
+          stats (description, buffer_size) {
           assert (capacity > 0);
         }
 
@@ -375,7 +428,8 @@ namespace MR
           capacity (buffer_size),
           writer_count (0),
           reader_count (0),
-          name (description) {
+          name (description),
+          stats (description, buffer_size) {
           assert (capacity > 0);
         }
 
@@ -424,7 +478,9 @@ namespace MR
                  *
                  * \note There should only be one Writer::Item object per Writer.
                  * */
-                Item (const Writer& writer) : Q (writer.Q), p (Q.get_item()) { }
+                Item (const Writer& writer) : Q (writer.Q), p (Q.get_item()) {
+                  Q.start_writer();
+                }
                 //! Unregister the parent Writer from the queue
                 ~Item () {
                   Q.unregister_writer();
@@ -489,7 +545,9 @@ namespace MR
                  *
                  * \note There should only be one Reader::Item object per
                  * Reader. */
-                Item (const Reader& reader) : Q (reader.Q), p (nullptr) { }
+                Item (const Reader& reader) : Q (reader.Q), p (nullptr) {
+                  Q.start_reader();
+                }
                 //! Unregister the parent Reader from the queue
                 ~Item () {
                   Q.unregister_reader();
@@ -523,6 +581,11 @@ namespace MR
                     << reader_count << " reader" << (reader_count > 1 ? "s" : "") << ", items waiting: " << size() << "\n";
         }
 
+        //! the profiling statistics gathered for this queue
+        /*! these should only be accessed once all readers & writers have
+         * completed. \sa __QueueStats */
+        __QueueStats& statistics () { return stats; }
+
 
       private:
         std::mutex mutex;
@@ -535,6 +598,7 @@ namespace MR
         std::stack<T*,vector<T*> > item_stack;
         vector<std::unique_ptr<T>> items;
         std::string name;
+        __QueueStats stats;
 
         Queue (const Queue&) = delete;
         Queue& operator= (const Queue&) = delete;
@@ -543,9 +607,25 @@ namespace MR
           std::lock_guard<std::mutex> lock (mutex);
           ++writer_count;
         }
+        void start_writer () {
+          if (stats.enabled) {
+            std::lock_guard<std::mutex> lock (mutex);
+            ++stats.writers;
+            stats.writer_time -= __QueueStats::now();
+          }
+        }
+        void start_reader () {
+          if (stats.enabled) {
+            std::lock_guard<std::mutex> lock (mutex);
+            ++stats.readers;
+            stats.reader_time -= __QueueStats::now();
+          }
+        }
         void unregister_writer () {
           std::lock_guard<std::mutex> lock (mutex);
           assert (writer_count);
+          if (stats.enabled)
+            stats.writer_time += __QueueStats::now();
           --writer_count;
           if (!writer_count) {
             DEBUG ("no writers left on queue \"" + name + "\"");
@@ -559,6 +639,8 @@ namespace MR
         void unregister_reader () {
           std::lock_guard<std::mutex> lock (mutex);
           assert (reader_count);
+          if (stats.enabled)
+            stats.reader_time += __QueueStats::now();
           --reader_count;
           if (!reader_count) {
             DEBUG ("no readers left on queue \"" + name + "\"");
@@ -585,10 +667,21 @@ namespace MR
 
         FORCE_INLINE bool push (T*& item) {
           std::unique_lock<std::mutex> lock (mutex);
-          more_space.wait (lock, [this]{ return !(full() && reader_count); });
+          if (stats.enabled && full() && reader_count) {
+            const double start = __QueueStats::now();
+            more_space.wait (lock, [this]{ return !(full() && reader_count); });
+            stats.push_wait += __QueueStats::now() - start;
+          }
+          else
+            more_space.wait (lock, [this]{ return !(full() && reader_count); });
           if (!reader_count) return false;
           *back = item;
           back = inc (back);
+          if (stats.enabled) {
+            ++stats.pushed;
+            stats.items_pushed += __num_items (*item, stats.batch_size > 1);
+            stats.sample (size());
+          }
           if (item_stack.empty()) {
             item = new T;
             items.push_back (std::unique_ptr<T> (item));
@@ -606,11 +699,23 @@ namespace MR
           if (item)
             item_stack.push (item);
           item = nullptr;
-          more_data.wait (lock, [this]{ return !(empty() && writer_count); });
+          if (stats.enabled && empty() && writer_count) {
+            const double start = __QueueStats::now();
+            more_data.wait (lock, [this]{ return !(empty() && writer_count); });
+            stats.pop_wait += __QueueStats::now() - start;
+          }
+          else
+            more_data.wait (lock, [this]{ return !(empty() && writer_count); });
           if (empty() && !writer_count)
             return false;
+          if (stats.enabled)
+            stats.sample (size());
           item = *front;
           front = inc (front);
+          if (stats.enabled) {
+            ++stats.popped;
+            stats.items_popped += __num_items (*item, stats.batch_size > 1);
+          }
           more_space.notify_one();
           return true;
         }
@@ -637,7 +742,9 @@ namespace MR
       public:
         Queue (const __Batch<T>& item_type, const std::string& description = "unnamed", size_t buffer_size = MRTRIX_QUEUE_DEFAULT_CAPACITY) :
           batch_queue (description, buffer_size),
-          batch_size (item_type.num) { }
+          batch_size (item_type.num) {
+            batch_queue.statistics().batch_size = batch_size;
+          }
 
 
         class Writer { NOMEMALIGN
@@ -720,6 +827,7 @@ namespace MR
         };
 
         FORCE_INLINE void status () { batch_queue.status(); }
+        __QueueStats& statistics () { return batch_queue.statistics(); }
 
 
       private:
@@ -1023,6 +1131,7 @@ namespace MR
           return;
         }
 
+         const double start = __QueueStats::now();
          Queue<Type> queue (item_type, "source->sink", capacity);
          __Source<Type,Source> source_functor (queue, source);
          __Sink<Type,Sink>     sink_functor   (queue, sink);
@@ -1033,6 +1142,9 @@ namespace MR
         t1.wait();
         t2.wait();
 
+        if (queue.statistics().enabled)
+          __report_queue_statistics ({ "source", "sink" }, { &queue.statistics() }, __QueueStats::now() - start);
+
         check_app_exit_code();
       }
 
@@ -1103,6 +1215,7 @@ namespace MR
         }
 
 
+        const double start = __QueueStats::now();
         Queue<Type1> queue1 (item_type1, "source->pipe", capacity);
         Queue<Type2> queue2 (item_type2, "pipe->sink", capacity);
 
@@ -1118,6 +1231,10 @@ namespace MR
         t2.wait();
         t3.wait();
 
+        if (queue1.statistics().enabled)
+          __report_queue_statistics ({ "source", "pipe", "sink" },
+              { &queue1.statistics(), &queue2.statistics() }, __QueueStats::now() - start);
+
         check_app_exit_code();
       }
 
@@ -1151,6 +1268,7 @@ namespace MR
         }
 
 
+        const double start = __QueueStats::now();
         Queue<Type1> queue1 (item_type1, "source->pipe", capacity);
         Queue<Type2> queue2 (item_type2, "pipe->pipe", capacity);
         Queue<Type3> queue3 (item_type3, "pipe->sink", capacity);
@@ -1170,6 +1288,10 @@ namespace MR
         t3.wait();
         t4.wait();
 
+        if (queue1.statistics().enabled)
+          __report_queue_statistics ({ "source", "pipe1", "pipe2", "sink" },
+              { &queue1.statistics(), &queue2.statistics(), &queue3.statistics() }, __QueueStats::now() - start);
+
         check_app_exit_code();
       }
 
@@ -75,6 +75,16 @@ namespace MR {
 
 
 
+      bool NBS::integrate (const vector_type& in, const value_type dh, const value_type E, const value_type H, vector_type& out) const
+      {
+        Stats::TFCE::integrate (*adjacency,
+                                [] (const value_type value, const value_type T) { return value >= T; },
+                                in, dh, E, H, out);
+        return true;
+      }
+
+
+
       void NBS::initialise (const node_t num_nodes)
       {
         const Mat2Vec mat2vec (num_nodes);
@@ -71,6 +71,8 @@ namespace MR {
 
           value_type operator() (const vector_type&, const value_type, vector_type&) const override;
 
+          bool integrate (const vector_type&, const value_type, const value_type, const value_type, vector_type&) const override;
+
         protected:
           std::shared_ptr< vector< vector<size_t> > > adjacency;
           value_type threshold;
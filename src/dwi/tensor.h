@@ -17,6 +17,7 @@
 #define __dwi_tensor_h__
 
 #include "types.h"
+#include "math/least_squares.h"
 
 #include "dwi/shells.h"
 
@@ -84,6 +85,95 @@ namespace MR
     }
 
 
+    //! fit a log-linear model of the DW signal to a block of voxels
+    /*! This fits the model log(S) = B p to the log-transformed signals of
+     * many voxels at once, using ordinary linear least squares followed by
+     * \a iter iterations of weighted linear least squares (Veraart et al.,
+     * 2013). This applies to tensor and kurtosis tensor estimation (with B
+     * set to -grad2bmatrix()), and to mono-exponential ADC estimation.
+     *
+     * The log-signals are supplied as a matrix with one column per voxel
+     * (typically a row of voxels), so that the initial fit reduces to a
+     * single matrix product with the pseudo-inverse of B. For each
+     * reweighting iteration, the weights and the weighted normal equations
+     * of all voxels are likewise computed as matrix products, leaving only
+     * the Cholesky factorisation of a small matrix per voxel. The columns
+     * of B are scaled to unit norm for the weighted fits, which keeps the
+     * normal equations well-conditioned in single precision.
+     *
+     * Each instance holds its own workspace, and should therefore be
+     * copied for use in each thread. */
+    template <typename ValueType>
+      class TensorFit { MEMALIGN(TensorFit<ValueType>)
+        public:
+          using matrix_type = Eigen::Matrix<ValueType,Eigen::Dynamic,Eigen::Dynamic>;
+          using vector_type = Eigen::Matrix<ValueType,Eigen::Dynamic,1>;
+
+          TensorFit (const Eigen::MatrixXd& bmatrix, int iter) :
+            B (bmatrix.cast<ValueType>()),
+            scale (bmatrix.cols()),
+            products (bmatrix.cols()*(bmatrix.cols()+1)/2, bmatrix.rows()),
+            iter (iter),
+            work (bmatrix.cols(), bmatrix.cols()),
+            llt (bmatrix.cols()) {
+              Eigen::VectorXd s (bmatrix.cols());
+              for (ssize_t k = 0; k < s.size(); ++k) {
+                const double norm = bmatrix.col (k).norm();
+                s[k] = norm > 0.0 ? 1.0 / norm : 1.0;
+              }
+              scale = s.cast<ValueType>();
+              const Eigen::MatrixXd Bs = bmatrix * s.asDiagonal();
+              Binv = (s.asDiagonal() * Math::pinv (Bs)).cast<ValueType>();
+              // pairwise products of the scaled columns of B, such that
+              // the weighted normal equations of all voxels can be formed
+              // as a single matrix product with the squared weights:
+              for (ssize_t k = 0, n = 0; k < Bs.cols(); ++k)
+                for (ssize_t l = k; l < Bs.cols(); ++l, ++n)
+                  products.row (n) = Bs.col (k).cwiseProduct (Bs.col (l)).transpose().cast<ValueType>();
+            }
+
+          //! the number of model parameters
+          ssize_t size () const { return B.cols(); }
+
+          //! fit the model to \a logS (one column per voxel), storing the parameters in \a p
+          void operator() (const matrix_type& logS, matrix_type& p) {
+            p.noalias() = Binv * logS;
+            if (!iter)
+              return;
+
+            const ssize_t P = B.cols();
+            for (int it = 0; it < iter; ++it) {
+              // squared weights, normalised per voxel to avoid overflow
+              // (this has no effect on the solution):
+              w2.noalias() = B * p;
+              for (ssize_t j = 0; j < w2.cols(); ++j)
+                w2.col (j).array() -= w2.col (j).maxCoeff();
+              w2 = (ValueType (2.0) * w2.array()).exp();
+
+              normal.noalias() = products * w2;
+              rhs.noalias() = scale.asDiagonal() * (B.transpose() * w2.cwiseProduct (logS));
+
+              for (ssize_t j = 0; j < p.cols(); ++j) {
+                for (ssize_t k = 0, n = 0; k < P; ++k)
+                  for (ssize_t l = k; l < P; ++l, ++n)
+                    work (l, k) = normal (n, j);
+                llt.compute (work);
+                if (llt.info() == Eigen::Success)
+                  p.col (j) = scale.cwiseProduct (llt.solve (rhs.col (j)));
+              }
+            }
+          }
+
+        protected:
+          const matrix_type B;
+          vector_type scale;
+          matrix_type Binv, products;
+          const int iter;
+          matrix_type w2, normal, rhs, work;
+          Eigen::LLT<matrix_type> llt;
+      };
+
+
     template <class VectorType> inline typename VectorType::Scalar tensor2ADC (const VectorType& dt)
     {
       using T = typename VectorType::Scalar;
@@ -16,6 +16,11 @@
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/roi.h"
 #include "adapter/subset.h"
+#include "file/config.h"
+
+// the number of times the grid spacing may be doubled for the lookup grid of
+//   spherical ROIs to satisfy the memory limit
+#define ROILOOKUP_MAX_COARSENING 20
 
 
 namespace MR {
@@ -64,6 +69,10 @@ namespace MR {
         opt = get_options ("mask");
         for (size_t i = 0; i < opt.size(); ++i)
           properties.mask.add (ROI (opt[i][0]));
+
+        properties.include.build_lookup();
+        properties.exclude.build_lookup();
+        properties.mask.build_lookup();
       }
 
 
@@ -111,6 +120,271 @@ namespace MR {
       }
 
 
+
+
+
+
+      constexpr size_t ROILookup::max_bytes;
+      constexpr size_t ROILookup::invalid;
+
+
+
+      ROILookup::ROILookup (const vector<ROI>& rois) :
+          words_per_cell ((rois.size() + 63) / 64),
+          boundary (0)
+      {
+        // If any mask images are provided, use the voxel grid of the first; any
+        //   other mask images defined on the same voxel grid are then
+        //   represented exactly, without requiring any explicit tests
+        const ROI* first_mask = nullptr;
+        float min_radius = std::numeric_limits<float>::infinity();
+        for (const auto& roi : rois) {
+          if (roi.mask) {
+            if (!first_mask)
+              first_mask = &roi;
+          } else {
+            if (!roi.pos.allFinite() || !std::isfinite (roi.radius) || roi.radius < 0.0f)
+              throw Exception ("invalid spherical ROI (" + roi.parameters() + ")");
+            min_radius = std::min (min_radius, roi.radius);
+          }
+        }
+
+        if (first_mask) {
+          set_grid (*first_mask->mask->voxel2scanner, *first_mask->mask->scanner2voxel, rois);
+        } else {
+          // For spheres only, use an axis-aligned grid that is fine relative to the
+          //   smallest sphere, coarsened if necessary to satisfy the memory limit
+          float spacing = std::max (0.25f * min_radius, 0.01f);
+          for (size_t attempt = 0; ; ++attempt) {
+            transform_type grid (transform_type::Identity());
+            grid.linear() *= spacing;
+            try {
+              set_grid (grid, grid.inverse(), rois);
+              break;
+            } catch (Exception&) {
+              // e.g. very distant spheres:
+              if (attempt == ROILOOKUP_MAX_COARSENING)
+                throw;
+              spacing *= 2.0f;
+            }
+          }
+        }
+
+        for (size_t n = 0; n != rois.size(); ++n) {
+          if (rois[n].mask)
+            rasterise_mask (rois[n], n);
+          else
+            rasterise_sphere (rois[n], n);
+        }
+      }
+
+
+
+      void ROILookup::set_grid (const transform_type& grid2scanner, const transform_type& scanner2grid, const vector<ROI>& rois)
+      {
+        Eigen::Vector3f lower = Eigen::Vector3f::Constant (std::numeric_limits<float>::infinity());
+        Eigen::Vector3f upper = -lower;
+        for (const auto& roi : rois) {
+          if (roi.mask) {
+            for (size_t c = 0; c != 8; ++c) {
+              const Eigen::Vector3f corner ((c & 1) ? roi.mask->size(0) - 0.5f : -0.5f,
+                                            (c & 2) ? roi.mask->size(1) - 0.5f : -0.5f,
+                                            (c & 4) ? roi.mask->size(2) - 0.5f : -0.5f);
+              const Eigen::Vector3f v = scanner2grid * (*roi.mask->voxel2scanner * corner);
+              lower = lower.cwiseMin (v);
+              upper = upper.cwiseMax (v);
+            }
+          } else {
+            const Eigen::Vector3f v = scanner2grid * roi.pos;
+            for (size_t axis = 0; axis != 3; ++axis) {
+              const float extent = roi.radius * scanner2grid.linear().row (axis).norm();
+              lower[axis] = std::min (lower[axis], v[axis] - extent);
+              upper[axis] = std::max (upper[axis], v[axis] + extent);
+            }
+          }
+        }
+
+        // Pad by one cell, such that any point outside of the grid is guaranteed
+        //   to be outside of all ROIs
+        Eigen::Vector3f origin;
+        size_t num_cells = 1;
+        for (size_t axis = 0; axis != 3; ++axis) {
+          origin[axis] = std::floor (lower[axis]) - 1.0f;
+          const float extent = std::ceil (upper[axis]) + 1.0f - origin[axis] + 1.0f;
+          if (!std::isfinite (extent) || extent > float(max_bytes))
+            throw Exception ("ROI lookup grid too large");
+          dim[axis] = extent;
+          num_cells *= dim[axis];
+          if (num_cells * words_per_cell * sizeof(uint64_t) > max_bytes)
+            throw Exception ("ROI lookup grid too large");
+        }
+
+        this->scanner2grid = scanner2grid;
+        for (size_t axis = 0; axis != 3; ++axis)
+          this->origin[axis] = origin[axis];
+        scanner2voxel = Eigen::Translation3f (-origin) * scanner2grid;
+        voxel2scanner = grid2scanner * Eigen::Translation3f (origin);
+        inside.assign (num_cells * words_per_cell, 0);
+        boundary.resize (num_cells);
+      }
+
+
+
+      void ROILookup::rasterise_sphere (const ROI& roi, const size_t index)
+      {
+        // Maximal distance from the centre of a cell to any point within it
+        float half_diagonal = 0.0f;
+        for (size_t c = 0; c != 8; ++c) {
+          const Eigen::Vector3f offset ((c & 1) ? 0.5f : -0.5f, (c & 2) ? 0.5f : -0.5f, (c & 4) ? 0.5f : -0.5f);
+          half_diagonal = std::max (half_diagonal, (voxel2scanner.linear() * offset).norm());
+        }
+        // Safety margin to account for floating-point precision
+        const float margin = 1e-4f * (roi.radius + half_diagonal);
+
+        const Eigen::Vector3f centre = scanner2voxel * roi.pos;
+        ssize_t from[3], to[3];
+        for (size_t axis = 0; axis != 3; ++axis) {
+          const float extent = roi.radius * scanner2voxel.linear().row (axis).norm();
+          from[axis] = std::max (ssize_t(0), ssize_t(std::floor (centre[axis] - extent)) - 1);
+          to[axis] = std::min (ssize_t(dim[axis]) - 1, ssize_t(std::ceil (centre[axis] + extent)) + 1);
+        }
+
+        for (ssize_t z = from[2]; z <= to[2]; ++z) {
+          for (ssize_t y = from[1]; y <= to[1]; ++y) {
+            for (ssize_t x = from[0]; x <= to[0]; ++x) {
+              const size_t cell = x + dim[0] * (y + dim[1] * z);
+              const float distance = (voxel2scanner * Eigen::Vector3f (x, y, z) - roi.pos).norm();
+              if (distance + half_diagonal < roi.radius - margin)
+                inside[cell*words_per_cell + index/64] |= uint64_t(1) << (index%64);
+              else if (distance - half_diagonal <= roi.radius + margin)
+                add_boundary (cell, index);
+            }
+          }
+        }
+      }
+
+
+
+      void ROILookup::rasterise_mask (const ROI& roi, const size_t index)
+      {
+        Mask mask (*roi.mask);
+        // Transformation from lookup grid cell to mask voxel coordinates
+        const transform_type grid2mask = (*mask.scanner2voxel) * voxel2scanner;
+
+        ssize_t from[3], to[3];
+        {
+          const transform_type mask2grid = grid2mask.inverse();
+          Eigen::Vector3f lower = Eigen::Vector3f::Constant (std::numeric_limits<float>::infinity());
+          Eigen::Vector3f upper = -lower;
+          for (size_t c = 0; c != 8; ++c) {
+            const Eigen::Vector3f corner ((c & 1) ? mask.size(0) - 0.5f : -0.5f,
+                                          (c & 2) ? mask.size(1) - 0.5f : -0.5f,
+                                          (c & 4) ? mask.size(2) - 0.5f : -0.5f);
+            const Eigen::Vector3f v = mask2grid * corner;
+            lower = lower.cwiseMin (v);
+            upper = upper.cwiseMax (v);
+          }
+          for (size_t axis = 0; axis != 3; ++axis) {
+            from[axis] = std::max (ssize_t(0), ssize_t(std::floor (lower[axis])) - 1);
+            to[axis] = std::min (ssize_t(dim[axis]) - 1, ssize_t(std::ceil (upper[axis])) + 1);
+          }
+        }
+
+        auto set_inside = [&] (const size_t cell) { inside[cell*words_per_cell + index/64] |= uint64_t(1) << (index%64); };
+
+        // Mask defined on the voxel grid of the lookup grid: each cell corresponds
+        //   to exactly one mask voxel. Since cells are located by rounding the
+        //   coordinates of each point on that same grid, this is exact even for
+        //   points lying half-way between two voxels. Masks on grids that merely
+        //   coincide (e.g. up to an integer offset) are handled below, using
+        //   explicit tests near their boundary.
+        if (mask.scanner2voxel->matrix() == scanner2grid.matrix()) {
+          for (ssize_t z = from[2]; z <= to[2]; ++z) {
+            for (ssize_t y = from[1]; y <= to[1]; ++y) {
+              for (ssize_t x = from[0]; x <= to[0]; ++x) {
+                mask.index(0) = x + origin[0];
+                mask.index(1) = y + origin[1];
+                mask.index(2) = z + origin[2];
+                if (!is_out_of_bounds (mask, 0, 3) && mask.value())
+                  set_inside (x + dim[0] * (y + dim[1] * z));
+              }
+            }
+          }
+          return;
+        }
+
+        // Otherwise, determine the range of mask voxels that may intersect each cell
+        Eigen::Vector3f lower_offset = Eigen::Vector3f::Constant (std::numeric_limits<float>::infinity());
+        Eigen::Vector3f upper_offset = -lower_offset;
+        for (size_t c = 0; c != 8; ++c) {
+          const Eigen::Vector3f offset = grid2mask.linear() * Eigen::Vector3f ((c & 1) ? 0.5f : -0.5f, (c & 2) ? 0.5f : -0.5f, (c & 4) ? 0.5f : -0.5f);
+          lower_offset = lower_offset.cwiseMin (offset);
+          upper_offset = upper_offset.cwiseMax (offset);
+        }
+        lower_offset.array() -= 1e-4f;
+        upper_offset.array() += 1e-4f;
+
+        for (ssize_t z = from[2]; z <= to[2]; ++z) {
+          for (ssize_t y = from[1]; y <= to[1]; ++y) {
+            for (ssize_t x = from[0]; x <= to[0]; ++x) {
+              const Eigen::Vector3f v = grid2mask * Eigen::Vector3f (x, y, z);
+              ssize_t lower[3], upper[3];
+              for (size_t axis = 0; axis != 3; ++axis) {
+                lower[axis] = std::round (v[axis] + lower_offset[axis]);
+                upper[axis] = std::round (v[axis] + upper_offset[axis]);
+              }
+              size_t count = 0, total = 0;
+              for (mask.index(2) = lower[2]; mask.index(2) <= upper[2]; ++mask.index(2)) {
+                for (mask.index(1) = lower[1]; mask.index(1) <= upper[1]; ++mask.index(1)) {
+                  for (mask.index(0) = lower[0]; mask.index(0) <= upper[0]; ++mask.index(0)) {
+                    ++total;
+                    if (!is_out_of_bounds (mask, 0, 3) && mask.value())
+                      ++count;
+                  }
+                }
+              }
+              const size_t cell = x + dim[0] * (y + dim[1] * z);
+              if (count == total)
+                set_inside (cell);
+              else if (count)
+                add_boundary (cell, index);
+            }
+          }
+        }
+      }
+
+
+
+      void ROILookup::add_boundary (const size_t cell, const size_t index)
+      {
+        boundary[cell] = true;
+        boundary_rois[cell].push_back (index);
+      }
+
+
+
+      //CONF option: TrackROILookup
+      //CONF default: 1 (true)
+      //CONF Specifies whether the regions of interest used to select
+      //CONF streamlines (e.g. in tckgen and tckedit) should be rasterised
+      //CONF into a common lookup grid, such that each streamline vertex can
+      //CONF be tested against all regions at once. Otherwise, each vertex is
+      //CONF tested against each region in turn.
+
+      void ROISet::build_lookup ()
+      {
+        lookup.reset();
+        if (R.empty() || !File::Config::get_bool ("TrackROILookup", true))
+          return;
+        try {
+          lookup.reset (new ROILookup (R));
+          DEBUG ("ROI lookup grid constructed with " + str(lookup->num_cells()) + " cells, of which " + str(lookup->num_boundary_cells()) + " require explicit testing");
+        } catch (Exception& e) {
+          DEBUG ("ROI lookup grid not constructed (" + e[0] + "); ROIs will be tested individually");
+        }
+      }
+
+
     }
   }
 }
@@ -16,7 +16,10 @@
 #ifndef __dwi_tractography_roi_h__
 #define __dwi_tractography_roi_h__
 
+#include <unordered_map>
+
 #include "app.h"
+#include "bitset.h"
 #include "image.h"
 #include "image.h"
 #include "interp/linear.h"
@@ -115,6 +118,90 @@ namespace MR
           float radius, radius2;
           std::shared_ptr<Mask> mask;
 
+          friend class ROILookup;
+
+      };
+
+
+
+
+      // A rasterised representation of a set of ROIs, storing for each cell of a
+      //   common grid a bitmask of those ROIs that entirely contain that cell; the
+      //   membership of a point in all ROIs can then be determined from a single
+      //   transformation and memory lookup. Only in those cells through which the
+      //   boundary of an ROI passes is the exact test of that ROI performed.
+      class ROILookup { MEMALIGN(ROILookup)
+        public:
+          using transform_type = Eigen::Transform<float, 3, Eigen::AffineCompact>;
+
+          ROILookup (const vector<ROI>& rois);
+
+          bool contains (const Eigen::Vector3f& p, const vector<ROI>& rois) const
+          {
+            const size_t cell = get_cell (p);
+            if (cell == invalid)
+              return false;
+            for (size_t w = 0; w != words_per_cell; ++w)
+              if (inside[cell*words_per_cell + w])
+                return true;
+            if (boundary[cell]) {
+              for (auto n : boundary_rois.find (cell)->second)
+                if (rois[n].contains (p)) return true;
+            }
+            return false;
+          }
+
+          void contains (const Eigen::Vector3f& p, const vector<ROI>& rois, vector<bool>& retval) const
+          {
+            const size_t cell = get_cell (p);
+            if (cell == invalid)
+              return;
+            const uint64_t* const data = &inside[cell*words_per_cell];
+            for (size_t n = 0; n != rois.size(); ++n)
+              if (data[n/64] & (uint64_t(1) << (n%64))) retval[n] = true;
+            if (boundary[cell]) {
+              for (auto n : boundary_rois.find (cell)->second)
+                if (!retval[n] && rois[n].contains (p)) retval[n] = true;
+            }
+          }
+
+          size_t num_cells () const { return dim[0]*dim[1]*dim[2]; }
+          size_t num_boundary_cells () const { return boundary_rois.size(); }
+
+          // Upper limit on the memory used to store cell contents
+          static constexpr size_t max_bytes = 256*1024*1024;
+
+        private:
+          static constexpr size_t invalid = std::numeric_limits<size_t>::max();
+
+          // cells are located by rounding the coordinates of each point on the
+          //   grid (scanner2grid), then offsetting by the integer position of the
+          //   grid origin, such that a mask defining the grid is sampled exactly
+          //   as in ROI::contains(); the combined transformations are used for
+          //   rasterisation
+          transform_type scanner2grid, scanner2voxel, voxel2scanner;
+          ssize_t origin[3];
+          size_t dim[3];
+          size_t words_per_cell;
+          vector<uint64_t> inside;
+          BitSet boundary;
+          std::unordered_map<size_t, vector<uint32_t>> boundary_rois;
+
+          size_t get_cell (const Eigen::Vector3f& p) const
+          {
+            const Eigen::Vector3f v = scanner2grid * p;
+            const ssize_t x = ssize_t(std::round (v[0])) - origin[0];
+            const ssize_t y = ssize_t(std::round (v[1])) - origin[1];
+            const ssize_t z = ssize_t(std::round (v[2])) - origin[2];
+            if (x < 0 || y < 0 || z < 0 || x >= ssize_t(dim[0]) || y >= ssize_t(dim[1]) || z >= ssize_t(dim[2]))
+              return invalid;
+            return x + dim[0] * (y + dim[1] * z);
+          }
+
+          void set_grid (const transform_type&, const transform_type&, const vector<ROI>&);
+          void rasterise_sphere (const ROI&, const size_t);
+          void rasterise_mask (const ROI&, const size_t);
+          void add_boundary (const size_t, const size_t);
       };
 
 
@@ -125,18 +212,28 @@ namespace MR
         public:
           ROISet () { }
 
-          void clear () { R.clear(); }
+          void clear () { R.clear(); lookup.reset(); }
           size_t size () const { return (R.size()); }
           const ROI& operator[] (size_t i) const { return (R[i]); }
-          void add (const ROI& roi) { R.push_back (roi); }
+          void add (const ROI& roi) { R.push_back (roi); lookup.reset(); }
+
+          // Rasterise all ROIs into a common lookup grid; this should be
+          //   called once all ROIs have been added to the set
+          void build_lookup ();
 
           bool contains (const Eigen::Vector3f& p) const {
+            if (lookup)
+              return lookup->contains (p, R);
             for (size_t n = 0; n < R.size(); ++n)
               if (R[n].contains (p)) return (true);
             return false;
           }
 
           void contains (const Eigen::Vector3f& p, vector<bool>& retval) const {
+            if (lookup) {
+              lookup->contains (p, R, retval);
+              return;
+            }
             for (size_t n = 0; n < R.size(); ++n)
               if (R[n].contains (p)) retval[n] = true;
           }
@@ -152,6 +249,7 @@ namespace MR
 
         private:
           vector<ROI> R;
+          std::shared_ptr<ROILookup> lookup;
       };
 
 
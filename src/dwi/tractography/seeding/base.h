@@ -71,6 +71,20 @@ namespace MR
       }
 
 
+      // Compact list of the voxels with non-zero value, in the order of traversal
+      //   of the per-voxel seeders (i.e. with the third axis varying fastest)
+      template <class ImageType>
+      vector<Eigen::Vector3i> get_voxels (ImageType& data)
+      {
+        vector<Eigen::Vector3i> voxels;
+        for (auto l = Loop ({ 2, 1, 0 }) (data); l; ++l) {
+          if (data.value())
+            voxels.push_back (Eigen::Vector3i (data.index(0), data.index(1), data.index(2)));
+        }
+        return voxels;
+      }
+
+
       template <class ImageType>
       float get_volume (ImageType& data)
       {
@@ -44,14 +44,9 @@ namespace MR
 
         bool SeedMask::get_seed (Eigen::Vector3f& p) const
         {
-          auto seed = mask;
-          do {
-            seed.index(0) = std::uniform_int_distribution<int>(0, mask.size(0)-1)(*rng);
-            seed.index(1) = std::uniform_int_distribution<int>(0, mask.size(1)-1)(*rng);
-            seed.index(2) = std::uniform_int_distribution<int>(0, mask.size(2)-1)(*rng);
-          } while (!seed.value());
+          const Eigen::Vector3i& v (voxels[std::uniform_int_distribution<size_t> (0, voxels.size()-1) (*rng)]);
           std::uniform_real_distribution<float> uniform;
-          p = { seed.index(0)+uniform(*rng)-0.5f, seed.index(1)+uniform(*rng)-0.5f, seed.index(2)+uniform(*rng)-0.5f };
+          p = { v[0]+uniform(*rng)-0.5f, v[1]+uniform(*rng)-0.5f, v[2]+uniform(*rng)-0.5f };
           p = (*mask.voxel2scanner) * p;
           return true;
         }
@@ -63,33 +58,13 @@ namespace MR
 
         bool Random_per_voxel::get_seed (Eigen::Vector3f& p) const
         {
-
-          std::lock_guard<std::mutex> lock (mutex);
-
-          if (expired)
+          const size_t index = next.fetch_add (1, std::memory_order_relaxed);
+          if (index >= voxels.size() * num)
             return false;
 
-          if (mask.index(2) < 0 || ++inc == num) {
-            inc = 0;
-
-            do {
-              if (++mask.index(2) == mask.size(2)) {
-                mask.index(2) = 0;
-                if (++mask.index(1) == mask.size(1)) {
-                  mask.index(1) = 0;
-                  ++mask.index(0);
-                }
-              }
-            } while (mask.index(0) != mask.size(0) && !mask.value());
-
-            if (mask.index(0) == mask.size(0)) {
-              expired = true;
-              return false;
-            }
-          }
-
+          const Eigen::Vector3i& v (voxels[index / num]);
           std::uniform_real_distribution<float> uniform;
-          p = { mask.index(0)+uniform(*rng)-0.5f, mask.index(1)+uniform(*rng)-0.5f, mask.index(2)+uniform(*rng)-0.5f };
+          p = { v[0]+uniform(*rng)-0.5f, v[1]+uniform(*rng)-0.5f, v[2]+uniform(*rng)-0.5f };
           p = (*mask.voxel2scanner) * p;
           return true;
         }
@@ -103,37 +78,15 @@ namespace MR
 
         bool Grid_per_voxel::get_seed (Eigen::Vector3f& p) const
         {
-
-          std::lock_guard<std::mutex> lock (mutex);
-
-          if (expired)
+          const size_t per_voxel = Math::pow3 (os);
+          const size_t index = next.fetch_add (1, std::memory_order_relaxed);
+          if (index >= voxels.size() * per_voxel)
             return false;
 
-          if (++pos[2] >= os) {
-            pos[2] = 0;
-            if (++pos[1] >= os) {
-              pos[1] = 0;
-              if (++pos[0] >= os) {
-                pos[0] = 0;
-
-                do {
-                  if (++mask.index(2) == mask.size(2)) {
-                    mask.index(2) = 0;
-                    if (++mask.index(1) == mask.size(1)) {
-                      mask.index(1) = 0;
-                      ++mask.index(0);
-                    }
-                  }
-                } while (mask.index(0) != mask.size(0) && !mask.value());
-                if (mask.index(0) == mask.size(0)) {
-                  expired = true;
-                  return false;
-                }
-              }
-            }
-          }
-
-          p = { mask.index(0)+offset+(pos[0]*step), mask.index(1)+offset+(pos[1]*step), mask.index(2)+offset+(pos[2]*step) };
+          const Eigen::Vector3i& v (voxels[index / per_voxel]);
+          const size_t within = index % per_voxel;
+          const Eigen::Vector3i pos (within / (os*os), (within / os) % os, within % os);
+          p = { v[0]+offset+(pos[0]*step), v[1]+offset+(pos[1]*step), v[2]+offset+(pos[2]*step) };
           p = (*mask.voxel2scanner) * p;
           return true;
 
@@ -141,15 +94,16 @@ namespace MR
 
 
         Rejection::Rejection (const std::string& in) :
-          Base (in, "rejection sampling", MAX_TRACKING_SEED_ATTEMPTS_RANDOM),
+          Base (in, "rejection sampling", MAX_TRACKING_SEED_ATTEMPTS_RANDOM)
 #ifdef REJECTION_SAMPLING_USE_INTERPOLATION
-          interp (in),
-#endif
+          , interp (in),
           max (0.0)
+#endif
         {
           auto vox = Image<float>::open (in);
           if (!(vox.ndim() == 3 || (vox.ndim() == 4 && vox.size(3) == 1)))
             throw Exception ("Seed image must be a 3D image");
+#ifdef REJECTION_SAMPLING_USE_INTERPOLATION
           vector<size_t> bottom (3, std::numeric_limits<size_t>::max());
           vector<size_t> top    (3, 0);
 
@@ -188,11 +142,26 @@ namespace MR
           volume *= buf.spacing(0) * buf.spacing(1) * buf.spacing(2);
 
           copy (sub, buf, 0, 3);
-#ifdef REJECTION_SAMPLING_USE_INTERPOLATION
           interp = Interp::Linear<Image<float>> (buf);
 #else
-          image = buf;
-          voxel2scanner = Transform (image).voxel2scanner.cast<float>();
+          vector<default_type> weights;
+          for (auto i = Loop (0,3) (vox); i; ++i) {
+            const float value = vox.value();
+            if (value && std::isfinite (value)) {
+              if (value < 0.0)
+                throw Exception ("Cannot have negative values in an image used for rejection sampling!");
+              voxels.push_back (Eigen::Vector3i (vox.index(0), vox.index(1), vox.index(2)));
+              weights.push_back (value);
+              volume += value;
+            }
+          }
+
+          if (voxels.empty())
+            throw Exception ("Cannot use image " + in + " for rejection sampling - image is empty");
+
+          volume *= vox.spacing(0) * vox.spacing(1) * vox.spacing(2);
+          table = Math::AliasTable (weights);
+          voxel2scanner = Transform (vox).voxel2scanner.cast<float>();
 #endif
         }
 
@@ -216,15 +185,8 @@ namespace MR
           } while (seed.value() < selector);
           p = interp.voxel2scanner * pos;
 #else
-          auto seed = image;
-          float selector;
-          do {
-            seed.index(0) = std::uniform_int_distribution<int> (0, image.size(0)-1) (*rng);
-            seed.index(1) = std::uniform_int_distribution<int> (0, image.size(1)-1) (*rng);
-            seed.index(2) = std::uniform_int_distribution<int> (0, image.size(2)-1) (*rng);
-            selector = uniform (*rng) * max;
-          } while (seed.value() < selector);
-          p = { seed.index(0)+uniform(*rng)-0.5f, seed.index(1)+uniform(*rng)-0.5f, seed.index(2)+uniform(*rng)-0.5f };
+          const Eigen::Vector3i& v (voxels[table (*rng)]);
+          p = { v[0]+uniform(*rng)-0.5f, v[1]+uniform(*rng)-0.5f, v[2]+uniform(*rng)-0.5f };
           p = voxel2scanner * p;
 #endif
           return true;
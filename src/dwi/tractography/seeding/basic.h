@@ -18,10 +18,12 @@
 
 #include "dwi/tractography/roi.h"
 #include "dwi/tractography/seeding/base.h"
+#include "math/alias_table.h"
 
 
-// By default, the rejection sampler will perform its sampling based on image intensity values,
-//   and then randomly select a position within that voxel
+// By default, the "rejection" sampler will select a voxel with probability proportional
+//   to its image intensity value (without any actual rejection), and then randomly select
+//   a position within that voxel
 // Use this flag to instead perform rejection sampling on the trilinear-interpolated value
 //   at each trial seed point
 //#define REJECTION_SAMPLING_USE_INTERPOLATION
@@ -67,14 +69,17 @@ namespace MR
           public:
             SeedMask (const std::string& in) :
               Base (in, "random seeding mask", MAX_TRACKING_SEED_ATTEMPTS_RANDOM),
-              mask (in) {
-                volume = get_count (mask) * mask.spacing(0) * mask.spacing(1) * mask.spacing(2);
+              mask (in),
+              voxels (get_voxels (mask)) {
+                volume = voxels.size() * mask.spacing(0) * mask.spacing(1) * mask.spacing(2);
               }
 
             virtual bool get_seed (Eigen::Vector3f& p) const override;
 
           private:
             Mask mask;
+            // Seeds are drawn from a compact list of mask voxels rather than the whole image grid
+            const vector<Eigen::Vector3i> voxels;
 
         };
 
@@ -87,22 +92,22 @@ namespace MR
             Random_per_voxel (const std::string& in, const size_t num_per_voxel) :
               Base (in, "random per voxel", MAX_TRACKING_SEED_ATTEMPTS_FIXED),
               mask (in),
+              voxels (get_voxels (mask)),
               num (num_per_voxel),
-              inc (0),
-              expired (false) {
-                count = get_count (mask) * num_per_voxel;
-                mask.index(0) = 0; mask.index(1) = 0; mask.index(2) = -1;
+              next (0) {
+                count = voxels.size() * num_per_voxel;
               }
 
             virtual bool get_seed (Eigen::Vector3f& p) const override;
             virtual ~Random_per_voxel() { }
 
           private:
-            mutable Mask mask;
+            Mask mask;
+            const vector<Eigen::Vector3i> voxels;
             const size_t num;
 
-            mutable uint32_t inc;
-            mutable bool expired;
+            // Index of the next seed to be generated; voxel is next / num
+            mutable std::atomic<size_t> next;
         };
 
 
@@ -114,12 +119,12 @@ namespace MR
             Grid_per_voxel (const std::string& in, const size_t os_factor) :
               Base (in, "grid per voxel", MAX_TRACKING_SEED_ATTEMPTS_FIXED),
               mask (in),
+              voxels (get_voxels (mask)),
               os (os_factor),
-              pos (os, os, os),
               offset (-0.5 + (1.0 / (2*os))),
               step (1.0 / os),
-              expired (false) {
-                count = get_count (mask) * Math::pow3 (os_factor);
+              next (0) {
+                count = voxels.size() * Math::pow3 (os_factor);
               }
 
             virtual ~Grid_per_voxel() { }
@@ -127,11 +132,13 @@ namespace MR
 
 
           private:
-            mutable Mask mask;
+            Mask mask;
+            const vector<Eigen::Vector3i> voxels;
             const int os;
-            mutable Eigen::Vector3i pos;
             const float offset, step;
-            mutable bool expired;
+
+            // Index of the next seed to be generated; voxel is next / os^3
+            mutable std::atomic<size_t> next;
 
         };
 
@@ -149,11 +156,14 @@ namespace MR
           private:
 #ifdef REJECTION_SAMPLING_USE_INTERPOLATION
             Interp::Linear<Image<float>> interp;
+            float max;
 #else
-            Image<float> image;
+            // Voxels with non-zero intensity, selected in proportion to
+            //   their intensity using an alias table; draws never fail
+            vector<Eigen::Vector3i> voxels;
+            Math::AliasTable table;
             transform_type voxel2scanner;
 #endif
-            float max;
 
         };
 
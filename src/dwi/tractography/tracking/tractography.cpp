@@ -131,6 +131,10 @@ namespace MR
         for (size_t i = 0; i < opt.size(); ++i)
           properties.mask.add (ROI (opt[i][0]));
 
+        properties.include.build_lookup();
+        properties.exclude.build_lookup();
+        properties.mask.build_lookup();
+
         opt = get_options ("stop");
         if (opt.size()) {
           if (properties.include.size())
@@ -263,6 +263,12 @@ namespace MR
           log_stream = stream;
         }
 
+        // Provide smoothed versions of im2 that have been pre-computed (e.g. for a template
+        //   image shared between many registrations)
+        void set_im2_cache (std::shared_ptr<MultiResolutionCache> cache) {
+          im2_cache = cache;
+        }
+
 
         Header get_midway_header () {
           return Header(midway_image_header);
@@ -399,7 +405,7 @@ namespace MR
               INFO ("smoothing image 1");
               auto im1_smoothed = Registration::multi_resolution_lmax (im1_image, stage.scale_factor, do_reorientation, stage.fod_lmax);
               INFO ("smoothing image 2");
-              auto im2_smoothed = Registration::multi_resolution_lmax (im2_image, stage.scale_factor, do_reorientation, stage.fod_lmax);
+              auto im2_smoothed = Registration::multi_resolution_lmax (im2_image, stage.scale_factor, do_reorientation, stage.fod_lmax, im2_cache.get());
 
               Filter::Resize midway_resize_filter (midway_image_header);
               midway_resize_filter.set_scale_factor (stage.scale_factor);
@@ -568,6 +574,7 @@ namespace MR
         bool do_reorientation;
         Eigen::MatrixXd aPSF_directions;
         const bool analyse_descent;
+        std::shared_ptr<MultiResolutionCache> im2_cache;
 
         Header midway_image_header;
     };
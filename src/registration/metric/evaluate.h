@@ -94,11 +94,8 @@ namespace MR
                 std::shared_ptr<Image<default_type> > im2_image_reoriented;
                 im1_image_reoriented = make_shared<Image<default_type>>(Image<default_type>::scratch (params.im1_image));
                 im2_image_reoriented = make_shared<Image<default_type>>(Image<default_type>::scratch (params.im2_image));
-                {
-                   LogLevelLatch log_level (0);
-                  Registration::Transform::reorient (params.im1_image, *im1_image_reoriented, params.transformation.get_transform_half(), directions);
-                  Registration::Transform::reorient (params.im2_image, *im2_image_reoriented, params.transformation.get_transform_half_inverse(), directions);
-                }
+                Registration::Transform::reorient (params.im1_image, *im1_image_reoriented, params.transformation.get_transform_half(), directions);
+                Registration::Transform::reorient (params.im2_image, *im2_image_reoriented, params.transformation.get_transform_half_inverse(), directions);
                 params.set_im1_iterpolator (*im1_image_reoriented);
                 params.set_im2_iterpolator (*im2_image_reoriented);
               }
@@ -218,11 +215,8 @@ namespace MR
                 std::shared_ptr<Image<default_type> > im2_image_reoriented;
                 im1_image_reoriented = make_shared<Image<default_type>>(Image<default_type>::scratch (params.im1_image));
                 im2_image_reoriented = make_shared<Image<default_type>>(Image<default_type>::scratch (params.im2_image));
-                {
-                   LogLevelLatch log_level (0);
-                  Registration::Transform::reorient (params.im1_image, *im1_image_reoriented, params.transformation.get_transform_half(), directions);
-                  Registration::Transform::reorient (params.im2_image, *im2_image_reoriented, params.transformation.get_transform_half_inverse(), directions);
-                }
+                Registration::Transform::reorient (params.im1_image, *im1_image_reoriented, params.transformation.get_transform_half(), directions);
+                Registration::Transform::reorient (params.im2_image, *im2_image_reoriented, params.transformation.get_transform_half_inverse(), directions);
                 params.set_im1_iterpolator (*im1_image_reoriented);
                 params.set_im2_iterpolator (*im2_image_reoriented);
               }
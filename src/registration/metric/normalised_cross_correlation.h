@@ -242,7 +242,7 @@ namespace MR
 
                 auto cc_image = cc_image_header.template get_image <ProcessedImageValueType>().with_direct_io(Stride::contiguous_along_axis(3));
                 {
-                  LogLevelLatch log_level (0);
+                  ProgressBar::Hide hide_progress;
                   if (parameters.im1_mask.valid() or parameters.im2_mask.valid())
                     cc_mask = cc_mask_header.template get_image<bool>();
                   if (parameters.im1_mask.valid() and !parameters.im2_mask.valid())
@@ -16,6 +16,11 @@
 #ifndef __registration_multi_resolution_lmax_h__
 #define __registration_multi_resolution_lmax_h__
 
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include "image.h"
 #include "adapter/subset.h"
 #include "filter/smooth.h"
 
@@ -50,6 +55,60 @@ namespace MR
       smooth_filter (smoothed);
       return smoothed;
     }
+
+
+
+    // Stores the smoothed versions of a single image for each multi-resolution level, such
+    //   that these are only computed once when that image is registered against many others
+    //   (e.g. a template); the returned images share their data, and must only be read from
+    class MultiResolutionCache
+    { NOMEMALIGN
+      public:
+        using ImageType = Image<default_type>;
+
+        MultiResolutionCache (const ImageType& input) :
+            input (input) { }
+
+        ImageType operator() (const default_type scale_factor, const bool do_reorientation, const int lmax)
+        {
+          const std::tuple<default_type, bool, int> key (scale_factor, do_reorientation, do_reorientation ? lmax : 0);
+          std::lock_guard<std::mutex> lock (mutex);
+          auto existing = cache.find (key);
+          if (existing != cache.end())
+            return existing->second;
+          ImageType smoothed = multi_resolution_lmax (input, scale_factor, do_reorientation, lmax);
+          cache.insert (std::make_pair (key, smoothed));
+          return smoothed;
+        }
+
+      private:
+        ImageType input;
+        std::map<std::tuple<default_type, bool, int>, ImageType> cache;
+        std::mutex mutex;
+    };
+
+
+
+    // Use the cache if one has been provided for this image; only images of the
+    //   type stored by the cache can be retrieved from it
+    template <class ImageType>
+    FORCE_INLINE ImageType multi_resolution_lmax (ImageType& input,
+                                                  const default_type scale_factor,
+                                                  const bool do_reorientation,
+                                                  const int lmax,
+                                                  MultiResolutionCache*)
+    {
+      return multi_resolution_lmax (input, scale_factor, do_reorientation, lmax);
+    }
+
+    inline MultiResolutionCache::ImageType multi_resolution_lmax (MultiResolutionCache::ImageType& input,
+                                                                  const default_type scale_factor,
+                                                                  const bool do_reorientation,
+                                                                  const int lmax,
+                                                                  MultiResolutionCache* cache)
+    {
+      return cache ? (*cache) (scale_factor, do_reorientation, lmax) : multi_resolution_lmax (input, scale_factor, do_reorientation, lmax);
+    }
   }
 }
 #endif
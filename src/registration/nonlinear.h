@@ -18,6 +18,7 @@
 
 #include "image.h"
 #include "types.h"
+#include "file/config.h"
 
 #include "filter/warp.h"
 #include "filter/resize.h"
@@ -60,6 +61,16 @@ namespace MR
             fod_lmax[0] = 0;
             fod_lmax[1] = 2;
             fod_lmax[2] = 4;
+            //CONF option: RegNlWarpInvertNeighbourInit
+            //CONF default: 0 (false)
+            //CONF Non-linear registration: when updating the inverse warps, also consider the
+            //CONF solution at the preceding voxel along each image row as an initial estimate.
+            invert_parameters.neighbour_init = File::Config::get_bool ("RegNlWarpInvertNeighbourInit", false);
+            //CONF option: RegNlWarpInvertCoarseFactor
+            //CONF default: 1
+            //CONF Non-linear registration: if greater than one, initialise the inverse warps using an
+            //CONF inversion on a grid downsampled by this factor.
+            invert_parameters.coarse_factor = std::max (1, File::Config::get_int ("RegNlWarpInvertCoarseFactor", 1));
         }
 
 
@@ -138,7 +149,7 @@ namespace MR
                                                                 + midway_image_header_resized.spacing(2)) / 3.0);
 
               auto im1_smoothed = Registration::multi_resolution_lmax (im1_image, scale_factor[level], do_reorientation, fod_lmax[level]);
-              auto im2_smoothed = Registration::multi_resolution_lmax (im2_image, scale_factor[level], do_reorientation, fod_lmax[level]);
+              auto im2_smoothed = Registration::multi_resolution_lmax (im2_image, scale_factor[level], do_reorientation, fod_lmax[level], im2_cache.get());
 
               DEBUG ("Initialising scratch images");
               Header warped_header (midway_image_header_resized);
@@ -169,7 +180,7 @@ namespace MR
                 } else {
                   DEBUG ("Upsampling fields");
                   {
-                    LogLevelLatch level(0);
+                    ProgressBar::Hide hide_progress;
                     im1_to_mid = reslice (*im1_to_mid, field_header);
                     im2_to_mid = reslice (*im2_to_mid, field_header);
                     mid_to_im1 = reslice (*mid_to_im1, field_header);
@@ -216,7 +227,7 @@ namespace MR
 
                 DEBUG ("warping input images");
                 {
-                  LogLevelLatch level (0);
+                  ProgressBar::Hide hide_progress;
                   Filter::warp<Interp::Linear> (im1_smoothed, im1_warped, im1_deform_field, 0.0);
                   Filter::warp<Interp::Linear> (im2_smoothed, im2_warped, im2_deform_field, 0.0);
                 }
@@ -231,13 +242,13 @@ namespace MR
                 Im1MaskType im1_mask_warped;
                 if (im1_mask.valid()) {
                   im1_mask_warped = Im1MaskType::scratch (midway_image_header_resized);
-                  LogLevelLatch level (0);
+                  ProgressBar::Hide hide_progress;
                   Filter::warp<Interp::Linear> (im1_mask, im1_mask_warped, im1_deform_field, 0.0);
                 }
                 Im1MaskType im2_mask_warped;
                 if (im2_mask.valid()) {
                   im2_mask_warped = Im1MaskType::scratch (midway_image_header_resized);
-                  LogLevelLatch level (0);
+                  ProgressBar::Hide hide_progress;
                   Filter::warp<Interp::Linear> (im2_mask, im2_mask_warped, im2_deform_field, 0.0);
                 }
 
@@ -267,9 +278,14 @@ namespace MR
 
                   DEBUG ("inverting displacement field");
                   {
-                    LogLevelLatch level (0);
-                    Warp::invert_displacement (*im1_to_mid, *mid_to_im1);
-                    Warp::invert_displacement (*im2_to_mid, *mid_to_im2);
+                    Warp::InvertStatistics im1_statistics, im2_statistics;
+                    {
+                      ProgressBar::Hide hide_progress;
+                      im1_statistics = Warp::invert_displacement (*im1_to_mid, *mid_to_im1, invert_parameters);
+                      im2_statistics = Warp::invert_displacement (*im2_to_mid, *mid_to_im2, invert_parameters);
+                    }
+                    DEBUG ("  im1 warp inversion: " + im1_statistics.info());
+                    DEBUG ("  im2 warp inversion: " + im2_statistics.info());
                   }
 
 
@@ -369,6 +385,12 @@ namespace MR
             disp_smoothing = voxel_fwhm;
           }
 
+          // Provide smoothed versions of im2 that have been pre-computed (e.g. for a template
+          //   image shared between many registrations)
+          void set_im2_cache (std::shared_ptr<MultiResolutionCache> cache) {
+            im2_cache = cache;
+          }
+
           void set_lmax (const vector<int>& lmax) {
             for (size_t i = 0; i < lmax.size (); ++i)
               if (lmax[i] < 0 || lmax[i] % 2)
@@ -476,6 +498,8 @@ namespace MR
           Eigen::MatrixXd aPSF_directions;
           bool do_reorientation;
           vector<int> fod_lmax;
+          std::shared_ptr<MultiResolutionCache> im2_cache;
+          Warp::InvertParameters invert_parameters;
 
           transform_type im1_to_mid_linear;
           transform_type im2_to_mid_linear;
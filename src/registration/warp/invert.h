@@ -16,9 +16,16 @@
 #ifndef __registration_warp_invert_h__
 #define __registration_warp_invert_h__
 
+#include <memory>
+#include <mutex>
+
 #include "image.h"
 #include "interp/linear.h"
+#include "algo/loop.h"
+#include "algo/threaded_copy.h"
 #include "algo/threaded_loop.h"
+#include "filter/reslice.h"
+#include "filter/resize.h"
 #include "registration/warp/convert.h"
 #include "transform.h"
 
@@ -29,95 +36,247 @@ namespace MR
     namespace Warp
     {
 
-      namespace {
+
+      /** \addtogroup Registration
+        @{ */
+
+      //! Parameters controlling the iterative inversion of a warp field
+      class InvertParameters { NOMEMALIGN
+        public:
+          InvertParameters () :
+              max_iter (50),
+              error_tolerance (0.0001),
+              neighbour_init (false),
+              coarse_factor (1) { }
+
+          //! maximum number of fixed-point iterations per voxel
+          size_t max_iter;
+          //! convergence tolerance, as a fraction of the mean voxel size
+          default_type error_tolerance;
+          //! also consider the solution of the preceding voxel along the same row as an initial estimate
+          bool neighbour_init;
+          //! if greater than one, first invert on a grid downsampled by this factor, and use the result to initialise the full resolution inversion
+          size_t coarse_factor;
+      };
 
 
-      class DisplacementThreadKernel { MEMALIGN(DisplacementThreadKernel)
 
+      //! Convergence statistics of the iterative inversion of a warp field
+      class InvertStatistics { NOMEMALIGN
         public:
-          DisplacementThreadKernel (Image<default_type> & displacement,
-                        Image<default_type> & displacement_inverse,
-                        const size_t max_iter,
-                        const default_type error_tol) :
-                          displacement (displacement),
-                          transform (displacement_inverse),
-                          max_iter (max_iter),
-                          error_tolerance (error_tol) {}
-
-          void operator() (Image<default_type>& displacement_inverse)
-          {
-            Eigen::Vector3 voxel ((default_type)displacement_inverse.index(0), (default_type)displacement_inverse.index(1), (default_type)displacement_inverse.index(2));
-            Eigen::Vector3 truth = transform.voxel2scanner * voxel;
-            Eigen::Vector3 current = truth + Eigen::Vector3(displacement_inverse.row(3));
-
-            size_t iter = 0;
-            default_type error = std::numeric_limits<default_type>::max();
-            while (iter < max_iter && error > error_tolerance) {
-              error = update (current, truth);
-              ++iter;
-            }
-            displacement_inverse.row(3) = current - truth;
+          InvertStatistics () :
+              voxels (0),
+              converged (0),
+              failed (0),
+              iterations (0),
+              neighbour_init (0),
+              max_error (0.0) { }
+
+          void merge (const InvertStatistics& that) {
+            voxels += that.voxels;
+            converged += that.converged;
+            failed += that.failed;
+            iterations += that.iterations;
+            neighbour_init += that.neighbour_init;
+            max_error = std::max (max_error, that.max_error);
           }
 
-        private:
-
-          default_type update (Eigen::Vector3& current, const Eigen::Vector3& truth)
-          {
-            displacement.scanner (current);
-            Eigen::Vector3 discrepancy = truth - (current + Eigen::Vector3 (displacement.row(3)));
-            current += discrepancy;
-            return discrepancy.dot (discrepancy);
+          std::string info () const {
+            if (!voxels)
+              return "no voxels processed";
+            return str(voxels) + " voxels, " + str(converged) + " converged (" + str(100.0 * converged / default_type(voxels), 4) + "%), "
+                + str(failed) + " outside warp field of view, mean " + str(iterations / default_type(voxels), 4) + " iterations per voxel, "
+                + str(neighbour_init) + " initialised from neighbour, max final update " + str(std::sqrt (max_error), 4) + "mm";
           }
 
-          Interp::Linear<Image<default_type> > displacement;
-          MR::Transform transform;
-          const size_t max_iter;
-          default_type error_tolerance;
+          size_t voxels, converged, failed, iterations, neighbour_init;
+          default_type max_error;
       };
 
+      //! @}
+
 
-        class DeformationThreadKernel { MEMALIGN(DeformationThreadKernel)
+
+      namespace {
+
+
+        // Inverts one row (along the first image axis) of the warp field at a time, such
+        //   that the solution at the preceding voxel can be used to initialise the next one;
+        //   the inverse is stored as a displacement field if is_displacement is true,
+        //   and as a deformation field otherwise
+        template <bool is_displacement>
+        class InvertRowKernel { MEMALIGN(InvertRowKernel<is_displacement>)
 
           public:
-            DeformationThreadKernel (Image<default_type> & deform,
-                          Image<default_type> & inv_deform,
-                          const size_t max_iter,
-                          const default_type error_tol) :
-                            deform (deform),
-                            transform (inv_deform),
-                            max_iter (max_iter),
-                            error_tolerance (error_tol) {}
-
-            void operator() (Image<default_type>& inv_deform)
+            InvertRowKernel (Image<default_type>& field,
+                             Image<default_type>& inverse,
+                             const InvertParameters& parameters,
+                             const default_type error_tolerance,
+                             InvertStatistics& overall) :
+                field (field),
+                inverse (inverse),
+                transform (inverse),
+                max_iter (parameters.max_iter),
+                neighbour_init (parameters.neighbour_init),
+                error_tolerance (error_tolerance),
+                overall (overall),
+                mutex (new std::mutex) { }
+
+            ~InvertRowKernel () {
+              std::lock_guard<std::mutex> lock (*mutex);
+              overall.merge (local);
+            }
+
+            void operator() (const Iterator& pos)
             {
-              Eigen::Vector3 voxel ((default_type)inv_deform.index(0), (default_type)inv_deform.index(1), (default_type)inv_deform.index(2));
-              Eigen::Vector3 truth = transform.voxel2scanner * voxel;
-              Eigen::Vector3 current = inv_deform.row(3);
-
-              size_t iter = 0;
-              default_type error = std::numeric_limits<default_type>::max();
-              while (iter < max_iter && error > error_tolerance) {
-                error = update (current, truth);
-                ++iter;
+              assign_pos_of (pos, 1, 3).to (inverse);
+              bool have_previous = false;
+              Eigen::Vector3 previous_offset;
+              for (auto l = Loop (0) (inverse); l; ++l) {
+                Eigen::Vector3 voxel ((default_type)inverse.index(0), (default_type)inverse.index(1), (default_type)inverse.index(2));
+                const Eigen::Vector3 truth = transform.voxel2scanner * voxel;
+                Eigen::Vector3 current = is_displacement ? Eigen::Vector3 (truth + Eigen::Vector3 (inverse.row(3))) : Eigen::Vector3 (inverse.row(3));
+
+                // First iteration: if requested, select whichever initial estimate
+                //   is closer to the solution
+                Eigen::Vector3 discrepancy = residual (current, truth);
+                default_type error = discrepancy.squaredNorm();
+                if (neighbour_init && have_previous) {
+                  const Eigen::Vector3 candidate = truth + previous_offset;
+                  const Eigen::Vector3 candidate_discrepancy = residual (candidate, truth);
+                  // Also use the candidate if the default estimate maps outside the warp field
+                  const default_type candidate_error = candidate_discrepancy.squaredNorm();
+                  if (candidate_error < error || (!std::isfinite (error) && std::isfinite (candidate_error))) {
+                    current = candidate;
+                    discrepancy = candidate_discrepancy;
+                    error = discrepancy.squaredNorm();
+                    ++local.neighbour_init;
+                  }
+                }
+                current += discrepancy;
+
+                size_t iter = 1;
+                while (iter < max_iter && error > error_tolerance) {
+                  discrepancy = residual (current, truth);
+                  current += discrepancy;
+                  error = discrepancy.squaredNorm();
+                  ++iter;
+                }
+
+                ++local.voxels;
+                local.iterations += iter;
+                if (error <= error_tolerance)
+                  ++local.converged;
+                else if (!std::isfinite (error))
+                  ++local.failed;
+                local.max_error = std::max (local.max_error, error);
+
+                previous_offset = current - truth;
+                have_previous = true;
+                if (is_displacement)
+                  inverse.row(3) = previous_offset;
+                else
+                  inverse.row(3) = current;
               }
-              inv_deform.row(3) = current;
             }
 
           private:
 
-            default_type update (Eigen::Vector3& current, const Eigen::Vector3& truth)
+            // Difference between the target position and the position to which the
+            //   current estimate is mapped by the forward warp
+            Eigen::Vector3 residual (const Eigen::Vector3& current, const Eigen::Vector3& truth)
             {
-              deform.scanner (current);
-              Eigen::Vector3 discrepancy = truth - Eigen::Vector3 (deform.row(3));
-              current += discrepancy;
-              return discrepancy.dot (discrepancy);
+              field.scanner (current);
+              if (is_displacement)
+                return truth - (current + Eigen::Vector3 (field.row(3)));
+              return truth - Eigen::Vector3 (field.row(3));
             }
 
-            Interp::Linear<Image<default_type> > deform;
+            Interp::Linear<Image<default_type> > field;
+            Image<default_type> inverse;
             MR::Transform transform;
             const size_t max_iter;
-            default_type error_tolerance;
+            const bool neighbour_init;
+            const default_type error_tolerance;
+            InvertStatistics& overall;
+            InvertStatistics local;
+            std::shared_ptr<std::mutex> mutex;
         };
+
+
+
+        template <bool is_displacement>
+        InvertStatistics invert_rows (const std::string& message, Image<default_type>& field, Image<default_type>& inverse, const InvertParameters& parameters)
+        {
+          const default_type error_tolerance = parameters.error_tolerance * (field.spacing(0) + field.spacing(1) + field.spacing(2)) / 3;
+          InvertStatistics statistics;
+          {
+            InvertRowKernel<is_displacement> kernel (field, inverse, parameters, error_tolerance, statistics);
+            const vector<size_t> outer_axes ({ 1, 2 }), inner_axes ({ 0 });
+            if (message.size())
+              ThreadedLoop (message, inverse, outer_axes, inner_axes).run_outer (kernel);
+            else
+              ThreadedLoop (inverse, outer_axes, inner_axes).run_outer (kernel);
+          }
+          return statistics;
+        }
+
+
+
+        // Invert on a coarser grid, and use the result to initialise the inverse at full
+        //   resolution; the initial estimate is transferred between grids as a displacement
+        //   field, such that positions outside the coarse grid default to the identity
+        template <bool is_displacement>
+        InvertStatistics invert_coarse_to_fine (const std::string& message, Image<default_type>& field, Image<default_type>& inverse, const InvertParameters& parameters)
+        {
+          Filter::Resize resize_filter (inverse);
+          resize_filter.set_scale_factor (1.0 / default_type(parameters.coarse_factor));
+          Header coarse_header (resize_filter);
+          coarse_header.ndim() = 4;
+          coarse_header.size(3) = 3;
+
+          const vector<int> no_oversampling (3, 1);
+          auto fine_displacement = Image<default_type>::scratch (inverse);
+          if (is_displacement)
+            threaded_copy (inverse, fine_displacement);
+          else
+            deformation2displacement (inverse, fine_displacement);
+
+          auto coarse = Image<default_type>::scratch (coarse_header);
+          Filter::reslice<Interp::Linear> (fine_displacement, coarse, Adapter::NoTransform, no_oversampling, 0.0);
+          if (!is_displacement)
+            displacement2deformation (coarse, coarse);
+
+          const InvertStatistics coarse_statistics = invert_rows<is_displacement> ("", field, coarse, parameters);
+          DEBUG ("coarse warp inversion: " + coarse_statistics.info());
+
+          if (!is_displacement)
+            deformation2displacement (coarse, coarse);
+          // Voxels for which no inverse could be found must not contaminate their neighbours
+          for (auto l = Loop (coarse) (coarse); l; ++l) {
+            if (!std::isfinite (coarse.value()))
+              coarse.value() = 0.0;
+          }
+          Filter::reslice<Interp::Linear> (coarse, fine_displacement, Adapter::NoTransform, no_oversampling, 0.0);
+          if (is_displacement)
+            threaded_copy (fine_displacement, inverse);
+          else
+            displacement2deformation (fine_displacement, inverse);
+
+          return invert_rows<is_displacement> (message, field, inverse, parameters);
+        }
+
+
+
+        template <bool is_displacement>
+        InvertStatistics invert (const std::string& message, Image<default_type>& field, Image<default_type>& inverse, const InvertParameters& parameters)
+        {
+          if (parameters.coarse_factor > 1)
+            return invert_coarse_to_fine<is_displacement> (message, field, inverse, parameters);
+          return invert_rows<is_displacement> (message, field, inverse, parameters);
+        }
+
+
       }
 
 
@@ -127,16 +286,22 @@ namespace MR
           /*! Estimate the inverse of a deformation field
            * Note that the output inv_warp can be passed as either a zero field or an initial estimate
            */
-          FORCE_INLINE void invert_deformation (Image<default_type>& deform_field, Image<default_type>& inv_deform_field, bool is_initialised = false, size_t max_iter = 50, default_type error_tolerance = 0.0001)
+          FORCE_INLINE InvertStatistics invert_deformation (Image<default_type>& deform_field, Image<default_type>& inv_deform_field, bool is_initialised, const InvertParameters& parameters)
           {
             check_dimensions (deform_field, inv_deform_field);
-            error_tolerance *= (deform_field.spacing(0) + deform_field.spacing(1) + deform_field.spacing(2)) / 3;
 
             if (!is_initialised)
               displacement2deformation (inv_deform_field, inv_deform_field);
 
-            ThreadedLoop ("inverting warp field...", inv_deform_field, 0, 3)
-              .run (DeformationThreadKernel (deform_field, inv_deform_field, max_iter, error_tolerance), inv_deform_field);
+            return invert<false> ("inverting warp field...", deform_field, inv_deform_field, parameters);
+          }
+
+          FORCE_INLINE void invert_deformation (Image<default_type>& deform_field, Image<default_type>& inv_deform_field, bool is_initialised = false, size_t max_iter = 50, default_type error_tolerance = 0.0001)
+          {
+            InvertParameters parameters;
+            parameters.max_iter = max_iter;
+            parameters.error_tolerance = error_tolerance;
+            invert_deformation (deform_field, inv_deform_field, is_initialised, parameters);
           }
 
           /*! Estimate the inverse of a displacement field, output the inverse as a deformation field
@@ -154,13 +319,18 @@ namespace MR
           /*! Estimate the inverse of a displacement field
            * Note that the output inv_warp can be passed as either a zero field or an initial estimate
            */
-          FORCE_INLINE void invert_displacement (Image<default_type>& disp_field, Image<default_type>& inv_disp_field, size_t max_iter = 50, default_type error_tolerance = 0.0001)
+          FORCE_INLINE InvertStatistics invert_displacement (Image<default_type>& disp_field, Image<default_type>& inv_disp_field, const InvertParameters& parameters)
           {
             check_dimensions (disp_field, inv_disp_field);
-            error_tolerance *= (disp_field.spacing(0) + disp_field.spacing(1) + disp_field.spacing(2)) / 3;
+            return invert<true> ("inverting displacement field...", disp_field, inv_disp_field, parameters);
+          }
 
-            ThreadedLoop ("inverting displacement field...", inv_disp_field, 0, 3)
-              .run (DisplacementThreadKernel (disp_field, inv_disp_field, max_iter, error_tolerance), inv_disp_field);
+          FORCE_INLINE void invert_displacement (Image<default_type>& disp_field, Image<default_type>& inv_disp_field, size_t max_iter = 50, default_type error_tolerance = 0.0001)
+          {
+            InvertParameters parameters;
+            parameters.max_iter = max_iter;
+            parameters.error_tolerance = error_tolerance;
+            invert_displacement (disp_field, inv_disp_field, parameters);
           }
 
 
@@ -15,6 +15,8 @@
 
 #include "stats/cfe.h"
 
+#include <algorithm>
+
 namespace MR
 {
   namespace Stats
@@ -107,15 +109,53 @@ namespace MR
       value_type Enhancer::operator() (const vector_type& stats, vector_type& enhanced_stats) const
       {
         enhanced_stats = vector_type::Zero (stats.size());
+        if (!stats.size())
+          return 0.0;
+
+        // Generate the integration heights using the same cumulative summation as
+        //   the direct implementation, and cache the height term for each step
+        const value_type max_stat = stats.maxCoeff();
+        vector<value_type> heights, height_terms;
+        for (value_type h = this->dh; h < max_stat; h += this->dh) {
+          heights.push_back (h);
+          height_terms.push_back (std::pow (h, H));
+        }
+        if (heights.empty())
+          return 0.0;
+
+        // For each fixel, sort the statistics of its neighbours once; the extent at any
+        //   height is then the sum of connectivities of all neighbours beyond a given
+        //   position in this sorted list, which is precomputed as a suffix sum
+        vector<std::pair<value_type, connectivity_value_type>> neighbours;
+        vector<value_type> extents;
         value_type max_enhanced_stat = 0.0;
-        vector<NormMatrixElement>::const_iterator connected_fixel;
         for (size_t fixel = 0; fixel < connectivity_matrix.size(); ++fixel) {
-          for (value_type h = this->dh; h < stats[fixel]; h +=  this->dh) {
-            value_type extent = 0.0;
-            for (connected_fixel = connectivity_matrix[fixel].begin(); connected_fixel != connectivity_matrix[fixel].end(); ++connected_fixel)
-              if (stats[connected_fixel->index()] > h)
-                extent += connected_fixel->value();
-            enhanced_stats[fixel] += std::pow (extent, E) * std::pow (h, H);
+          if (!(heights.front() < stats[fixel]))
+            continue;
+
+          neighbours.clear();
+          for (const auto& connected_fixel : connectivity_matrix[fixel]) {
+            const value_type connected_stat = stats[connected_fixel.index()];
+            if (connected_stat > heights.front())
+              neighbours.push_back (std::make_pair (connected_stat, connected_fixel.value()));
+          }
+          std::sort (neighbours.begin(), neighbours.end(),
+                     [] (const std::pair<value_type, connectivity_value_type>& a, const std::pair<value_type, connectivity_value_type>& b) { return a.first < b.first; });
+          extents.resize (neighbours.size() + 1);
+          extents[neighbours.size()] = 0.0;
+          for (size_t i = neighbours.size(); i > 0; --i)
+            extents[i-1] = extents[i] + neighbours[i-1].second;
+
+          size_t first_above = 0;
+          value_type extent_term = std::pow (extents[0], E);
+          for (size_t step = 0; step < heights.size() && heights[step] < stats[fixel]; ++step) {
+            if (first_above < neighbours.size() && !(neighbours[first_above].first > heights[step])) {
+              do {
+                ++first_above;
+              } while (first_above < neighbours.size() && !(neighbours[first_above].first > heights[step]));
+              extent_term = std::pow (extents[first_above], E);
+            }
+            enhanced_stats[fixel] += extent_term * height_terms[step];
           }
           if (enhanced_stats[fixel] > max_enhanced_stat)
             max_enhanced_stat = enhanced_stats[fixel];
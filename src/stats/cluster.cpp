@@ -40,6 +40,17 @@ namespace MR
 
 
 
+      bool ClusterSize::integrate (const vector_type& stats, const value_type dh, const value_type E, const value_type H, vector_type& enhanced_stats) const
+      {
+        // Filter::Connector applies the cluster-forming threshold in single precision
+        TFCE::integrate (connector.adjacent_indices,
+                         [] (const value_type value, const value_type h) { return value > float(h); },
+                         stats, dh, E, H, enhanced_stats);
+        return true;
+      }
+
+
+
     }
   }
 }
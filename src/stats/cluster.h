@@ -51,6 +51,8 @@ namespace MR
 
           value_type operator() (const vector_type&, const value_type, vector_type&) const override;
 
+          bool integrate (const vector_type&, const value_type, const value_type, const value_type, vector_type&) const override;
+
 
         protected:
           const Filter::Connector& connector;
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+#include <sys/stat.h>
+
+#include "stats/subjects.h"
+
+#include "header.h"
+#include "image.h"
+#include "progressbar.h"
+#include "thread_queue.h"
+#include "algo/loop.h"
+#include "file/path.h"
+
+
+namespace MR
+{
+  namespace Stats
+  {
+    namespace Subjects
+    {
+
+
+
+      const App::OptionGroup Options ()
+      {
+        using namespace App;
+        return OptionGroup ("Options for loading subject data")
+          + Option ("data_cache", "store the assembled data of all subjects in a single image file, "
+                                  "or read them from that file if it already exists and was generated "
+                                  "from the same subjects and processing parameters, and none of the subject "
+                                  "files has since changed in size or modification time. Subsequent analyses "
+                                  "of the same data (e.g. with a different design matrix) can thereby "
+                                  "avoid re-reading the data of each individual subject.")
+            + Argument ("image").type_image_out();
+      }
+
+
+
+      namespace
+      {
+
+        const char* const subjects_key = "stats subjects";
+        const char* const description_key = "stats data description";
+        const char* const files_key = "stats subject files";
+
+        // Size and modification time of each subject file, such that
+        //   changes to a file are detected even if its path is unchanged
+        std::string file_signatures (const vector<std::string>& subjects)
+        {
+          vector<std::string> signatures;
+          for (const auto& subject : subjects) {
+            struct stat info;
+            if (stat (subject.c_str(), &info))
+              throw Exception ("error querying subject file \"" + subject + "\": " + strerror (errno));
+            signatures.push_back (str(info.st_size) + " " + str(info.st_mtime));
+          }
+          return join (signatures, "\n");
+        }
+
+        bool read_cache (const std::string& path, matrix_type& data, const vector<std::string>& subjects, const std::string& description)
+        {
+          if (!Path::exists (path))
+            return false;
+          auto H = Header::open (path);
+          if (H.ndim() > 3 || H.size(0) != data.rows() || H.size(1) != data.cols() || (H.ndim() == 3 && H.size(2) != 1)) {
+            WARN ("dimensions of data cache image \"" + path + "\" do not match current data");
+            App::check_overwrite (path);
+            return false;
+          }
+          const auto subjects_it = H.keyval().find (subjects_key);
+          const auto description_it = H.keyval().find (description_key);
+          if (subjects_it == H.keyval().end() || subjects_it->second != join (subjects, "\n") ||
+              description_it == H.keyval().end() || description_it->second != description) {
+            WARN ("data cache image \"" + path + "\" was generated from different subjects or parameters");
+            App::check_overwrite (path);
+            return false;
+          }
+          const auto files_it = H.keyval().find (files_key);
+          if (files_it == H.keyval().end() || files_it->second != file_signatures (subjects)) {
+            WARN ("subject files have been modified since data cache image \"" + path + "\" was generated");
+            App::check_overwrite (path);
+            return false;
+          }
+          // Column-major strides match the layout of the data matrix, such
+          //   that a cache written by this function is used as-is
+          auto image = H.get_image<value_type>().with_direct_io (Stride::List ({ 1, 2, 3 }));
+          data = Eigen::Map<const matrix_type> (image.address(), data.rows(), data.cols());
+          INFO ("subject data read from cache image \"" + path + "\"");
+          return true;
+        }
+
+        void write_cache (const std::string& path, const matrix_type& data, const vector<std::string>& subjects, const std::string& description)
+        {
+          Header H;
+          H.ndim() = 3;
+          H.size(0) = data.rows();
+          H.size(1) = data.cols();
+          H.size(2) = 1;
+          for (size_t axis = 0; axis != 3; ++axis) {
+            H.stride(axis) = axis+1;
+            H.spacing(axis) = 1.0;
+          }
+          H.transform().setIdentity();
+          H.datatype() = DataType::from<value_type>();
+          H.keyval()[subjects_key] = join (subjects, "\n");
+          H.keyval()[description_key] = description;
+          H.keyval()[files_key] = file_signatures (subjects);
+          auto image = Image<value_type>::create (path, H);
+          for (auto l = Loop ("writing subject data cache", image) (image); l; ++l)
+            image.value() = data (image.index(0), image.index(1));
+        }
+
+      }
+
+
+
+      void load (matrix_type& data,
+                 const vector<std::string>& subjects,
+                 const std::string& description,
+                 std::function<void(size_t)> func,
+                 const std::string& message)
+      {
+        assert (size_t(data.cols()) == subjects.size());
+
+        auto opt = App::get_options ("data_cache");
+        const std::string cache_path = opt.size() ? std::string (opt[0][0]) : std::string();
+        if (cache_path.size() && read_cache (cache_path, data, subjects, description))
+          return;
+
+        {
+          ProgressBar progress (message, subjects.size());
+          size_t next = 0;
+          auto source = [&] (size_t& subject) {
+            if (next >= subjects.size())
+              return false;
+            subject = next++;
+            return true;
+          };
+          // Each subject writes only into its own column of the data matrix;
+          //   only the progress over all subjects is shown
+          auto loader = [&] (const size_t& subject, size_t& out) {
+            ProgressBar::Hide hide_progress;
+            func (subject);
+            out = subject;
+            return true;
+          };
+          auto sink = [&] (const size_t&) {
+            ++progress;
+            return true;
+          };
+          Thread::run_queue (source, size_t(), Thread::multi (loader), size_t(), sink);
+        }
+
+        if (cache_path.size())
+          write_cache (cache_path, data, subjects, description);
+      }
+
+
+
+    }
+  }
+}
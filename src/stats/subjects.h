@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+#ifndef __stats_subjects_h__
+#define __stats_subjects_h__
+
+#include <functional>
+
+#include "app.h"
+#include "types.h"
+#include "math/stats/typedefs.h"
+
+
+namespace MR
+{
+  namespace Stats
+  {
+    namespace Subjects
+    {
+
+      using value_type = Math::Stats::value_type;
+      using matrix_type = Math::Stats::matrix_type;
+
+
+
+      const App::OptionGroup Options ();
+
+
+
+      //! assemble the data of all subjects into the columns of \a data
+      /*! \a data must already be sized as (number of elements) x (number of
+       * subjects). For each subject, \a func (subject) is invoked to fill in
+       * the corresponding column of \a data; this is done concurrently for
+       * different subjects, such that the number of subject files open at any
+       * one time is bounded by the number of threads. Progress is displayed
+       * over all subjects using \a message; any progress bars created by
+       * \a func itself are hidden.
+       *
+       * If the -data_cache option has been specified and the cache file
+       * exists, was generated from the same list of subjects (each of which
+       * must be a file, whose size and modification time are also stored in
+       * the cache), and matches \a description (which should encode any
+       * parameters that influence the values of the data), \a data are read
+       * from that file instead and \a func is never invoked; otherwise, the
+       * assembled matrix is written to that file for use in subsequent runs. */
+      void load (matrix_type& data,
+                 const vector<std::string>& subjects,
+                 const std::string& description,
+                 std::function<void(size_t)> func,
+                 const std::string& message);
+
+
+
+    }
+  }
+}
+
+#endif
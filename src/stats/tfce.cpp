@@ -35,7 +35,11 @@ namespace MR
         + Argument ("value").type_float (0.0)
 
         + Option ("tfce_h", "tfce height exponent (default: " + str(default_h, 2) + ")")
-        + Argument ("value").type_float (0.0);
+        + Argument ("value").type_float (0.0)
+
+        + Option ("tfce_stepwise", "perform the tfce integration by identifying clusters separately at each height increment, "
+                                   "rather than in a single sweep over the sorted statistic values; this is considerably slower, "
+                                   "and provided for verification purposes");
 
         return result;
       }
@@ -44,6 +48,8 @@ namespace MR
 
       value_type Wrapper::operator() (const vector_type& in, vector_type& out) const
       {
+        if (!stepwise && enhancer->integrate (in, dH, E, H, out))
+          return out.maxCoeff();
         out = vector_type::Zero (in.size());
         const value_type max_input_value = in.maxCoeff();
         for (value_type h = dH; (h-dH) < max_input_value; h += dH) {
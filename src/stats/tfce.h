@@ -16,7 +16,10 @@
 #ifndef __stats_tfce_h__
 #define __stats_tfce_h__
 
+#include <algorithm>
+
 #include "thread_queue.h"
+#include "types.h"
 #include "filter/connected_components.h"
 #include "math/stats/permutation.h"
 #include "math/stats/typedefs.h"
@@ -48,16 +51,147 @@ namespace MR
           //   makes TFCE integration cleaner
           virtual value_type operator() (const vector_type& /*input_statistics*/, const value_type /*threshold*/, vector_type& /*enhanced_statistics*/) const = 0;
 
+          // Enhancers for which clusters are the connected components of a fixed
+          //   adjacency between elements can instead perform the complete TFCE
+          //   integration in a single sweep (see TFCE::integrate()); returns false
+          //   if this is not supported, in which case the threshold-based functor
+          //   is invoked separately for each height increment
+          virtual bool integrate (const vector_type& /*input_statistics*/, const value_type /*dh*/, const value_type /*E*/, const value_type /*H*/, vector_type& /*enhanced_statistics*/) const { return false; }
+
       };
 
 
 
 
+      /*! Perform TFCE integration in a single sweep over the sorted statistic values
+       *
+       * Rather than identifying clusters from scratch at every height increment,
+       * elements are sorted by statistic value once, and added in descending order
+       * to a union-find structure as the height decreases. Since the size of a
+       * cluster only changes when elements are added to it, its contribution to the
+       * enhanced statistic of all of its members can be accumulated analytically
+       * across the range of heights over which it remains unchanged; this is
+       * deferred to the cluster root, and propagated to the individual elements
+       * through the offsets stored along the union-find tree.
+       *
+       * \a adjacency provides the list of neighbours of each element, and
+       * \a is_active (value, height) determines whether an element with statistic
+       * \a value forms part of a cluster at \a height. Non-finite statistic values
+       * never form part of a cluster. The integration heights are those of
+       * TFCE::Wrapper, such that the results are identical within floating-point
+       * precision. */
+      template <class AdjacencyType, class ActiveFunctor>
+      value_type integrate (const AdjacencyType& adjacency, ActiveFunctor&& is_active,
+                            const vector_type& in, const value_type dh, const value_type E, const value_type H,
+                            vector_type& out)
+      {
+        const size_t num_elements = in.size();
+        out = vector_type::Zero (num_elements);
+
+        vector<uint32_t> order;
+        order.reserve (num_elements);
+        value_type max_input_value = -std::numeric_limits<value_type>::infinity();
+        for (size_t i = 0; i != num_elements; ++i) {
+          if (std::isfinite (in[i])) {
+            order.push_back (i);
+            max_input_value = std::max (max_input_value, in[i]);
+          }
+        }
+        if (order.empty())
+          return 0.0;
+        std::sort (order.begin(), order.end(), [&] (const uint32_t a, const uint32_t b) { return in[a] > in[b]; });
+
+        // Cumulative sum of the height term across integration steps
+        vector<value_type> heights, cumulative (1, 0.0);
+        for (value_type h = dh; (h-dh) < max_input_value; h += dh) {
+          heights.push_back (h);
+          cumulative.push_back (cumulative.back() + std::pow (h, H));
+        }
+
+        // For each element: the integration step at which it was added (-1 if never);
+        //   its parent in the union-find tree; and its offset relative to its parent.
+        //   For cluster roots, the offset is the accumulated enhanced statistic,
+        //   and 'since' is the last step for which this has not yet been accumulated
+        vector<ssize_t> activation (num_elements, -1), since (num_elements, -1);
+        vector<uint32_t> parent (num_elements), size (num_elements, 0);
+        vector<value_type> offset (num_elements, 0.0);
+        vector<uint32_t> path;
+
+        auto find = [&] (const uint32_t index) -> uint32_t {
+          uint32_t root = index;
+          while (parent[root] != root) {
+            path.push_back (root);
+            root = parent[root];
+          }
+          // Path compression: make offsets relative to the root
+          if (path.size() > 1) {
+            for (size_t i = path.size() - 1; i-- > 0;)
+              offset[path[i]] += offset[path[i+1]];
+          }
+          for (auto i : path)
+            parent[i] = root;
+          path.clear();
+          return root;
+        };
+
+        auto flush = [&] (const uint32_t root, const ssize_t step) {
+          offset[root] += std::pow (value_type(size[root]), E) * (cumulative[since[root]+1] - cumulative[step+1]);
+          since[root] = step;
+        };
+
+        size_t next = 0;
+        for (ssize_t step = ssize_t(heights.size()) - 1; step >= 0; --step) {
+          const value_type h = heights[step];
+          while (next != order.size() && is_active (in[order[next]], h)) {
+            const uint32_t index = order[next++];
+            activation[index] = since[index] = step;
+            parent[index] = index;
+            size[index] = 1;
+            for (const auto neighbour : adjacency[index]) {
+              if (activation[neighbour] < 0)
+                continue;
+              uint32_t a = find (index), b = find (neighbour);
+              if (a == b)
+                continue;
+              flush (a, step);
+              flush (b, step);
+              if (size[a] < size[b])
+                std::swap (a, b);
+              parent[b] = a;
+              offset[b] -= offset[a];
+              size[a] += size[b];
+            }
+          }
+        }
+
+        for (size_t i = 0; i != num_elements; ++i) {
+          if (activation[i] >= 0 && parent[i] == i)
+            flush (i, -1);
+        }
+
+        // The threshold-based implementation adds pow (0, E) to all elements outside of
+        //   any cluster, for each height at which at least one cluster exists
+        const value_type empty_term = std::pow (value_type(0), E);
+        const ssize_t num_active_steps = activation[order.front()] + 1;
+        for (size_t i = 0; i != num_elements; ++i) {
+          if (activation[i] >= 0) {
+            const uint32_t root = find (i);
+            out[i] = (root == i) ? offset[i] : offset[i] + offset[root];
+          }
+          if (empty_term)
+            out[i] += empty_term * (cumulative[num_active_steps] - cumulative[activation[i]+1]);
+        }
+
+        return out.maxCoeff();
+      }
+
+
+
       class Wrapper : public Stats::EnhancerBase
       { MEMALIGN (Wrapper)
         public:
-          Wrapper (const std::shared_ptr<TFCE::EnhancerBase> base) : enhancer (base), dH (NaN), E (NaN), H (NaN) { }
-          Wrapper (const std::shared_ptr<TFCE::EnhancerBase> base, const default_type dh, const default_type e, const default_type h) : enhancer (base), dH (dh), E (e), H (h) { }
+          Wrapper (const std::shared_ptr<TFCE::EnhancerBase> base) : enhancer (base), dH (NaN), E (NaN), H (NaN), stepwise (false) { }
+          Wrapper (const std::shared_ptr<TFCE::EnhancerBase> base, const default_type dh, const default_type e, const default_type h) : enhancer (base), dH (dh), E (e), H (h), stepwise (false) { }
           Wrapper (const Wrapper& that) = default;
           virtual ~Wrapper() { }
 
@@ -68,11 +202,16 @@ namespace MR
             H = height;
           }
 
+          // Disable the single-sweep integration (TFCE::integrate()) of enhancers that
+          //   support it, and instead label clusters separately at each height increment
+          void set_stepwise (const bool value) { stepwise = value; }
+
           value_type operator() (const vector_type&, vector_type&) const override;
 
         private:
           std::shared_ptr<Stats::TFCE::EnhancerBase> enhancer;
           value_type dH, E, H;
+          bool stepwise;
       };
 
 
@@ -20,6 +20,7 @@
 #include <map>
 
 #include "image_helpers.h"
+#include "thread_queue.h"
 #include "transform.h"
 #include "types.h"
 
@@ -143,8 +144,10 @@ namespace MR
 
 
     // Image-to-mesh conversion function using the Marching Cubes algorithm
+    // The image is divided into slabs along the z axis, which are processed
+    //   using up to nthreads threads
     template <class ImageType>
-    void image2mesh_mc (const ImageType& input_image, Mesh& out, const default_type threshold)
+    void image2mesh_mc (const ImageType& input_image, Mesh& out, const default_type threshold, const size_t nthreads = Thread::number_of_threads())
     {
       static const Vox neighbour_offsets[] = { Vox (0, 0, 0),
                                                Vox (1, 0, 0),
@@ -436,89 +439,190 @@ namespace MR
         {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
         {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1} };
 
-      VertexList vertices;
-      TriangleList triangles;
+      const Transform transform (input_image);
+      const int nx = input_image.size(0), ny = input_image.size(1), nz = input_image.size(2);
+
+      // Lattice points span [-1, size] along each axis, such that the surface
+      //   is closed at the image boundary. Output vertices are identified by
+      //   the lattice edge on which they lie; within a slab these are cached
+      //   in flat arrays for the lower & upper planes of the current layer of
+      //   cubes (edges along x & y) and for the edges spanning the layer (along z)
+      const size_t X = nx + 2, plane_size = X * (ny + 2);
+      constexpr uint32_t no_vertex = std::numeric_limits<uint32_t>::max();
+
+      // Where the output vertex for each cube edge is cached, relative to the
+      //   lower corner of the cube
+      class EdgeLocation { NOMEMALIGN
+        public:
+          int plane; // 0: lower plane, 1: upper plane, 2: spanning edges
+          size_t offset;
+      };
+      std::array<EdgeLocation, 12> edge_locations;
+      for (size_t edge_index = 0; edge_index != 12; ++edge_index) {
+        const Vox a = neighbour_offsets[edge_vertices[edge_index][0]];
+        const Vox b = neighbour_offsets[edge_vertices[edge_index][1]];
+        const Vox lower = a.min (b);
+        const size_t axis = (a[0] != b[0]) ? 0 : ((a[1] != b[1]) ? 1 : 2);
+        const size_t point = lower[1] * X + lower[0];
+        if (axis == 2)
+          edge_locations[edge_index] = { 2, point };
+        else
+          edge_locations[edge_index] = { lower[2], 2*point + axis };
+      }
+
+      // Each slab processes those cubes whose lower corner lies within a
+      //   range of z positions, generating its own vertices & triangles
+      //   (using slab-local vertex indices); vertices that lie on the planes
+      //   shared between adjacent slabs are reconciled afterwards
+      class Slab { NOMEMALIGN
+        public:
+          int from, to;
+          VertexList vertices;
+          TriangleList triangles;
+          vector<uint32_t> bottom, top;
+      };
+      const size_t num_layers = nz + 1;
+      const size_t num_slabs = std::max (size_t(1), std::min (num_layers, nthreads > 1 ? 4 * nthreads : size_t(1)));
+      vector<Slab> slabs (num_slabs);
+      for (size_t n = 0; n != num_slabs; ++n) {
+        slabs[n].from = int ((n * num_layers) / num_slabs) - 1;
+        slabs[n].to   = int (((n+1) * num_layers) / num_slabs) - 1;
+      }
+
+      auto process_slab = [&] (const size_t& slab_index) {
+        Slab& slab (slabs[slab_index]);
+        ImageType voxel (input_image);
+        vector<float> values_lower (plane_size), values_upper (plane_size);
+        vector<uint32_t> edges_lower (2*plane_size, no_vertex), edges_upper (2*plane_size, no_vertex), edges_spanning (plane_size, no_vertex);
+
+        auto load_plane = [&] (const int z, vector<float>& values) {
+          std::fill (values.begin(), values.end(), 0.0f);
+          if (z < 0 || z >= nz)
+            return;
+          voxel.index(2) = z;
+          for (voxel.index(1) = 0; voxel.index(1) != ny; ++voxel.index(1)) {
+            float* row = values.data() + (voxel.index(1)+1) * X + 1;
+            for (voxel.index(0) = 0; voxel.index(0) != nx; ++voxel.index(0))
+              row[voxel.index(0)] = voxel.value();
+          }
+        };
+
+        load_plane (slab.from, values_lower);
+        load_plane (slab.from + 1, values_upper);
+        float in_vertex_values[8];
+        Vox lower_corner;
+        for (lower_corner[2] = slab.from; lower_corner[2] != slab.to; ++lower_corner[2]) {
+          for (lower_corner[1] = -1; lower_corner[1] != ny; ++lower_corner[1]) {
+            for (lower_corner[0] = -1; lower_corner[0] != nx; ++lower_corner[0]) {
+
+              // This is our lower corner for our region of 8 voxels
+              const size_t point = (lower_corner[1]+1) * X + (lower_corner[0]+1);
+              uint8_t code = 0x00;
+              for (size_t neighbour_index = 0; neighbour_index != 8; ++neighbour_index) {
+                const Vox& offset (neighbour_offsets[neighbour_index]);
+                const vector<float>& values (offset[2] ? values_upper : values_lower);
+                in_vertex_values[neighbour_index] = values[point + offset[1] * X + offset[0]];
+                if (in_vertex_values[neighbour_index] > threshold)
+                  code |= (1 << neighbour_index);
+              }
+              // Our code here acts as a lookup index to the table cube_edge_flags
+              const uint32_t edge_flags = cube_edge_flags[code];
+              if (!edge_flags)
+                continue;
+              // Now we find out which edges are intersected, based on this flag
+              // For all relevant output vertices, we need to store the output index
+              //   of that vertex
+              std::array<uint32_t, 12> edge_to_output_vertex;
+              edge_to_output_vertex.fill (0);
+              for (size_t edge_index = 0; edge_index != 12; ++edge_index) {
+                if (edge_flags & (1 << edge_index)) {
+
+                  // Has a vertex already been generated somewhere along this edge?
+                  const EdgeLocation& location (edge_locations[edge_index]);
+                  uint32_t& existing = location.plane == 2 ?
+                                       edges_spanning[point + location.offset] :
+                                       (location.plane ? edges_upper : edges_lower)[2*point + location.offset];
+                  if (existing == no_vertex) {
+                    existing = slab.vertices.size();
+                    // Calculate the precise position of this vertex, based on the
+                    //   image intensities in the two relevant voxels
+                    const uint8_t vertex_index_zero = edge_vertices[edge_index][0];
+                    const uint8_t vertex_index_one  = edge_vertices[edge_index][1];
+                    const Vox vertex_position_zero = lower_corner + neighbour_offsets[vertex_index_zero];
+                    const Vox vertex_position_one  = lower_corner + neighbour_offsets[vertex_index_one];
+                    const default_type alpha = (threshold - in_vertex_values[vertex_index_zero]) / (in_vertex_values[vertex_index_one] - in_vertex_values[vertex_index_zero]);
+                    const Vertex pos_voxelspace = vertex_position_zero.cast<default_type>() + (alpha * (vertex_position_one - vertex_position_zero).cast<default_type>());
+                    slab.vertices.push_back (transform.voxel2scanner * pos_voxelspace);
+                  }
+                  edge_to_output_vertex[edge_index] = existing;
 
-      Transform transform (input_image);
-
-      ImageType voxel (input_image);
-      float in_vertex_values[8];
-      std::map< Vox, std::map<Vox, size_t> > input_vertex_pair_to_output_vertex_index_map;
-      Vox lower_corner;
-      for (lower_corner[2] = -1; lower_corner[2] != voxel.size(2); ++lower_corner[2]) {
-        for (lower_corner[1] = -1; lower_corner[1] != voxel.size(1); ++lower_corner[1]) {
-          for (lower_corner[0] = -1; lower_corner[0] != voxel.size(0); ++lower_corner[0]) {
-
-            // This is our lower corner for our region of 8 voxels
-            uint8_t code = 0x00;
-            for (size_t neighbour_index = 0; neighbour_index != 8; ++neighbour_index) {
-              assign_pos_of (lower_corner + neighbour_offsets[neighbour_index]).to (voxel);
-              in_vertex_values[neighbour_index] = 0.0f;
-              if (!is_out_of_bounds (voxel))
-                in_vertex_values[neighbour_index] = voxel.value();
-              if (in_vertex_values[neighbour_index] > threshold)
-                code |= (1 << neighbour_index);
-            }
-            // Our code here acts as a lookup index to the table cube_edge_flags
-            const uint32_t edge_flags = cube_edge_flags[code];
-            // Now we find out which edges are intersected, based on this flag
-            // For all relevant output vertices, we need to store the output index
-            //   of that vertex
-            std::array<uint32_t, 12> edge_to_output_vertex;
-            edge_to_output_vertex.fill (0);
-            for (size_t edge_index = 0; edge_index != 12; ++edge_index) {
-              if (edge_flags & (1 << edge_index)) {
-
-                // OK, so now we have two vertices corresponding to this edge
-                // However, we don't want to duplicate vertices
-                // Therefore, need to do a lookup
-                // Remember: we have the lower corner position, and 8 offsets from that
-                std::array<uint8_t, 2> vertex_indices;
-                std::array<Vox,     2> vertex_positions;
-
-                for (size_t i = 0; i != 2; ++i) {
-                  const uint8_t vertex_index = edge_vertices[edge_index][i];
-                  vertex_indices[i] = vertex_index;
-                  vertex_positions[i] = lower_corner + neighbour_offsets[vertex_index];
-                }
-                // Has a vertex already been generated somewhere along this edge?
-                auto lookup_zero_it = input_vertex_pair_to_output_vertex_index_map.find (vertex_positions[0]);
-                if (lookup_zero_it == input_vertex_pair_to_output_vertex_index_map.end())
-                  lookup_zero_it = input_vertex_pair_to_output_vertex_index_map.insert (std::make_pair (vertex_positions[0], std::map<Vox, size_t>())).first;
-                auto lookup_one_it = input_vertex_pair_to_output_vertex_index_map.find (vertex_positions[1]);
-                if (lookup_one_it == input_vertex_pair_to_output_vertex_index_map.end())
-                  lookup_one_it = input_vertex_pair_to_output_vertex_index_map.insert (std::make_pair (vertex_positions[1], std::map<Vox, size_t>())).first;
-                auto& lookup_zero = lookup_zero_it->second;
-                auto& lookup_one  = lookup_one_it ->second;
-                auto existing_zero = lookup_zero.find (vertex_positions[1]);
-                if (existing_zero == lookup_zero.end()) {
-                  lookup_zero.insert (std::make_pair (vertex_positions[1], vertices.size()));
-                  lookup_one .insert (std::make_pair (vertex_positions[0], vertices.size()));
-                  edge_to_output_vertex[edge_index] = vertices.size();
-                  // Calculate the precise position of this vertex, based on the
-                  //   image intensities in the two relevant voxels
-                  const default_type alpha = (threshold - in_vertex_values[vertex_indices[0]]) / (in_vertex_values[vertex_indices[1]] - in_vertex_values[vertex_indices[0]]);
-                  const Vertex pos_voxelspace = vertex_positions[0].cast<default_type>() + (alpha * (vertex_positions[1] - vertex_positions[0]).cast<default_type>());
-                  vertices.push_back (transform.voxel2scanner * pos_voxelspace);
-                } else {
-                  edge_to_output_vertex[edge_index] = existing_zero->second;
                 }
+              }
 
+              // OK, so now the relevant edges have an output vertex index associated with them
+              // Based on the code for this voxel, now we use the table cube_triangle_table to see
+              //   which edges need to have triangles constructed from the relevant generated vertices
+              // Note that flipping the last two vertex indices is deliberate; the provided
+              //   lookup table does not use a right-hand rule axis convention, so this is necessary
+              //   to calculate the correct surface normals
+              for (const int8_t* first_edge = cube_triangle_table[code]; *first_edge >= 0; first_edge += 3) {
+                const uint32_t indices[3] { edge_to_output_vertex[*first_edge], edge_to_output_vertex[*(first_edge+2)], edge_to_output_vertex[*(first_edge+1)] };
+                slab.triangles.push_back (Triangle (indices));
               }
-            }
-
-            // OK, so now the relevant edges have an output vertex index associated with them
-            // Based on the code for this voxel, now we use the table cube_triangle_table to see
-            //   which edges need to have triangles constructed from the relevant generated vertices
-            // Note that flipping the last two vertex indices is deliberate; the provided
-            //   lookup table does not use a right-hand rule axis convention, so this is necessary
-            //   to calculate the correct surface normals
-            for (const int8_t* first_edge = cube_triangle_table[code]; *first_edge >= 0; first_edge += 3) {
-              const uint32_t indices[3] { edge_to_output_vertex[*first_edge], edge_to_output_vertex[*(first_edge+2)], edge_to_output_vertex[*(first_edge+1)] };
-              triangles.push_back (Triangle (indices));
-            }
-
-      } } } // Finished looping over all voxels in the input image
+
+          } }
+
+          // Move on to the next layer of cubes
+          if (lower_corner[2] == slab.from)
+            slab.bottom = edges_lower;
+          std::swap (edges_lower, edges_upper);
+          std::fill (edges_upper.begin(), edges_upper.end(), no_vertex);
+          std::fill (edges_spanning.begin(), edges_spanning.end(), no_vertex);
+          std::swap (values_lower, values_upper);
+          load_plane (lower_corner[2] + 2, values_upper);
+        }
+        slab.top = std::move (edges_lower);
+        return true;
+      };
+
+      if (num_slabs == 1) {
+        process_slab (0);
+      } else {
+        size_t next_slab = 0;
+        auto source = [&] (size_t& slab_index) { slab_index = next_slab++; return slab_index < num_slabs; };
+        Thread::run_queue (source, size_t(), Thread::multi (process_slab, nthreads));
+      }
+
+      // Concatenate the slabs, merging those vertices on the planes shared
+      //   between adjacent slabs; this reproduces exactly the output of
+      //   processing the whole image in a single pass
+      VertexList vertices;
+      TriangleList triangles;
+      vector<uint32_t> previous_top;
+      for (auto& slab : slabs) {
+        vector<uint32_t> local_to_global (slab.vertices.size(), no_vertex);
+        for (size_t i = 0; i != previous_top.size(); ++i) {
+          if (slab.bottom[i] != no_vertex)
+            local_to_global[slab.bottom[i]] = previous_top[i];
+        }
+        for (size_t v = 0; v != slab.vertices.size(); ++v) {
+          if (local_to_global[v] == no_vertex) {
+            local_to_global[v] = vertices.size();
+            vertices.push_back (slab.vertices[v]);
+          }
+        }
+        for (const auto& t : slab.triangles) {
+          const uint32_t indices[3] { local_to_global[t[0]], local_to_global[t[1]], local_to_global[t[2]] };
+          triangles.push_back (Triangle (indices));
+        }
+        previous_top.assign (slab.top.size(), no_vertex);
+        for (size_t i = 0; i != slab.top.size(); ++i) {
+          if (slab.top[i] != no_vertex)
+            previous_top[i] = local_to_global[slab.top[i]];
+        }
+        VertexList().swap (slab.vertices);
+        TriangleList().swap (slab.triangles);
+      }
 
       // Write the result to the output class
       out.load (vertices, triangles);
@@ -15,10 +15,9 @@
 
 #include "surface/algo/mesh2image.h"
 
-#include <map>
-
 #include "header.h"
 #include "progressbar.h"
+#include "thread_queue.h"
 #include "types.h"
 
 #include "surface/types.h"
@@ -34,11 +33,73 @@ namespace MR
 
 
 
+      namespace
+      {
+
+        // Geometry of each polygon that is invariant to the position being tested,
+        //   such that it need only be computed once rather than for every sub-voxel point
+        class PolygonData
+        { MEMALIGN (PolygonData)
+          public:
+            PolygonData (const Mesh& mesh)
+            {
+              const size_t num_polygons = mesh.num_polygons();
+              normals.reserve (num_polygons);
+              centres.reserve (num_polygons);
+              vertices.reserve (num_polygons);
+              edge_normals.reserve (mesh.num_triangles());
+              VertexList v;
+              for (size_t poly_index = 0; poly_index != num_polygons; ++poly_index) {
+                std::array<Vertex, 4> these_vertices;
+                if (poly_index < mesh.num_triangles()) {
+                  const Eigen::Vector3 n (normal (mesh, mesh.tri (poly_index)));
+                  mesh.load_triangle_vertices (v, poly_index);
+                  these_vertices = {{ v[0], v[1], v[2], Vertex() }};
+                  normals.push_back (n);
+                  centres.push_back ((v[0] + v[1] + v[2]) * (1.0/3.0));
+                  Vertex zero = (v[2]-v[0]).cross (n); zero.normalize();
+                  Vertex one  = (v[1]-v[2]).cross (n); one .normalize();
+                  Vertex two  = (v[0]-v[1]).cross (n); two .normalize();
+                  edge_normals.push_back ({{ zero, one, two }});
+                } else {
+                  const size_t quad_index = poly_index - mesh.num_triangles();
+                  normals.push_back (normal (mesh, mesh.quad (quad_index)));
+                  mesh.load_quad_vertices (v, quad_index);
+                  these_vertices = {{ v[0], v[1], v[2], v[3] }};
+                  centres.push_back ((v[0] + v[1] + v[2] + v[3]) * 0.25);
+                }
+                vertices.push_back (these_vertices);
+              }
+            }
+
+            vector<Eigen::Vector3> normals;
+            vector<Vertex> centres;
+            vector<std::array<Vertex, 4>> vertices;
+            vector<std::array<Vertex, 3>> edge_normals;
+        };
+
+
+
+        // For every voxel intersected by the mesh, stores those polygons that may intersect
+        //   the voxel, in compressed sparse row format: the polygons for voxel i are
+        //   polygons[offsets[i]] to polygons[offsets[i+1]-1]
+        class Vox2Poly
+        { NOMEMALIGN
+          public:
+            vector<size_t> voxels;
+            vector<size_t> offsets;
+            vector<uint32_t> polygons;
+        };
+
+      }
+
+
+
       void mesh2image (const Mesh& mesh_realspace, Image<float>& image)
       {
 
         // For initial segmentation of mesh - identify voxels on the mesh, inside & outside
-        enum vox_mesh_t { UNDEFINED, ON_MESH, OUTSIDE, INSIDE };
+        enum vox_mesh_t : uint8_t { UNDEFINED, ON_MESH, OUTSIDE, INSIDE };
 
         ProgressBar progress ("converting mesh to PVE image", 6);
 
@@ -48,81 +109,70 @@ namespace MR
         Mesh mesh;
         transform (mesh_realspace, mesh);
 
-        static const Vox adj_voxels[6] = { { -1,  0,  0 },
-                                           { +1,  0,  0 },
-                                           {  0, -1,  0 },
-                                           {  0, +1,  0 },
-                                           {  0,  0, -1 },
-                                           {  0,  0, +1 } };
-
-        // Compute normals for polygons
-        vector<Eigen::Vector3> polygon_normals;
-        polygon_normals.reserve (mesh.num_polygons());
-        for (TriangleList::const_iterator p = mesh.get_triangles().begin(); p != mesh.get_triangles().end(); ++p)
-          polygon_normals.push_back (normal (mesh, *p));
-        for (QuadList::const_iterator p = mesh.get_quads().begin(); p != mesh.get_quads().end(); ++p)
-          polygon_normals.push_back (normal (mesh, *p));
+        if (mesh.num_polygons() > size_t(std::numeric_limits<uint32_t>::max()))
+          throw Exception ("Too many polygons in mesh for conversion to image");
+
+        // Compute normals, centres etc. for polygons
+        const PolygonData polygon_data (mesh);
         ++progress;
 
-        // Create some memory to work with:
+        // Voxels are addressed using a linear index, with the first axis varying fastest;
+        //   this matches the order in which voxels were previously sorted (see Vox::operator<)
+        const Vox dims (image.size(0), image.size(1), image.size(2));
+        const size_t stride_y = dims[0], stride_z = size_t(dims[0]) * size_t(dims[1]);
+        const size_t num_voxels = stride_z * size_t(dims[2]);
+
         // Stores a flag for each voxel as encoded in enum vox_mesh_t
-        Header H (image);
-        auto init_seg = Image<uint8_t>::scratch (H);
+        vector<uint8_t> init_seg (num_voxels, UNDEFINED);
 
-        // For every voxel, stores those polygons that may intersect the voxel
-        using Vox2Poly = std::map< Vox, vector<size_t> >;
+        // Map each polygon to the underlying voxels
         Vox2Poly voxel2poly;
+        {
+          vector<std::pair<size_t, uint32_t>> pairs;
+          pairs.reserve (mesh.num_polygons() * 4);
+          for (size_t poly_index = 0; poly_index != mesh.num_polygons(); ++poly_index) {
+
+            const size_t num_vertices = (poly_index < mesh.num_triangles()) ? 3 : 4;
+            const std::array<Vertex, 4>& this_poly_verts (polygon_data.vertices[poly_index]);
+
+            // Figure out the voxel extent of this polygon in three dimensions
+            Vox lower_bound (dims[0]-1, dims[1]-1, dims[2]-1), upper_bound (0, 0, 0);
+            for (size_t v = 0; v != num_vertices; ++v) {
+              for (size_t axis = 0; axis != 3; ++axis) {
+                const int this_axis_voxel = std::round (this_poly_verts[v][axis]);
+                lower_bound[axis] = std::min (lower_bound[axis], this_axis_voxel);
+                upper_bound[axis] = std::max (upper_bound[axis], this_axis_voxel);
+              }
+            }
 
-        // Map each polygon to the underlying voxels
-        for (size_t poly_index = 0; poly_index != mesh.num_polygons(); ++poly_index) {
-
-          const size_t num_vertices = (poly_index < mesh.num_triangles()) ? 3 : 4;
-
-          // Figure out the voxel extent of this polygon in three dimensions
-          Vox lower_bound (H.size(0)-1, H.size(1)-1, H.size(2)-1), upper_bound (0, 0, 0);
-          VertexList this_poly_verts;
-          if (num_vertices == 3)
-            mesh.load_triangle_vertices (this_poly_verts, poly_index);
-          else
-            mesh.load_quad_vertices (this_poly_verts, poly_index - mesh.num_triangles());
-          for (VertexList::const_iterator v = this_poly_verts.begin(); v != this_poly_verts.end(); ++v) {
+            // Constrain to lie within the dimensions of the image
             for (size_t axis = 0; axis != 3; ++axis) {
-              const int this_axis_voxel = std::round((*v)[axis]);
-              lower_bound[axis] = std::min (lower_bound[axis], this_axis_voxel);
-              upper_bound[axis] = std::max (upper_bound[axis], this_axis_voxel);
+              lower_bound[axis] = std::max (0,              lower_bound[axis]);
+              upper_bound[axis] = std::min (dims[axis] - 1, upper_bound[axis]);
             }
-          }
 
-          // Constrain to lie within the dimensions of the image
-          for (size_t axis = 0; axis != 3; ++axis) {
-            lower_bound[axis] = std::max(0,                   lower_bound[axis]);
-            upper_bound[axis] = std::min(int(H.size(axis)-1), upper_bound[axis]);
+            // For all voxels within this rectangular region, assign this polygon to the voxel
+            for (int z = lower_bound[2]; z <= upper_bound[2]; ++z) {
+              for (int y = lower_bound[1]; y <= upper_bound[1]; ++y) {
+                for (int x = lower_bound[0]; x <= upper_bound[0]; ++x)
+                  pairs.push_back (std::make_pair (x + y*stride_y + z*stride_z, uint32_t(poly_index)));
+            } }
+
           }
 
-          // For all voxels within this rectangular region, assign this polygon to the map
-          Vox voxel;
-          for (voxel[2] = lower_bound[2]; voxel[2] <= upper_bound[2]; ++voxel[2]) {
-            for (voxel[1] = lower_bound[1]; voxel[1] <= upper_bound[1]; ++voxel[1]) {
-              for (voxel[0] = lower_bound[0]; voxel[0] <= upper_bound[0]; ++voxel[0]) {
-                vector<size_t> this_voxel_polys;
-                //#if __clang__
-                //              Vox2Poly::const_iterator existing = voxel2poly.find (voxel);
-                //#else
-                //              Vox2Poly::iterator existing = voxel2poly.find (voxel);
-                //#endif
-                Vox2Poly::const_iterator existing = voxel2poly.find (voxel);
-                if (existing != voxel2poly.end()) {
-                  this_voxel_polys = existing->second;
-                  voxel2poly.erase (existing);
-                } else {
-                  // Only call this once each voxel, regardless of the number of intersecting polygons
-                  assign_pos_of (voxel).to (init_seg);
-                  init_seg.value() = ON_MESH;
-                }
-                this_voxel_polys.push_back (poly_index);
-                voxel2poly.insert (std::make_pair (voxel, this_voxel_polys));
-          } } }
+          // Sorting by voxel then polygon index preserves the order in which polygons are tested
+          std::sort (pairs.begin(), pairs.end());
 
+          voxel2poly.polygons.reserve (pairs.size());
+          for (const auto& p : pairs) {
+            if (voxel2poly.voxels.empty() || voxel2poly.voxels.back() != p.first) {
+              voxel2poly.voxels.push_back (p.first);
+              voxel2poly.offsets.push_back (voxel2poly.polygons.size());
+              init_seg[p.first] = ON_MESH;
+            }
+            voxel2poly.polygons.push_back (p.second);
+          }
+          voxel2poly.offsets.push_back (voxel2poly.polygons.size());
         }
         ++progress;
 
@@ -130,53 +180,58 @@ namespace MR
         // Find all voxels that are not partial-volumed with the mesh, and are not inside the mesh
         // Use a corner of the image FoV to commence filling of the volume, and then check that all
         //   eight corners have been flagged as outside the volume
-        const Vox corner_voxels[8] = {
-            Vox (             0,              0,              0),
-            Vox (             0,              0, H.size (2) - 1),
-            Vox (             0, H.size (1) - 1,              0),
-            Vox (             0, H.size (1) - 1, H.size (2) - 1),
-            Vox (H.size (0) - 1,              0,              0),
-            Vox (H.size (0) - 1,              0, H.size (2) - 1),
-            Vox (H.size (0) - 1, H.size (1) - 1,              0),
-            Vox (H.size (0) - 1, H.size (1) - 1, H.size (2) - 1)};
-
-        // TODO This is slow; is there a faster implementation?
-        // This is essentially a connected-component analysis...
-        vector<Vox> to_expand;
-        to_expand.push_back (corner_voxels[0]);
-        assign_pos_of (corner_voxels[0]).to (init_seg);
-        init_seg.value() = vox_mesh_t::OUTSIDE;
-        do {
-          const Vox centre_voxel (to_expand.back());
-          to_expand.pop_back();
-          for (size_t adj_vox_idx = 0; adj_vox_idx != 6; ++adj_vox_idx) {
-            const Vox this_voxel (centre_voxel + adj_voxels[adj_vox_idx]);
-            assign_pos_of (this_voxel).to (init_seg);
-            if (!is_out_of_bounds (init_seg) && init_seg.value() == vox_mesh_t (UNDEFINED)) {
-              init_seg.value() = vox_mesh_t (OUTSIDE);
-              to_expand.push_back (this_voxel);
-            }
+        const size_t corner_voxels[8] = {
+            0,
+            (dims[2]-1)*stride_z,
+            (dims[1]-1)*stride_y,
+            (dims[1]-1)*stride_y + (dims[2]-1)*stride_z,
+            size_t(dims[0]-1),
+            size_t(dims[0]-1) + (dims[2]-1)*stride_z,
+            size_t(dims[0]-1) + (dims[1]-1)*stride_y,
+            size_t(dims[0]-1) + (dims[1]-1)*stride_y + (dims[2]-1)*stride_z };
+
+        // Flood fill operates directly on linear voxel indices; the bounds of the
+        //   image along each axis are tested before stepping to each neighbour
+        vector<size_t> to_expand;
+        if (init_seg[corner_voxels[0]] == UNDEFINED) {
+          init_seg[corner_voxels[0]] = OUTSIDE;
+          to_expand.push_back (corner_voxels[0]);
+        }
+        auto expand = [&] (const size_t index) {
+          if (init_seg[index] == UNDEFINED) {
+            init_seg[index] = OUTSIDE;
+            to_expand.push_back (index);
           }
-        } while (!to_expand.empty());
+        };
+        while (!to_expand.empty()) {
+          const size_t index = to_expand.back();
+          to_expand.pop_back();
+          const int x = index % stride_y, y = (index / stride_y) % dims[1], z = index / stride_z;
+          if (x)             expand (index - 1);
+          if (x < dims[0]-1) expand (index + 1);
+          if (y)             expand (index - stride_y);
+          if (y < dims[1]-1) expand (index + stride_y);
+          if (z)             expand (index - stride_z);
+          if (z < dims[2]-1) expand (index + stride_z);
+        }
         ++progress;
 
         for (size_t cnr_idx = 0; cnr_idx != 8; ++cnr_idx) {
-          assign_pos_of (corner_voxels[cnr_idx]).to (init_seg);
-          if (init_seg.value() == vox_mesh_t (UNDEFINED))
+          if (init_seg[corner_voxels[cnr_idx]] == UNDEFINED)
             throw Exception ("Mesh is not bound within image field of view");
         }
 
 
         // Find those voxels that remain unassigned, and set them to INSIDE
-        for (auto l = Loop (init_seg) (init_seg); l; ++l) {
-          if (init_seg.value() == vox_mesh_t (UNDEFINED))
-            init_seg.value() = vox_mesh_t (INSIDE);
+        for (auto& v : init_seg) {
+          if (v == UNDEFINED)
+            v = INSIDE;
         }
         ++progress;
 
         // Write initial ternary segmentation
-        for (auto l = Loop (init_seg) (init_seg, image); l; ++l) {
-          switch (init_seg.value()) {
+        for (auto l = Loop (image) (image); l; ++l) {
+          switch (init_seg[image.index(0) + image.index(1)*stride_y + image.index(2)*stride_z]) {
             case vox_mesh_t (UNDEFINED): throw Exception ("Code error: poor filling of initial mesh estimate"); break;
             case vox_mesh_t (ON_MESH):   image.value() = 0.5; break;
             case vox_mesh_t (OUTSIDE):   image.value() = 0.0; break;
@@ -186,13 +241,13 @@ namespace MR
         ++progress;
 
         // Get better partial volume estimates for all necessary voxels
-        // TODO This could be multi-threaded, but hard to justify the dev time
+        // Each voxel is independent of all others, so these are distributed across
+        //   threads in contiguous batches of voxels
         static const size_t pve_os_ratio = 10;
+        static const size_t batch_size = 64;
 
-        for (Vox2Poly::const_iterator i = voxel2poly.begin(); i != voxel2poly.end(); ++i) {
-
-          const Vox& voxel (i->first);
-
+        auto estimate_pve = [&] (const Vox& voxel, const size_t voxel_index) -> default_type
+        {
           // Generate a set of points within this voxel that need to be tested individually
           vector<Vertex> to_test;
           to_test.reserve (Math::pow3 (pve_os_ratio));
@@ -216,51 +271,33 @@ namespace MR
             bool best_result_inside = false;
 
             // Only test against those polygons that are near this voxel
-            for (vector<size_t>::const_iterator polygon_index = i->second.begin(); polygon_index != i->second.end(); ++polygon_index) {
-              const Eigen::Vector3& n (polygon_normals[*polygon_index]);
+            for (size_t i = voxel2poly.offsets[voxel_index]; i != voxel2poly.offsets[voxel_index+1]; ++i) {
+              const size_t polygon_index = voxel2poly.polygons[i];
+              const Eigen::Vector3& n (polygon_data.normals[polygon_index]);
+              const std::array<Vertex, 4>& v (polygon_data.vertices[polygon_index]);
 
-              const size_t polygon_num_vertices = (*polygon_index < mesh.num_triangles()) ? 3 : 4;
-              VertexList v;
-
-              bool is_inside = false;
-              default_type min_edge_distance = std::numeric_limits<default_type>::infinity();
+              // First: is it aligned with the normal?
+              const Vertex diff (p - polygon_data.centres[polygon_index]);
+              const bool is_inside = (diff.dot (n) <= 0.0);
 
-              if (polygon_num_vertices == 3) {
+              // Second: how well does it project onto this polygon?
+              const Vertex p_on_plane (p - (n * (diff.dot (n))));
 
-                mesh.load_triangle_vertices (v, *polygon_index);
-
-                // First: is it aligned with the normal?
-                const Vertex poly_centre ((v[0] + v[1] + v[2]) * (1.0/3.0));
-                const Vertex diff (p - poly_centre);
-                is_inside = (diff.dot (n) <= 0.0);
+              default_type min_edge_distance = std::numeric_limits<default_type>::infinity();
 
-                // Second: how well does it project onto this polygon?
-                const Vertex p_on_plane (p - (n * (diff.dot (n))));
+              if (polygon_index < mesh.num_triangles()) {
 
+                const std::array<Vertex, 3>& edge_normals (polygon_data.edge_normals[polygon_index]);
                 std::array<default_type, 3> edge_distances;
-                Vertex zero = (v[2]-v[0]).cross (n); zero.normalize();
-                Vertex one  = (v[1]-v[2]).cross (n); one .normalize();
-                Vertex two  = (v[0]-v[1]).cross (n); two .normalize();
-                edge_distances[0] = (p_on_plane-v[0]).dot (zero);
-                edge_distances[1] = (p_on_plane-v[2]).dot (one);
-                edge_distances[2] = (p_on_plane-v[1]).dot (two);
+                edge_distances[0] = (p_on_plane-v[0]).dot (edge_normals[0]);
+                edge_distances[1] = (p_on_plane-v[2]).dot (edge_normals[1]);
+                edge_distances[2] = (p_on_plane-v[1]).dot (edge_normals[2]);
                 min_edge_distance = std::min (edge_distances[0], std::min (edge_distances[1], edge_distances[2]));
 
               } else {
 
-                mesh.load_quad_vertices (v, *polygon_index);
-
                 // This may be slightly ill-posed with a quad; no guarantee of fixed normal
                 // Proceed regardless
-
-                // First: is it aligned with the normal?
-                const Vertex poly_centre ((v[0] + v[1] + v[2] + v[3]) * 0.25);
-                const Vertex diff (p - poly_centre);
-                is_inside = (diff.dot (n) <= 0.0);
-
-                // Second: how well does it project onto this polygon?
-                const Vertex p_on_plane (p - (n * (diff.dot (n))));
-
                 for (int edge = 0; edge != 4; ++edge) {
                   // Want an appropriate vector emanating from this edge from which to test the 'on-plane' distance
                   //   (bearing in mind that there may not be a uniform normal)
@@ -298,10 +335,35 @@ namespace MR
 
           }
 
-          assign_pos_of (voxel).to (image);
-          image.value() = (default_type)inside_mesh_count / (default_type)Math::pow3 (pve_os_ratio);
+          return (default_type)inside_mesh_count / (default_type)Math::pow3 (pve_os_ratio);
+        };
+
+        size_t next_batch = 0;
+        auto source = [&] (size_t& out)
+        {
+          if (next_batch >= voxel2poly.voxels.size())
+            return false;
+          out = next_batch;
+          next_batch += batch_size;
+          return true;
+        };
+
+        // Each thread writes to a distinct set of voxels through its own copy of the image
+        Image<float> output (image);
+        auto estimate_batch = [output, &voxel2poly, &estimate_pve, &dims, stride_y, stride_z] (const size_t& first) mutable
+        {
+          const size_t last = std::min (first + batch_size, voxel2poly.voxels.size());
+          for (size_t i = first; i != last; ++i) {
+            const size_t index = voxel2poly.voxels[i];
+            const Vox voxel (index % stride_y, (index / stride_y) % dims[1], index / stride_z);
+            assign_pos_of (voxel).to (output);
+            output.value() = estimate_pve (voxel, i);
+          }
+          return true;
+        };
 
-        }
+        Thread::run_queue (source, size_t(), Thread::multi (estimate_batch));
+        ++progress;
 
       }
 
@@ -15,7 +15,12 @@
 
 #include "surface/filter/smooth.h"
 
-#include <set>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <numeric>
+
+#include "thread_queue.h"
 
 #include "surface/utils.h"
 
@@ -27,13 +32,121 @@ namespace MR
     {
 
 
-      void Smooth::operator() (const Mesh& in, Mesh& out) const
+
+      namespace
       {
-        std::unique_ptr<ProgressBar> progress;
-        if (message.size())
-          progress.reset (new ProgressBar (message, 8));
-        out.clear();
 
+        constexpr size_t batch_size = 256;
+
+        // Distribute contiguous batches of vertices across threads; each thread
+        //   invokes its own copy of the functor for the range [first, last)
+        template <class Functor>
+        void run_batched (const size_t count, Functor&& functor)
+        {
+          size_t next = 0;
+          auto source = [&] (size_t& first)
+          {
+            if (next >= count)
+              return false;
+            first = next;
+            next += batch_size;
+            return true;
+          };
+          auto sink = [functor, count] (const size_t& first) mutable
+          {
+            functor (first, std::min (first + batch_size, count));
+            return true;
+          };
+          Thread::run_queue (source, size_t(), Thread::multi (sink));
+        }
+
+
+
+        // Expand outwards from the polygons that use each vertex, using the connections
+        //   between polygons that share an edge; each thread keeps its own record of
+        //   which polygons have already been added to the neighbourhood of the current vertex
+        class Expander
+        { NOMEMALIGN
+          public:
+            Expander (const vector<size_t>& vert_offsets, const vector<uint32_t>& vert_polys,
+                      const vector<size_t>& poly_offsets, const vector<uint32_t>& poly_neighbours,
+                      vector<vector<uint32_t>>& batch_polys, vector<size_t>& counts) :
+                vert_offsets (vert_offsets),
+                vert_polys (vert_polys),
+                poly_offsets (poly_offsets),
+                poly_neighbours (poly_neighbours),
+                batch_polys (batch_polys),
+                counts (counts),
+                visited (poly_offsets.size() - 1, 0) { }
+
+            void operator() (const size_t first, const size_t last)
+            {
+              vector<uint32_t>& output (batch_polys[first / batch_size]);
+              for (size_t v = first; v != last; ++v) {
+                const uint32_t marker = uint32_t(v) + 1;
+                const size_t start = output.size();
+                front.clear();
+                for (size_t i = vert_offsets[v]; i != vert_offsets[v+1]; ++i) {
+                  const uint32_t p = vert_polys[i];
+                  if (visited[p] != marker) {
+                    visited[p] = marker;
+                    output.push_back (p);
+                    front.push_back (p);
+                  }
+                }
+                // TODO Will want to develop a better heuristic for this
+                for (size_t iter = 0; iter != 8; ++iter) {
+                  next_front.clear();
+                  for (const auto p : front) {
+                    for (size_t i = poly_offsets[p]; i != poly_offsets[p+1]; ++i) {
+                      const uint32_t n = poly_neighbours[i];
+                      if (visited[n] != marker) {
+                        visited[n] = marker;
+                        output.push_back (n);
+                        next_front.push_back (n);
+                      }
+                    }
+                  }
+                  std::swap (front, next_front);
+                }
+                // Retain ascending polygon order, such that summation order is deterministic
+                std::sort (output.begin() + start, output.end());
+                counts[v] = output.size() - start;
+              }
+            }
+
+          private:
+            const vector<size_t>& vert_offsets;
+            const vector<uint32_t>& vert_polys;
+            const vector<size_t>& poly_offsets;
+            const vector<uint32_t>& poly_neighbours;
+            vector<vector<uint32_t>>& batch_polys;
+            vector<size_t>& counts;
+            vector<uint32_t> visited, front, next_front;
+        };
+
+
+
+        bool same_triangulation (const Mesh& a, const Mesh& b)
+        {
+          if (a.num_vertices() != b.num_vertices() || a.num_triangles() != b.num_triangles() || a.num_quads() || b.num_quads())
+            return false;
+          for (size_t t = 0; t != a.num_triangles(); ++t) {
+            for (size_t i = 0; i != 3; ++i) {
+              if (a.tri (t)[i] != b.tri (t)[i])
+                return false;
+            }
+          }
+          return true;
+        }
+
+      }
+
+
+
+      Smooth::Neighbourhood::Neighbourhood (const Mesh& in, ProgressBar* progress) :
+          offsets (1, 0)
+      {
         const size_t V = in.num_vertices();
         if (!V) return;
 
@@ -42,15 +155,8 @@ namespace MR
         const size_t T = in.num_triangles();
         if (V == 3*T)
           throw Exception ("Cannot perform smoothing on this mesh: no triangulation information");
-
-        // Pre-compute polygon centroids and areas
-        VertexList centroids;
-        vector<default_type> areas;
-        for (TriangleList::const_iterator p = in.triangles.begin(); p != in.triangles.end(); ++p) {
-          centroids.push_back ((in.vertices[(*p)[0]] + in.vertices[(*p)[1]] + in.vertices[(*p)[2]]) * (1.0/3.0));
-          areas.push_back (area (in, *p));
-        }
-        if (progress) ++(*progress);
+        if (T >= size_t(std::numeric_limits<uint32_t>::max()) || V >= size_t(std::numeric_limits<uint32_t>::max()))
+          throw Exception ("Mesh is too large for smoothing");
 
         // Perform pre-calculation of an appropriate mesh neighbourhood for each vertex
         // Use knowledge of the connections between vertices provided by the triangles/quads to
@@ -61,15 +167,18 @@ namespace MR
         //
         // Initialisation is different to iterations: Need a single pass to find those
         //   polygons that actually use the vertex
-        vector< std::set<uint32_t> > vert_polys (V, std::set<uint32_t>());
-        // For each vertex, don't just want to store the polygons within the neighbourhood;
-        //   also want to store those that will be expanded from in the next iteration
-        vector< vector<uint32_t> > vert_polys_to_expand (V, vector<uint32_t>());
-
+        vector<size_t> vert_offsets (V+1, 0);
         for (uint32_t t = 0; t != T; ++t) {
-          for (uint32_t i = 0; i != 3; ++i) {
-            vert_polys[(in.triangles[t])[i]].insert (t);
-            vert_polys_to_expand[(in.triangles[t])[i]].push_back (t);
+          for (uint32_t i = 0; i != 3; ++i)
+            ++vert_offsets[in.triangles[t][i] + 1];
+        }
+        std::partial_sum (vert_offsets.begin(), vert_offsets.end(), vert_offsets.begin());
+        vector<uint32_t> vert_polys (vert_offsets.back());
+        {
+          vector<size_t> position (vert_offsets.begin(), vert_offsets.end() - 1);
+          for (uint32_t t = 0; t != T; ++t) {
+            for (uint32_t i = 0; i != 3; ++i)
+              vert_polys[position[in.triangles[t][i]]++] = t;
           }
         }
         if (progress) ++(*progress);
@@ -77,77 +186,189 @@ namespace MR
         // Now, we want to expand this selection outwards for each vertex
         // To do this, also want to produce a list for each polygon: containing those polygons
         //   that share a common edge (i.e. two vertices)
-        vector< vector<uint32_t> > poly_neighbours (T, vector<uint32_t>());
-        for (uint32_t i = 0; i != T; ++i) {
-          for (uint32_t j = i+1; j != T; ++j) {
-            if (in.triangles[i].shares_edge (in.triangles[j])) {
-              poly_neighbours[i].push_back (j);
-              poly_neighbours[j].push_back (i);
-
+        // Rather than testing all pairs of polygons, only those polygons that have an
+        //   edge in common (as found by sorting all edges) are tested
+        vector<size_t> poly_offsets (T+1, 0);
+        vector<uint32_t> poly_neighbours;
+        {
+          vector<std::pair<uint64_t, uint32_t>> edges;
+          edges.reserve (3*T);
+          for (uint32_t t = 0; t != T; ++t) {
+            for (uint32_t i = 0; i != 3; ++i) {
+              const uint32_t a = in.triangles[t][i], b = in.triangles[t][(i+1)%3];
+              if (a != b)
+                edges.push_back (std::make_pair ((uint64_t(std::min (a, b)) << 32) | uint64_t(std::max (a, b)), t));
             }
           }
-        }
-        if (progress) ++(*progress);
-
-        // TODO Will want to develop a better heuristic for this
-        for (size_t iter = 0; iter != 8; ++iter) {
-          for (uint32_t v = 0; v != V; ++v) {
-
-            // Find polygons at the outer edge of this expanding front, and add them to the neighbourhood for this vertex
-            vector<uint32_t> next_front;
-            for (vector<uint32_t>::const_iterator front = vert_polys_to_expand[v].begin(); front != vert_polys_to_expand[v].end(); ++front) {
-              for (vector<uint32_t>::const_iterator expansion = poly_neighbours[*front].begin(); expansion != poly_neighbours[*front].end(); ++expansion) {
-                const std::set<uint32_t>::const_iterator existing = vert_polys[v].find (*expansion);
-                if (existing == vert_polys[v].end()) {
-                  vert_polys[v].insert (*expansion);
-                  next_front.push_back (*expansion);
+          std::sort (edges.begin(), edges.end());
+
+          vector<std::pair<uint32_t, uint32_t>> adjacent;
+          adjacent.reserve (edges.size());
+          for (size_t group_start = 0; group_start != edges.size();) {
+            size_t group_end = group_start + 1;
+            while (group_end != edges.size() && edges[group_end].first == edges[group_start].first)
+              ++group_end;
+            for (size_t i = group_start; i != group_end; ++i) {
+              for (size_t j = i+1; j != group_end; ++j) {
+                const uint32_t p = edges[i].second, q = edges[j].second;
+                if (p != q && in.triangles[p].shares_edge (in.triangles[q])) {
+                  adjacent.push_back (std::make_pair (p, q));
+                  adjacent.push_back (std::make_pair (q, p));
                 }
               }
             }
-            vert_polys_to_expand[v] = std::move (next_front);
+            group_start = group_end;
+          }
+          std::sort (adjacent.begin(), adjacent.end());
+          adjacent.erase (std::unique (adjacent.begin(), adjacent.end()), adjacent.end());
 
+          poly_neighbours.reserve (adjacent.size());
+          for (const auto& a : adjacent) {
+            ++poly_offsets[a.first + 1];
+            poly_neighbours.push_back (a.second);
           }
+          std::partial_sum (poly_offsets.begin(), poly_offsets.end(), poly_offsets.begin());
+        }
+        if (progress) ++(*progress);
+
+        // Each vertex is expanded independently; neighbourhoods for each batch of vertices
+        //   are concatenated into the final compressed representation afterwards
+        vector<vector<uint32_t>> batch_polys ((V + batch_size - 1) / batch_size);
+        vector<size_t> counts (V, 0);
+        run_batched (V, Expander (vert_offsets, vert_polys, poly_offsets, poly_neighbours, batch_polys, counts));
+
+        offsets.resize (V+1);
+        for (size_t v = 0; v != V; ++v)
+          offsets[v+1] = offsets[v] + counts[v];
+        polygons.reserve (offsets.back());
+        for (auto& b : batch_polys) {
+          polygons.insert (polygons.end(), b.begin(), b.end());
+          vector<uint32_t>().swap (b);
         }
         if (progress) ++(*progress);
+      }
 
 
 
+      void Smooth::operator() (const Mesh& in, Mesh& out) const
+      {
+        std::unique_ptr<ProgressBar> progress;
+        if (message.size())
+          progress.reset (new ProgressBar (message, 8));
+        const Neighbourhood neighbourhood (in, progress.get());
+        smooth (in, neighbourhood, out, progress.get());
+      }
+
+
+
+      void Smooth::operator() (const Mesh& in, const Neighbourhood& neighbourhood, Mesh& out) const
+      {
+        std::unique_ptr<ProgressBar> progress;
+        if (message.size())
+          progress.reset (new ProgressBar (message, 5));
+        smooth (in, neighbourhood, out, progress.get());
+      }
+
+
+
+      void Smooth::operator() (const MeshMulti& in, MeshMulti& out) const
+      {
+        std::unique_ptr<ProgressBar> progress;
+        if (message.size())
+          progress.reset (new ProgressBar (message, in.size()));
+        out.assign (in.size(), Mesh());
+
+        // For each mesh, find the first mesh with an identical triangulation (if any),
+        //   and the last mesh to make use of each neighbourhood (so that it can be freed)
+        vector<size_t> source (in.size()), last_use (in.size());
+        for (size_t i = 0; i != in.size(); ++i) {
+          source[i] = i;
+          for (size_t j = 0; j != i; ++j) {
+            if (source[j] == j && same_triangulation (in[j], in[i])) {
+              source[i] = j;
+              break;
+            }
+          }
+          last_use[source[i]] = i;
+        }
+
+        vector<std::unique_ptr<Neighbourhood>> neighbourhoods (in.size());
+        for (size_t i = 0; i != in.size(); ++i) {
+          std::unique_ptr<Neighbourhood>& neighbourhood (neighbourhoods[source[i]]);
+          if (!neighbourhood)
+            neighbourhood.reset (new Neighbourhood (in[i]));
+          smooth (in[i], *neighbourhood, out[i], nullptr);
+          if (last_use[source[i]] == i)
+            neighbourhood.reset();
+          if (progress) ++(*progress);
+        }
+      }
+
+
+
+      void Smooth::smooth (const Mesh& in, const Neighbourhood& neighbourhood, Mesh& out, ProgressBar* progress) const
+      {
+        out.clear();
+
+        const size_t V = in.num_vertices();
+        if (!V) return;
+
+        if (in.num_quads())
+          throw Exception ("For now, mesh smoothing is only supported for triangular meshes");
+        if (neighbourhood.num_vertices() != V)
+          throw Exception ("Mesh smoothing neighbourhood does not match the number of mesh vertices");
+        const size_t T = in.num_triangles();
+
+        // Pre-compute polygon centroids and areas
+        VertexList centroids;
+        vector<default_type> areas;
+        centroids.reserve (T);
+        areas.reserve (T);
+        for (TriangleList::const_iterator p = in.triangles.begin(); p != in.triangles.end(); ++p) {
+          centroids.push_back ((in.vertices[(*p)[0]] + in.vertices[(*p)[1]] + in.vertices[(*p)[2]]) * (1.0/3.0));
+          areas.push_back (area (in, *p));
+        }
+        if (progress) ++(*progress);
+
         // Need to perform a first mollification pass, where the polygon normals are
         //   smoothed but the vertices are not perturbed
         // However, in order to calculate these new normals, we need to calculate new vertex positions!
-        VertexList mollified_vertices;
+        // Vertices are read from the input mesh and written to a separate buffer,
+        //   so each vertex can be processed independently
+        VertexList mollified_vertices (V);
         // Use half standard spatial factor for mollification
         // Denominator = 2(SF/2)^2
         const default_type spatial_mollification_power_multiplier = -2.0 / Math::pow2 (spatial);
         // No need to normalise the Gaussian; have to explicitly normalise afterwards
-        for (uint32_t v = 0; v != V; ++v) {
-
-          Vertex new_pos (0.0, 0.0, 0.0);
-          default_type sum_weights = 0.0;
-
-          // For now, just use every polygon as part of the estimate
-          // Eventually, restrict this to some form of mesh neighbourhood
-          //for (size_t i = 0; i != centroids.size(); ++i) {
-          for (std::set<uint32_t>::const_iterator it = vert_polys[v].begin(); it != vert_polys[v].end(); ++it) {
-            const uint32_t i = *it;
-            default_type this_weight = areas[i];
-            const default_type distance_sq = (centroids[i] - in.vertices[v]).squaredNorm();
-            this_weight *= std::exp (distance_sq * spatial_mollification_power_multiplier);
-            const Vertex prediction = centroids[i];
-            new_pos += this_weight * prediction;
-            sum_weights += this_weight;
-          }
+        run_batched (V, [&] (const size_t first, const size_t last)
+        {
+          for (size_t v = first; v != last; ++v) {
+
+            Vertex new_pos (0.0, 0.0, 0.0);
+            default_type sum_weights = 0.0;
+
+            for (size_t j = neighbourhood.offsets[v]; j != neighbourhood.offsets[v+1]; ++j) {
+              const uint32_t i = neighbourhood.polygons[j];
+              default_type this_weight = areas[i];
+              const default_type distance_sq = (centroids[i] - in.vertices[v]).squaredNorm();
+              this_weight *= std::exp (distance_sq * spatial_mollification_power_multiplier);
+              const Vertex prediction = centroids[i];
+              new_pos += this_weight * prediction;
+              sum_weights += this_weight;
+            }
 
-          new_pos *= (1.0 / sum_weights);
-          mollified_vertices.push_back (new_pos);
+            new_pos *= (1.0 / sum_weights);
+            mollified_vertices[v] = new_pos;
 
-        }
+          }
+        });
         if (progress) ++(*progress);
 
         // Have new vertices; compute polygon normals based on these vertices
         Mesh mollified_mesh;
         mollified_mesh.load (mollified_vertices, in.triangles);
         VertexList tangents;
+        tangents.reserve (T);
         for (TriangleList::const_iterator p = mollified_mesh.triangles.begin(); p != mollified_mesh.triangles.end(); ++p)
           tangents.push_back (normal (mollified_mesh, *p));
         if (progress) ++(*progress);
@@ -155,28 +376,31 @@ namespace MR
         // Now perform the actual smoothing
         const default_type spatial_power_multiplier = -0.5 / Math::pow2 (spatial);
         const default_type influence_power_multiplier = -0.5 / Math::pow2 (influence);
-        for (size_t v = 0; v != V; ++v) {
-
-          Vertex new_pos (0.0, 0.0, 0.0);
-          default_type sum_weights = 0.0;
-
-          //for (size_t i = 0; i != centroids.size(); ++i) {
-          for (std::set<uint32_t>::const_iterator it = vert_polys[v].begin(); it != vert_polys[v].end(); ++it) {
-            const uint32_t i = *it;
-            default_type this_weight = areas[i];
-            const default_type distance_sq = (centroids[i] - in.vertices[v]).squaredNorm();
-            this_weight *= std::exp (distance_sq * spatial_power_multiplier);
-            const default_type prediction_distance = (centroids[i] - in.vertices[v]).dot (tangents[i]);
-            const Vertex prediction = in.vertices[v] + (tangents[i] * prediction_distance);
-            this_weight *= std::exp (Math::pow2 (prediction_distance) * influence_power_multiplier);
-            new_pos += this_weight * prediction;
-            sum_weights += this_weight;
-          }
+        out.vertices.resize (V);
+        run_batched (V, [&] (const size_t first, const size_t last)
+        {
+          for (size_t v = first; v != last; ++v) {
+
+            Vertex new_pos (0.0, 0.0, 0.0);
+            default_type sum_weights = 0.0;
+
+            for (size_t j = neighbourhood.offsets[v]; j != neighbourhood.offsets[v+1]; ++j) {
+              const uint32_t i = neighbourhood.polygons[j];
+              default_type this_weight = areas[i];
+              const default_type distance_sq = (centroids[i] - in.vertices[v]).squaredNorm();
+              this_weight *= std::exp (distance_sq * spatial_power_multiplier);
+              const default_type prediction_distance = (centroids[i] - in.vertices[v]).dot (tangents[i]);
+              const Vertex prediction = in.vertices[v] + (tangents[i] * prediction_distance);
+              this_weight *= std::exp (Math::pow2 (prediction_distance) * influence_power_multiplier);
+              new_pos += this_weight * prediction;
+              sum_weights += this_weight;
+            }
 
-          new_pos *= (1.0 / sum_weights);
-          out.vertices.push_back (new_pos);
+            new_pos *= (1.0 / sum_weights);
+            out.vertices[v] = new_pos;
 
-        }
+          }
+        });
         if (progress) ++(*progress);
 
         out.triangles = in.triangles;
@@ -192,4 +416,3 @@ namespace MR
     }
   }
 }
-
@@ -17,6 +17,7 @@
 #define __surface_filter_smooth_h__
 
 #include "surface/mesh.h"
+#include "surface/mesh_multi.h"
 #include "surface/filter/base.h"
 
 
@@ -57,11 +58,35 @@ namespace MR
               spatial (spatial_factor),
               influence (influence_factor) { }
 
+          // Set of polygons contributing to the smoothed position of each vertex,
+          //   stored in compressed sparse row format: the polygons for vertex v are
+          //   polygons[offsets[v]] to polygons[offsets[v+1]-1], in ascending order
+          // This depends only on the mesh topology, and can therefore be shared
+          //   between meshes with identical triangulations
+          class Neighbourhood
+          { NOMEMALIGN
+            public:
+              Neighbourhood (const Mesh&, ProgressBar* progress = nullptr);
+
+              size_t num_vertices() const { return offsets.size() - 1; }
+              size_t size() const { return polygons.size(); }
+
+              vector<size_t> offsets;
+              vector<uint32_t> polygons;
+          };
+
           void operator() (const Mesh&, Mesh&) const override;
+          void operator() (const Mesh&, const Neighbourhood&, Mesh&) const;
+
+          // Meshes are processed one at a time, each using all available threads;
+          //   neighbourhoods are re-used between meshes that share a triangulation
+          void operator() (const MeshMulti&, MeshMulti&) const override;
 
         private:
           default_type spatial, influence;
 
+          void smooth (const Mesh&, const Neighbourhood&, Mesh&, ProgressBar*) const;
+
       };
 
 
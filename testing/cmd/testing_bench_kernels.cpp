@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "thread_queue.h"
+#include "timer.h"
+#include "algo/threaded_loop.h"
+#include "file/path.h"
+#include "file/utils.h"
+#include "interp/cubic.h"
+#include "interp/linear.h"
+#include "math/rng.h"
+#include "math/SH.h"
+#include "dwi/directions/predefined.h"
+#include "dwi/tractography/file.h"
+#include "dwi/tractography/properties.h"
+
+using namespace MR;
+using namespace App;
+
+const char* kernels[] = { "threaded_loop", "queue", "interp_linear", "interp_cubic", "sh2amp", "tck_write", "tck_read", nullptr };
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Benchmark core processing kernels on synthetic data";
+
+  DESCRIPTION
+  + "Each kernel is run the requested number of times, and the fastest run is reported. "
+    "Results are written to standard output, one kernel per line, as: kernel name; "
+    "time taken (in seconds); number of elements processed per second. The number of "
+    "threads is controlled using the -nthreads option as for any other command."
+
+  + "The kernels available are: "
+    "threaded_loop (voxel-wise arithmetic over two 4D images using ThreadedLoop); "
+    "queue (passing small items through a multi-threaded Thread::run_queue pipeline); "
+    "interp_linear & interp_cubic (resampling a 3D image at off-grid positions); "
+    "sh2amp (evaluating lmax=8 SH coefficients over 300 directions in each voxel); "
+    "tck_write & tck_read (writing and reading back a .tck file of random walks).";
+
+  ARGUMENTS
+  + Argument ("kernel", "the kernel(s) to benchmark (default: all)").type_choice (kernels).optional().allow_multiple();
+
+  OPTIONS
+  + Option ("size", "the number of voxels along each spatial axis of the synthetic images (default: 64)")
+    + Argument ("value").type_integer (4)
+
+  + Option ("volumes", "the number of volumes of the synthetic 4D image (default: 32)")
+    + Argument ("value").type_integer (1)
+
+  + Option ("streamlines", "the number of streamlines to write and read (default: 100000)")
+    + Argument ("value").type_integer (1)
+
+  + Option ("repeats", "the number of times to run each kernel (default: 3)")
+    + Argument ("value").type_integer (1);
+}
+
+
+
+using value_type = float;
+
+size_t size, volumes, num_streamlines, repeats;
+constexpr size_t points_per_streamline = 100;
+
+
+Header make_header (const size_t nvolumes)
+{
+  Header header;
+  header.ndim() = nvolumes > 1 ? 4 : 3;
+  for (size_t axis = 0; axis != 3; ++axis) {
+    header.size (axis) = size;
+    header.spacing (axis) = 2.0;
+  }
+  if (nvolumes > 1) {
+    header.size (3) = nvolumes;
+    header.spacing (3) = 1.0;
+  }
+  header.transform().setIdentity();
+  header.datatype() = DataType::Float32;
+  return header;
+}
+
+
+Image<value_type> random_image (const size_t nvolumes)
+{
+  auto image = Image<value_type>::scratch (make_header (nvolumes), "random data");
+  struct Fill { NOMEMALIGN
+    Math::RNG rng;
+    std::normal_distribution<value_type> normal;
+    void operator() (Image<value_type>& v) { v.value() = normal (rng); }
+  };
+  ThreadedLoop (image).run (Fill(), image);
+  return image;
+}
+
+
+// Run the kernel the requested number of times, returning the fastest time
+template <class Functor>
+double time_kernel (Functor&& kernel)
+{
+  double fastest = std::numeric_limits<double>::infinity();
+  for (size_t r = 0; r != repeats; ++r) {
+    Timer timer;
+    kernel();
+    fastest = std::min (fastest, timer.elapsed());
+  }
+  return fastest;
+}
+
+
+void report (const std::string& name, const double seconds, const size_t elements)
+{
+  std::cout << name << "\t" << seconds << "\t" << elements / seconds << "\n";
+  std::cout.flush();
+}
+
+
+
+
+void bench_threaded_loop ()
+{
+  auto a = random_image (volumes), b = random_image (volumes);
+  auto out = Image<value_type>::scratch (make_header (volumes));
+  const double seconds = time_kernel ([&] {
+      ThreadedLoop (out).run ([] (Image<value_type>& o, Image<value_type>& x, Image<value_type>& y) {
+          o.value() = x.value() * y.value() + x.value();
+          }, out, a, b);
+      });
+  report ("threaded_loop", seconds, size * size * size * volumes);
+}
+
+
+
+void bench_queue ()
+{
+  const size_t num_items = size * size * size * 4;
+  struct Source { NOMEMALIGN
+    size_t count, total;
+    bool operator() (Eigen::Vector4f& item) {
+      if (count == total)
+        return false;
+      item.setConstant (float (count++));
+      return true;
+    }
+  };
+  struct Pipe { NOMEMALIGN
+    bool operator() (const Eigen::Vector4f& in, Eigen::Vector4f& out) {
+      out = in.cwiseProduct (in);
+      return true;
+    }
+  };
+  struct Sink { NOMEMALIGN
+    double sum;
+    bool operator() (const Eigen::Vector4f& item) {
+      sum += item.sum();
+      return true;
+    }
+  };
+
+  const double seconds = time_kernel ([&] {
+      Source source { 0, num_items };
+      Sink sink { 0.0 };
+      Thread::run_queue (source, Eigen::Vector4f(), Thread::multi (Pipe()), Eigen::Vector4f(), sink);
+      });
+  report ("queue", seconds, num_items);
+}
+
+
+
+template <template <class> class InterpType>
+void bench_interp (const std::string& name)
+{
+  auto in = random_image (1);
+  auto out = Image<value_type>::scratch (make_header (1));
+
+  struct Resample { MEMALIGN(Resample)
+    InterpType<Image<value_type>> interp;
+    void operator() (Image<value_type>& o) {
+      interp.voxel (Eigen::Vector3 (o.index(0) + 0.37, o.index(1) + 0.51, o.index(2) - 0.23));
+      o.value() = interp.value();
+    }
+  };
+
+  const double seconds = time_kernel ([&] {
+      ThreadedLoop (out).run (Resample { InterpType<Image<value_type>> (in, 0.0) }, out);
+      });
+  report (name, seconds, size * size * size);
+}
+
+
+
+void bench_sh2amp ()
+{
+  const int lmax = 8;
+  auto sh = random_image (Math::SH::NforL (lmax));
+  auto amp = Image<value_type>::scratch (make_header (300));
+  const Eigen::MatrixXf transform = Math::SH::init_transform (DWI::Directions::electrostatic_repulsion_300(), lmax).cast<value_type>();
+
+  struct Evaluate { MEMALIGN(Evaluate)
+    const Eigen::MatrixXf& transform;
+    Eigen::VectorXf in, out;
+    void operator() (Image<value_type>& sh, Image<value_type>& amp) {
+      in = sh.row (3);
+      Math::Kernels::mult (out, transform, in);
+      amp.row (3) = out;
+    }
+  };
+
+  const double seconds = time_kernel ([&] {
+      ThreadedLoop (sh, 0, 3).run (Evaluate { transform, Eigen::VectorXf(), Eigen::VectorXf() }, sh, amp);
+      });
+  report ("sh2amp", seconds, size * size * size);
+}
+
+
+
+void bench_tck (const bool do_write, const bool do_read)
+{
+  const std::string path = File::create_tempfile (0, "tck");
+  try {
+    // Random walks with a fixed step size, seeded uniformly within a box
+    Math::RNG rng;
+    std::uniform_real_distribution<value_type> uniform (-50.0, 50.0);
+    std::normal_distribution<value_type> normal;
+    vector<DWI::Tractography::Streamline<value_type>> tracks (1000);
+    for (auto& tck : tracks) {
+      Eigen::Vector3f pos (uniform (rng), uniform (rng), uniform (rng));
+      Eigen::Vector3f dir (normal (rng), normal (rng), normal (rng));
+      for (size_t i = 0; i != points_per_streamline; ++i) {
+        tck.push_back (pos);
+        dir = (dir.normalized() + Eigen::Vector3f (normal (rng), normal (rng), normal (rng)) * 0.1f).normalized();
+        pos += dir;
+      }
+    }
+
+    auto write = [&] {
+      if (Path::exists (path))
+        File::unlink (path);
+      DWI::Tractography::Properties properties;
+      DWI::Tractography::Writer<value_type> writer (path, properties);
+      for (size_t n = 0; n != num_streamlines; ++n)
+        writer (tracks[n % tracks.size()]);
+    };
+    auto read = [&] {
+      DWI::Tractography::Properties properties;
+      DWI::Tractography::Reader<value_type> reader (path, properties);
+      DWI::Tractography::Streamline<value_type> tck;
+      size_t count = 0;
+      while (reader (tck))
+        ++count;
+      if (count != num_streamlines)
+        throw Exception ("streamline count mismatch when reading benchmark track file");
+    };
+
+    const double write_seconds = time_kernel (write);
+    if (do_write)
+      report ("tck_write", write_seconds, num_streamlines * points_per_streamline);
+    if (do_read)
+      report ("tck_read", time_kernel (read), num_streamlines * points_per_streamline);
+  }
+  catch (...) {
+    File::unlink (path);
+    throw;
+  }
+  File::unlink (path);
+}
+
+
+
+
+void run ()
+{
+  size = get_option_value ("size", 64);
+  volumes = get_option_value ("volumes", 32);
+  num_streamlines = get_option_value ("streamlines", 100000);
+  repeats = get_option_value ("repeats", 3);
+
+  vector<bool> selected (sizeof(kernels) / sizeof(kernels[0]) - 1, argument.empty());
+  for (const auto& arg : argument)
+    selected[int(arg)] = true;
+
+  if (selected[0]) bench_threaded_loop();
+  if (selected[1]) bench_queue();
+  if (selected[2]) bench_interp<Interp::Linear> ("interp_linear");
+  if (selected[3]) bench_interp<Interp::Cubic> ("interp_cubic");
+  if (selected[4]) bench_sh2amp();
+  if (selected[5] || selected[6]) bench_tck (selected[5], selected[6]);
+}
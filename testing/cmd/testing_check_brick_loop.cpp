@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/loop.h"
+#include "algo/threaded_loop.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Check the brick-wise traversal of images, and the storage of bricked images";
+
+  DESCRIPTION
+  + "An image of known values is written to the output image using ThreadedBrickLoop(), "
+    "counting the number of times each voxel is visited. The image is then closed, "
+    "re-opened, and its contents checked against the known values, both using Loop() "
+    "and using ThreadedBrickLoop(). If the output image is in the MRtrix bricked "
+    "format (.mib), this also exercises the eviction and write-back of its bricks, "
+    "depending on the BrickSize and BrickCacheSize config file entries. The test fails "
+    "on the first discrepancy.";
+
+  ARGUMENTS
+  + Argument ("image", "the output image.").type_image_out();
+}
+
+
+
+// a value unique to each voxel:
+template <class ImageType>
+  float expected_value (const ImageType& image)
+  {
+    return image.index(0) + 16*image.index(1) + 256*image.index(2) + 4096*image.index(3) - 1000;
+  }
+
+
+template <class ImageType>
+  std::string position (const ImageType& image)
+  {
+    return "[ " + str(image.index(0)) + " " + str(image.index(1)) + " " + str(image.index(2)) + " " + str(image.index(3)) + " ]";
+  }
+
+
+
+void run ()
+{
+  Header header;
+  header.ndim() = 4;
+  header.transform().setIdentity();
+  const ssize_t sizes[] = { 13, 11, 9, 3 };
+  for (size_t n = 0; n < 4; ++n) {
+    header.size(n) = sizes[n];
+    header.spacing(n) = 1.0;
+  }
+  header.datatype() = DataType::Float32;
+  header.datatype().set_byte_order_native();
+
+  {
+    auto out = Image<float>::create (argument[0], header);
+    auto visits = Image<uint8_t>::scratch (header, "voxel visits");
+    ThreadedBrickLoop (out).run ([] (Image<float>& out, Image<uint8_t>& visits) {
+        out.value() = expected_value (out);
+        visits.value() = visits.value() + 1;
+        }, out, visits);
+
+    for (auto l = Loop (visits) (visits); l; ++l)
+      if (visits.value() != 1)
+        throw Exception ("voxel " + position (visits) + " visited " + str(int(visits.value())) + " times - test FAILED");
+  }
+
+  auto in = Image<float>::open (argument[0]);
+  check_dimensions (in, header);
+  for (auto l = Loop (in) (in); l; ++l)
+    if (in.value() != expected_value (in))
+      throw Exception ("incorrect value at " + position (in) + " - test FAILED");
+
+  std::atomic<size_t> mismatches (0);
+  ThreadedBrickLoop (in).run ([&] (Image<float>& in) {
+      if (in.value() != expected_value (in))
+        ++mismatches;
+      }, in);
+  if (mismatches)
+    throw Exception (str(size_t(mismatches)) + " incorrect values read using ThreadedBrickLoop() - test FAILED");
+
+  CONSOLE ("data checked OK");
+}
+
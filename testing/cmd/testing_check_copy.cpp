@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/copy.h"
+#include "algo/loop.h"
+#include "algo/threaded_copy.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Check the copying of image data between images of different strides and data types";
+
+  DESCRIPTION
+  + "Scratch images of various strides and data types are filled with known values, "
+    "and copied using both copy() and threaded_copy(), with all images initially "
+    "positioned at an arbitrary voxel (including one past the end of each axis, as left "
+    "by a completed Loop). The contents of each destination image are then checked "
+    "against the known values. The test fails on the first discrepancy.";
+
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+using stride_type = vector<ssize_t>;
+
+// a value unique to each voxel, exactly representable by all data types tested:
+template <class ImageType>
+  int expected_value (const ImageType& image)
+  {
+    return image.index(0) + 8*image.index(1) + 64*image.index(2) + 512*image.index(3) - 1000;
+  }
+
+
+template <typename ValueType>
+  Image<ValueType> make_image (const stride_type& strides)
+  {
+    Header header;
+    header.ndim() = 4;
+    header.transform().setIdentity();
+    const ssize_t sizes[] = { 7, 5, 6, 3 };
+    for (size_t n = 0; n < 4; ++n) {
+      header.size(n) = sizes[n];
+      header.spacing(n) = 1.0;
+      header.stride(n) = strides[n];
+    }
+    return Image<ValueType>::scratch (header);
+  }
+
+
+// position an image at the voxel \a pos along each axis, clamped to the
+// range [0, size]:
+template <class ImageType>
+  void displace (ImageType& image, const ssize_t pos)
+  {
+    for (size_t n = 0; n < image.ndim(); ++n)
+      image.index(n) = std::min (pos, ssize_t (image.size(n)));
+  }
+
+
+template <class ImageType>
+  void check (ImageType& image, const std::string& what)
+  {
+    for (auto l = Loop (image) (image); l; ++l)
+      if (cdouble (image.value()) != cdouble (expected_value (image)))
+        throw Exception (what + ": incorrect value at [ " + str(image.index(0)) + " " + str(image.index(1)) + " "
+            + str(image.index(2)) + " " + str(image.index(3)) + " ] - test FAILED");
+  }
+
+
+template <typename InputValueType, typename OutputValueType>
+  void check_copy (const stride_type& in_strides, const stride_type& out_strides)
+  {
+    auto in = make_image<InputValueType> (in_strides);
+    for (auto l = Loop (in) (in); l; ++l)
+      in.value() = expected_value (in);
+
+    const std::string what = std::string ("copy from ") + DataType::from<InputValueType>().specifier() + " [ " + str(in_strides) + " ] to "
+      + DataType::from<OutputValueType>().specifier() + " [ " + str(out_strides) + " ]";
+
+    for (ssize_t pos : { ssize_t(0), ssize_t(2), std::numeric_limits<ssize_t>::max() }) {
+      auto out = make_image<OutputValueType> (out_strides);
+      displace (in, pos);
+      displace (out, pos);
+      copy (in, out);
+      check (out, what + " (initial position " + str(pos) + ")");
+
+      auto threaded_out = make_image<OutputValueType> (out_strides);
+      displace (in, pos);
+      displace (threaded_out, pos);
+      threaded_copy (in, threaded_out);
+      check (threaded_out, "threaded " + what + " (initial position " + str(pos) + ")");
+    }
+  }
+
+
+template <typename InputValueType, typename OutputValueType>
+  void check_strides ()
+  {
+    const vector<stride_type> strides = { { 1, 2, 3, 4 }, { 2, 1, 3, 4 }, { 3, 2, 1, 4 }, { -1, 2, -3, 4 }, { 4, 1, 2, 3 } };
+    for (const auto& in_strides : strides)
+      for (const auto& out_strides : strides)
+        check_copy<InputValueType,OutputValueType> (in_strides, out_strides);
+  }
+
+
+
+void run ()
+{
+  check_strides<float,float>();
+  check_strides<float,int16_t>();
+  check_strides<int32_t,double>();
+  check_strides<int16_t,cfloat>();
+
+  CONSOLE ("data checked OK");
+}
+
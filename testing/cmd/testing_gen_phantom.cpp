@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/threaded_loop.h"
+#include "file/path.h"
+#include "file/utils.h"
+#include "math/least_squares.h"
+#include "math/rng.h"
+#include "math/SH.h"
+#include "math/ZSH.h"
+#include "math/sphere.h"
+#include "dwi/gradient.h"
+#include "dwi/directions/predefined.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Generate a synthetic diffusion phantom of configurable size, for use in benchmarking";
+
+  DESCRIPTION
+  + "The phantom consists of a spherical mask containing a bundle of fibres circulating "
+    "about the z-axis, crossed by a second bundle parallel to the z-axis in the positive-x "
+    "half of the sphere, along with an isotropic free water compartment throughout."
+
+  + "The following files are written to the output directory: "
+    "mask.mif (the phantom mask); "
+    "fod.mif (the ground truth white matter FOD, as a sum of apodised point spread functions with lmax=8); "
+    "dwi.mif (the synthetic DWI data, with b=0, 1000 & 3000 s/mm^2 shells, "
+    "embedded gradient table and Gaussian noise); "
+    "wm.txt and csf.txt (the corresponding response functions, as used by dwi2fod msmt_csd).";
+
+  ARGUMENTS
+  + Argument ("size", "the number of voxels along each axis of the phantom").type_integer (8)
+  + Argument ("directory", "the output directory").type_directory_out();
+
+  OPTIONS
+  + Option ("snr", "the signal-to-noise ratio of the b=0 signal (default: 50)")
+    + Argument ("value").type_float (1.0);
+}
+
+
+using value_type = default_type;
+
+constexpr int lmax = 8;
+constexpr value_type voxel_size = 2.0;
+constexpr value_type wm_fraction = 0.8;
+constexpr value_type axial_diffusivity = 1.7e-3;
+constexpr value_type radial_diffusivity = 0.3e-3;
+constexpr value_type free_diffusivity = 3.0e-3;
+
+
+
+// Zonal harmonic representation of an axially symmetric tensor signal,
+//   for each shell of the acquisition
+Eigen::MatrixXd response (const vector<value_type>& bvalues, const value_type axial, const value_type radial, const int response_lmax)
+{
+  const size_t num_elevations = 91;
+  Eigen::VectorXd elevations (num_elevations);
+  for (size_t i = 0; i != num_elevations; ++i)
+    elevations[i] = Math::pi * i / value_type (num_elevations - 1);
+  const Eigen::MatrixXd A2ZSH = Math::pinv (Math::ZSH::init_amp_transform<value_type> (elevations, response_lmax));
+
+  Eigen::MatrixXd amplitudes (num_elevations, bvalues.size());
+  for (size_t shell = 0; shell != bvalues.size(); ++shell) {
+    for (size_t i = 0; i != num_elevations; ++i) {
+      const value_type cos_el = std::cos (elevations[i]);
+      amplitudes (i, shell) = std::exp (-bvalues[shell] * (radial + (axial - radial) * cos_el * cos_el));
+    }
+  }
+  return (A2ZSH * amplitudes).transpose();
+}
+
+
+
+// Fibre orientations and densities for a voxel at normalised position p within [-1,1]^3
+void fibres (const Eigen::Vector3& p, vector<std::pair<Eigen::Vector3, value_type>>& result)
+{
+  result.clear();
+  const value_type rho = std::sqrt (Math::pow2 (p[0]) + Math::pow2 (p[1]));
+  const Eigen::Vector3 circumferential = rho > 0.05 ? Eigen::Vector3 (-p[1] / rho, p[0] / rho, 0.0) : Eigen::Vector3 (1.0, 0.0, 0.0);
+  if (p[0] > 0.0) {
+    result.push_back (std::make_pair (circumferential, 0.5 * wm_fraction));
+    result.push_back (std::make_pair (Eigen::Vector3 (0.0, 0.0, 1.0), 0.5 * wm_fraction));
+  } else {
+    result.push_back (std::make_pair (circumferential, wm_fraction));
+  }
+}
+
+
+
+void run ()
+{
+  const size_t size = argument[0];
+  const std::string directory = argument[1];
+  if (Path::exists (directory)) {
+    if (!Path::is_dir (directory))
+      throw Exception ("output path \"" + directory + "\" exists and is not a directory");
+  } else {
+    File::mkdir (directory);
+  }
+  const value_type snr = get_option_value ("snr", value_type (50.0));
+
+  // Gradient scheme: 3 b=0 volumes, followed by two 60-direction shells
+  const vector<value_type> bvalues { 0.0, 1000.0, 3000.0 };
+  const Eigen::MatrixXd shell_dirs = DWI::Directions::electrostatic_repulsion_60();
+  Eigen::MatrixXd unit_dirs (shell_dirs.rows(), 3);
+  Math::Sphere::spherical2cartesian (shell_dirs, unit_dirs);
+  const size_t num_b0 = 3;
+  Eigen::MatrixXd grad (num_b0 + 2 * unit_dirs.rows(), 4);
+  grad.topRows (num_b0).setZero();
+  for (size_t shell = 1; shell != bvalues.size(); ++shell) {
+    for (ssize_t i = 0; i != unit_dirs.rows(); ++i) {
+      auto row = grad.row (num_b0 + (shell - 1) * unit_dirs.rows() + i);
+      row.head (3) = unit_dirs.row (i);
+      row[3] = bvalues[shell];
+    }
+  }
+
+  const Eigen::MatrixXd wm_response = response (bvalues, axial_diffusivity, radial_diffusivity, lmax);
+  const Eigen::MatrixXd csf_response = response (bvalues, free_diffusivity, free_diffusivity, 0);
+  save_matrix (wm_response, Path::join (directory, "wm.txt"));
+  save_matrix (csf_response, Path::join (directory, "csf.txt"));
+
+  // Per-volume signal transforms: the WM signal is the FOD convolved with the
+  //   WM response, evaluated along the gradient direction of each volume
+  const size_t nSH = Math::SH::NforL (lmax);
+  Eigen::MatrixXd wm_transform (grad.rows(), nSH);
+  Eigen::VectorXd csf_signal (grad.rows());
+  for (ssize_t volume = 0; volume != grad.rows(); ++volume) {
+    const size_t shell = volume < ssize_t(num_b0) ? 0 : 1 + (volume - num_b0) / unit_dirs.rows();
+    Eigen::VectorXd RH, delta;
+    Math::ZSH::ZSH2RH (RH, Eigen::VectorXd (wm_response.row (shell)));
+    const Eigen::Vector3 dir = volume < ssize_t(num_b0) ? Eigen::Vector3 (0.0, 0.0, 1.0) : Eigen::Vector3 (grad.row (volume).head (3));
+    Math::SH::delta (delta, dir, lmax);
+    Math::SH::sconv (delta, RH);
+    wm_transform.row (volume) = delta;
+    csf_signal[volume] = csf_response (shell, 0) / std::sqrt (4.0 * Math::pi);
+  }
+
+  Header header;
+  header.ndim() = 3;
+  for (size_t axis = 0; axis != 3; ++axis) {
+    header.size (axis) = size;
+    header.spacing (axis) = voxel_size;
+  }
+  header.transform().setIdentity();
+  header.transform().translation().fill (-0.5 * voxel_size * (size - 1));
+  header.datatype() = DataType::Bit;
+  auto mask = Image<bool>::create (Path::join (directory, "mask.mif"), header);
+
+  header.ndim() = 4;
+  header.datatype() = DataType::Float32;
+  header.datatype().set_byte_order_native();
+  header.size (3) = nSH;
+  auto fod = Image<float>::create (Path::join (directory, "fod.mif"), header);
+
+  header.size (3) = grad.rows();
+  DWI::set_DW_scheme (header, grad);
+  auto dwi = Image<float>::create (Path::join (directory, "dwi.mif"), header);
+
+  struct Synthesise { MEMALIGN(Synthesise)
+    const Eigen::MatrixXd& wm_transform;
+    const Eigen::VectorXd& csf_signal;
+    const Math::SH::aPSF<value_type>& psf;
+    const value_type noise, scale;
+    Math::RNG rng;
+    std::normal_distribution<value_type> normal;
+    vector<std::pair<Eigen::Vector3, value_type>> populations;
+    Eigen::VectorXd fod_sh, delta, signal;
+
+    Synthesise (const Eigen::MatrixXd& wm_transform, const Eigen::VectorXd& csf_signal, const Math::SH::aPSF<value_type>& psf, const value_type noise, const size_t size) :
+        wm_transform (wm_transform),
+        csf_signal (csf_signal),
+        psf (psf),
+        noise (noise),
+        scale (2.0 / value_type (size - 1)) { }
+    Synthesise (const Synthesise& that) :
+        wm_transform (that.wm_transform),
+        csf_signal (that.csf_signal),
+        psf (that.psf),
+        noise (that.noise),
+        scale (that.scale) { }
+
+    void operator() (Image<bool>& mask, Image<float>& fod, Image<float>& dwi)
+    {
+      const Eigen::Vector3 p (scale * mask.index (0) - 1.0, scale * mask.index (1) - 1.0, scale * mask.index (2) - 1.0);
+      const bool inside = p.norm() < 0.9;
+      mask.value() = inside;
+      fod_sh.setZero (wm_transform.cols());
+      if (inside) {
+        fibres (p, populations);
+        for (const auto& f : populations) {
+          psf (delta, f.first);
+          fod_sh += f.second * delta;
+        }
+      }
+      for (auto l = Loop (3) (fod); l; ++l)
+        fod.value() = fod_sh[fod.index (3)];
+      signal.noalias() = wm_transform * fod_sh;
+      if (inside)
+        signal += (1.0 - wm_fraction) * csf_signal;
+      for (auto l = Loop (3) (dwi); l; ++l)
+        dwi.value() = signal[dwi.index (3)] + noise * normal (rng);
+    }
+  };
+
+  const value_type b0_signal = wm_fraction * wm_response (0, 0) / std::sqrt (4.0 * Math::pi) + (1.0 - wm_fraction) * csf_signal[0];
+  const Math::SH::aPSF<value_type> psf (lmax);
+  ThreadedLoop ("generating phantom", mask, 0, 3).run (Synthesise (wm_transform, csf_signal, psf, b0_signal / snr, size), mask, fod, dwi);
+}
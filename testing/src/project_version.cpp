@@ -0,0 +1,11 @@
+
+namespace MR {
+  namespace App {
+    extern const char* project_version;
+    extern const char* project_build_date;
+    void set_project_version () {
+      project_version = "4181ff18";
+      project_build_date = __DATE__;
+    }
+  }
+}